@@ -51,6 +51,48 @@ float EnvironmentCamera::GenerateRay(const CameraSample &sample,
 }
 
 
+void EnvironmentCamera::GenerateRayDifferentials(const CameraSample *samples,
+        int n, RayDifferential *rays, float *weights) const {
+    const int B = CAMERA_BATCH_SIZE;
+    float thetaScale = M_PI / film->yResolution;
+    float phiScale = 2 * M_PI / film->xResolution;
+    for (int start = 0; start < n; start += B) {
+        int count = min(B, n - start);
+        const CameraSample *cs = &samples[start];
+        RayDifferential *ray = &rays[start];
+
+        // Compute spherical angles of the main and offset rays for the batch
+        float sinTheta[2][B], cosTheta[2][B], sinPhi[2][B], cosPhi[2][B];
+        for (int i = 0; i < count; ++i) {
+            for (int j = 0; j < 2; ++j) {
+                float theta = thetaScale * (cs[i].imageY + j);
+                float phi = phiScale * (cs[i].imageX + j);
+                sinTheta[j][i] = sinf(theta);
+                cosTheta[j][i] = cosf(theta);
+                sinPhi[j][i] = sinf(phi);
+                cosPhi[j][i] = cosf(phi);
+            }
+        }
+
+        // Initialize camera space rays and transform them to world space
+        for (int i = 0; i < count; ++i) {
+            ray[i] = RayDifferential(Point(0,0,0),
+                Vector(sinTheta[0][i] * cosPhi[0][i], cosTheta[0][i],
+                       sinTheta[0][i] * sinPhi[0][i]), 0.f, INFINITY,
+                Lerp(cs[i].time, shutterOpen, shutterClose));
+            ray[i].rxOrigin = ray[i].ryOrigin = ray[i].o;
+            ray[i].rxDirection = Vector(sinTheta[0][i] * cosPhi[1][i],
+                cosTheta[0][i], sinTheta[0][i] * sinPhi[1][i]);
+            ray[i].ryDirection = Vector(sinTheta[1][i] * cosPhi[0][i],
+                cosTheta[1][i], sinTheta[1][i] * sinPhi[0][i]);
+            ray[i].hasDifferentials = true;
+            weights[start + i] = 1.f;
+        }
+        CameraToWorld(ray, count, ray);
+    }
+}
+
+
 EnvironmentCamera *CreateEnvironmentCamera(const ParamSet &params,
         const AnimatedTransform &cam2world, Film *film) {
     // Extract common camera parameters from _ParamSet_
@@ -49,6 +49,8 @@ public:
         : Camera(cam2world, sopen, sclose, film) {
     }
     float GenerateRay(const CameraSample &sample, Ray *) const;
+    void GenerateRayDifferentials(const CameraSample *samples, int n,
+                                  RayDifferential *rays, float *weights) const;
 };
 
 
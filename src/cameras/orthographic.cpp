@@ -44,6 +44,7 @@ OrthoCamera::OrthoCamera(const AnimatedTransform &cam2world,
     : ProjectiveCamera(cam2world, Orthographic(0., 1.), screenWindow,
                        sopen, sclose, lensr, focald, f) {
     // Compute differential changes in origin for ortho camera rays
+    rasterOrigin = RasterToCamera(Point(0,0,0));
     dxCamera = RasterToCamera(Vector(1, 0, 0));
     dyCamera = RasterToCamera(Vector(0, 1, 0));
 }
@@ -113,6 +114,51 @@ float OrthoCamera::GenerateRayDifferential(const CameraSample &sample,
 }
 
 
+void OrthoCamera::GenerateRayDifferentials(const CameraSample *samples,
+        int n, RayDifferential *rays, float *weights) const {
+    const int B = CAMERA_BATCH_SIZE;
+    bool thinLens = lensRadius > 0.f;
+    for (int start = 0; start < n; start += B) {
+        int count = min(B, n - start);
+        const CameraSample *cs = &samples[start];
+        RayDifferential *ray = &rays[start];
+
+        // Compute camera space ray origins for the batch
+        float o[3][B];
+        for (int i = 0; i < count; ++i) {
+            o[0][i] = rasterOrigin.x + cs[i].imageX * dxCamera.x +
+                                       cs[i].imageY * dyCamera.x;
+            o[1][i] = rasterOrigin.y + cs[i].imageX * dxCamera.y +
+                                       cs[i].imageY * dyCamera.y;
+            o[2][i] = rasterOrigin.z + cs[i].imageX * dxCamera.z +
+                                       cs[i].imageY * dyCamera.z;
+        }
+
+        // Initialize camera space rays and transform them to world space
+        for (int i = 0; i < count; ++i) {
+            Point Pcamera(o[0][i], o[1][i], o[2][i]);
+            ray[i] = RayDifferential(Pcamera, Vector(0,0,1), 0.f, INFINITY,
+                Lerp(cs[i].time, shutterOpen, shutterClose));
+            if (thinLens) {
+                // Aim from the lens at the point on the plane of focus
+                float lensU, lensV;
+                ConcentricSampleDisk(cs[i].lensU, cs[i].lensV,
+                                     &lensU, &lensV);
+                ray[i].o = Point(lensU * lensRadius, lensV * lensRadius, 0.f);
+                ray[i].d = Normalize(Pcamera +
+                    Vector(0.f, 0.f, focalDistance) - ray[i].o);
+            }
+            ray[i].rxOrigin = ray[i].o + dxCamera;
+            ray[i].ryOrigin = ray[i].o + dyCamera;
+            ray[i].rxDirection = ray[i].ryDirection = ray[i].d;
+            ray[i].hasDifferentials = true;
+            weights[start + i] = 1.f;
+        }
+        CameraToWorld(ray, count, ray);
+    }
+}
+
+
 OrthoCamera *CreateOrthographicCamera(const ParamSet &params,
         const AnimatedTransform &cam2world, Film *film) {
     // Extract common camera parameters from _ParamSet_
@@ -49,8 +49,11 @@ public:
         float sopen, float sclose, float lensr, float focald, Film *film);
     float GenerateRay(const CameraSample &sample, Ray *) const;
     float GenerateRayDifferential(const CameraSample &sample, RayDifferential *) const;
+    void GenerateRayDifferentials(const CameraSample *samples, int n,
+                                  RayDifferential *rays, float *weights) const;
 private:
     // OrthoCamera Private Data
+    Point rasterOrigin;
     Vector dxCamera, dyCamera;
 };
 
@@ -44,8 +44,9 @@ PerspectiveCamera:: PerspectiveCamera(const AnimatedTransform &cam2world,
     : ProjectiveCamera(cam2world, Perspective(fov, 1e-2f, 1000.f),
                        screenWindow, sopen, sclose, lensr, focald, f) {
     // Compute differential changes in origin for perspective camera rays
-    dxCamera = RasterToCamera(Point(1,0,0)) - RasterToCamera(Point(0,0,0));
-    dyCamera = RasterToCamera(Point(0,1,0)) - RasterToCamera(Point(0,0,0));
+    rasterOrigin = RasterToCamera(Point(0,0,0));
+    dxCamera = RasterToCamera(Point(1,0,0)) - rasterOrigin;
+    dyCamera = RasterToCamera(Point(0,1,0)) - rasterOrigin;
 }
 
 
@@ -136,6 +137,75 @@ float PerspectiveCamera::GenerateRayDifferential(const CameraSample &sample,
 }
 
 
+void PerspectiveCamera::GenerateRayDifferentials(const CameraSample *samples,
+        int n, RayDifferential *rays, float *weights) const {
+    const int B = CAMERA_BATCH_SIZE;
+    bool thinLens = lensRadius > 0.f;
+    for (int start = 0; start < n; start += B) {
+        int count = min(B, n - start);
+        const CameraSample *cs = &samples[start];
+        RayDifferential *ray = &rays[start];
+
+        // Sample points on lens, which are the ray origins
+        float lensU[B], lensV[B];
+        for (int i = 0; i < count; ++i) {
+            if (thinLens) {
+                ConcentricSampleDisk(cs[i].lensU, cs[i].lensV,
+                                     &lensU[i], &lensV[i]);
+                lensU[i] *= lensRadius;
+                lensV[i] *= lensRadius;
+            }
+            else
+                lensU[i] = lensV[i] = 0.f;
+        }
+
+        // Compute main and offset ray directions for the batch
+        // _RasterToCamera_ is affine on the $z=0$ raster plane, so camera
+        // space points are found from _rasterOrigin_ and the differentials
+        float d[3][B], dx[3][B], dy[3][B];
+        for (int i = 0; i < count; ++i) {
+            float px = rasterOrigin.x + cs[i].imageX * dxCamera.x +
+                                        cs[i].imageY * dyCamera.x;
+            float py = rasterOrigin.y + cs[i].imageX * dxCamera.y +
+                                        cs[i].imageY * dyCamera.y;
+            float pz = rasterOrigin.z + cs[i].imageX * dxCamera.z +
+                                        cs[i].imageY * dyCamera.z;
+            float p[3][3] = { { px, py, pz },
+                { px + dxCamera.x, py + dxCamera.y, pz + dxCamera.z },
+                { px + dyCamera.x, py + dyCamera.y, pz + dyCamera.z } };
+            float (*out[3])[B] = { d, dx, dy };
+            for (int j = 0; j < 3; ++j) {
+                float x = p[j][0], y = p[j][1], z = p[j][2];
+                if (thinLens) {
+                    // Aim from the lens at the point on the plane of focus
+                    float ft = focalDistance / z;
+                    x = x * ft - lensU[i];
+                    y = y * ft - lensV[i];
+                    z = z * ft;
+                }
+                float invLen = 1.f / sqrtf(x*x + y*y + z*z);
+                out[j][0][i] = x * invLen;
+                out[j][1][i] = y * invLen;
+                out[j][2][i] = z * invLen;
+            }
+        }
+
+        // Initialize camera space rays and transform them to world space
+        for (int i = 0; i < count; ++i) {
+            ray[i] = RayDifferential(Point(lensU[i], lensV[i], 0.f),
+                Vector(d[0][i], d[1][i], d[2][i]), 0.f, INFINITY,
+                Lerp(cs[i].time, shutterOpen, shutterClose));
+            ray[i].rxOrigin = ray[i].ryOrigin = ray[i].o;
+            ray[i].rxDirection = Vector(dx[0][i], dx[1][i], dx[2][i]);
+            ray[i].ryDirection = Vector(dy[0][i], dy[1][i], dy[2][i]);
+            ray[i].hasDifferentials = true;
+            weights[start + i] = 1.f;
+        }
+        CameraToWorld(ray, count, ray);
+    }
+}
+
+
 PerspectiveCamera *CreatePerspectiveCamera(const ParamSet &params,
         const AnimatedTransform &cam2world, Film *film) {
     // Extract common camera parameters from _ParamSet_
@@ -51,8 +51,11 @@ public:
     float GenerateRay(const CameraSample &sample, Ray *) const;
     float GenerateRayDifferential(const CameraSample &sample,
                                   RayDifferential *ray) const;
+    void GenerateRayDifferentials(const CameraSample *samples, int n,
+                                  RayDifferential *rays, float *weights) const;
 private:
     // PerspectiveCamera Private Data
+    Point rasterOrigin;
     Vector dxCamera, dyCamera;
 };
 
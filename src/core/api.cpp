@@ -41,6 +41,7 @@
 #include "film.h"
 #include "volume.h"
 #include "probes.h"
+#include "imageio.h"
 
 // API Additional Headers
 #include "accelerators/bvh.h"
@@ -199,6 +200,7 @@ struct RenderOptions {
     mutable vector<VolumeRegion *> volumeRegions;
     map<string, vector<Reference<Primitive> > > instances;
     vector<Reference<Primitive> > *currentInstance;
+    uint64_t sceneHash;
 };
 
 
@@ -215,6 +217,7 @@ RenderOptions::RenderOptions() {
     VolIntegratorName = "emission";
     CameraName = "perspective";
     currentInstance = NULL;
+    sceneHash = HashBytes(NULL, 0);
 }
 
 
@@ -694,6 +697,20 @@ Film *MakeFilm(const string &name,
 }
 
 
+static void HashSceneInput(const string &directive, const string &name,
+                           const ParamSet &params) {
+    // Accumulate world block input into _renderOptions->sceneHash_
+    uint64_t &hash = renderOptions->sceneHash;
+    hash = HashBytes(directive.c_str(), directive.size() + 1, hash);
+    hash = HashBytes(name.c_str(), name.size() + 1, hash);
+    hash = params.Hash(hash);
+    for (int i = 0; i < MAX_TRANSFORMS; ++i)
+        hash = HashBytes(&curTransform[i], sizeof(Transform), hash);
+    hash = HashBytes(&renderOptions->transformStartTime, sizeof(float), hash);
+    hash = HashBytes(&renderOptions->transformEndTime, sizeof(float), hash);
+}
+
+
 
 // API Function Definitions
 void pbrtInit(const Options &opt) {
@@ -881,6 +898,7 @@ void pbrtWorldBegin() {
         curTransform[i] = Transform();
     activeTransformBits = ALL_TRANSFORMS_BITS;
     namedCoordinateSystems["world"] = curTransform;
+    renderOptions->sceneHash = HashBytes(NULL, 0);
 }
 
 
@@ -932,6 +950,7 @@ void pbrtTransformEnd() {
 void pbrtTexture(const string &name, const string &type,
                  const string &texname, const ParamSet &params) {
     VERIFY_WORLD("Texture");
+    HashSceneInput("Texture", name + " " + type + " " + texname, params);
     TextureParams tp(params, params, graphicsState.floatTextures,
                      graphicsState.spectrumTextures);
     if (type == "float")  {
@@ -969,6 +988,9 @@ void pbrtMaterial(const string &name, const ParamSet &params) {
 void pbrtMakeNamedMaterial(const string &name,
         const ParamSet &params) {
     VERIFY_WORLD("MakeNamedMaterial");
+    HashSceneInput("MakeNamedMaterial", name, params);
+    HashSceneInput("Material", graphicsState.material,
+                   graphicsState.materialParams);
     // error checking, warning if replace, what to use for transform?
     TextureParams mp(params, graphicsState.materialParams,
                      graphicsState.floatTextures,
@@ -992,6 +1014,7 @@ void pbrtNamedMaterial(const string &name) {
 
 void pbrtLightSource(const string &name, const ParamSet &params) {
     VERIFY_WORLD("LightSource");
+    HashSceneInput("LightSource", name, params);
     WARN_IF_ANIMATED_TRANSFORM("LightSource");
     Light *lt = MakeLight(name, curTransform[0], params);
     if (lt == NULL)
@@ -1011,6 +1034,14 @@ void pbrtAreaLightSource(const string &name,
 
 void pbrtShape(const string &name, const ParamSet &params) {
     VERIFY_WORLD("Shape");
+    HashSceneInput("Shape", name, params);
+    HashSceneInput("Material", graphicsState.material + " " +
+                   graphicsState.currentNamedMaterial,
+                   graphicsState.materialParams);
+    HashSceneInput("AreaLightSource", graphicsState.areaLight,
+                   graphicsState.areaLightParams);
+    renderOptions->sceneHash = HashBytes(&graphicsState.reverseOrientation,
+        sizeof(bool), renderOptions->sceneHash);
     Reference<Primitive> prim;
     AreaLight *area = NULL;
     if (!curTransform.IsAnimated()) {
@@ -1108,6 +1139,7 @@ void pbrtReverseOrientation() {
 
 void pbrtVolume(const string &name, const ParamSet &params) {
     VERIFY_WORLD("Volume");
+    HashSceneInput("Volume", name, params);
     WARN_IF_ANIMATED_TRANSFORM("Volume");
     VolumeRegion *vr = MakeVolumeRegion(name, curTransform[0], params);
     if (vr) renderOptions->volumeRegions.push_back(vr);
@@ -1116,6 +1148,7 @@ void pbrtVolume(const string &name, const ParamSet &params) {
 
 void pbrtObjectBegin(const string &name) {
     VERIFY_WORLD("ObjectBegin");
+    HashSceneInput("ObjectBegin", name, ParamSet());
     pbrtAttributeBegin();
     if (renderOptions->currentInstance)
         Error("ObjectBegin called inside of instance definition");
@@ -1126,6 +1159,7 @@ void pbrtObjectBegin(const string &name) {
 
 void pbrtObjectEnd() {
     VERIFY_WORLD("ObjectEnd");
+    HashSceneInput("ObjectEnd", "", ParamSet());
     if (!renderOptions->currentInstance)
         Error("ObjectEnd called outside of instance definition");
     renderOptions->currentInstance = NULL;
@@ -1135,6 +1169,7 @@ void pbrtObjectEnd() {
 
 void pbrtObjectInstance(const string &name) {
     VERIFY_WORLD("ObjectInstance");
+    HashSceneInput("ObjectInstance", name, ParamSet());
     // Object instance error checking
     if (renderOptions->currentInstance) {
         Error("ObjectInstance can't be called inside instance definition");
@@ -1189,6 +1224,7 @@ void pbrtWorldEnd() {
     TasksCleanup();
     delete renderer;
     delete scene;
+    ImageWritesCleanup();
 
     // Clean up after rendering
     graphicsState = GraphicsState();
@@ -1221,6 +1257,7 @@ Scene *RenderOptions::MakeScene() {
     if (!accelerator)
         Severe("Unable to create \"bvh\" accelerator.");
     Scene *scene = new Scene(accelerator, lights, volumeRegion);
+    scene->descriptionHash = sceneHash;
     // Erase primitives, lights, and volume regions from _RenderOptions_
     primitives.erase(primitives.begin(), primitives.end());
     lights.erase(lights.begin(), lights.end());
@@ -1270,6 +1307,11 @@ Renderer *RenderOptions::MakeRenderer() const {
             Warning("Renderer type \"%s\" unknown.  Using \"sampler\".",
                     RendererName.c_str());
         bool visIds = RendererParams.FindOneBool("visualizeobjectids", false);
+        float timeBudget = 0.f, targetMse = 0.f;
+        if (RendererName == "sbf") {
+            timeBudget = RendererParams.FindOneFloat("timebudget", 0.f);
+            targetMse = RendererParams.FindOneFloat("targetmse", 0.f);
+        }
         RendererParams.ReportUnused();
         if (RendererName == "sbf" && SamplerName != "sbfsampler") {
             Severe("SBFRenderer only support SBFSampler.");
@@ -1285,7 +1327,8 @@ Renderer *RenderOptions::MakeRenderer() const {
         if (!volumeIntegrator) Severe("Unable to create volume integrator.");
         if (RendererName == "sbf") {
             renderer = new SBFRenderer(sampler, camera, surfaceIntegrator,
-                                       volumeIntegrator);
+                                       volumeIntegrator, timeBudget,
+                                       targetMse);
         } else {
             renderer = new SamplerRenderer(sampler, camera, surfaceIntegrator,
                                            volumeIntegrator, visIds);
@@ -80,6 +80,13 @@ float Camera::GenerateRayDifferential(const CameraSample &sample,
 }
 
 
+void Camera::GenerateRayDifferentials(const CameraSample *samples, int n,
+        RayDifferential *rays, float *weights) const {
+    for (int i = 0; i < n; ++i)
+        weights[i] = GenerateRayDifferential(samples[i], &rays[i]);
+}
+
+
 ProjectiveCamera::ProjectiveCamera(const AnimatedTransform &cam2world,
         const Transform &proj, const float screenWindow[4], float sopen,
         float sclose, float lensr, float focald, Film *f)
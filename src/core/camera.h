@@ -42,6 +42,8 @@
 #include "transform.h"
 
 // Camera Declarations
+// Number of samples processed together by batched ray generation
+#define CAMERA_BATCH_SIZE 64
 class Camera {
 public:
     // Camera Interface
@@ -51,6 +53,8 @@ public:
     virtual float GenerateRay(const CameraSample &sample,
                               Ray *ray) const = 0;
     virtual float GenerateRayDifferential(const CameraSample &sample, RayDifferential *rd) const;
+    virtual void GenerateRayDifferentials(const CameraSample *samples, int n,
+        RayDifferential *rays, float *weights) const;
 
     // Camera Public Data
     AnimatedTransform CameraToWorld;
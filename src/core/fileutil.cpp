@@ -138,4 +138,13 @@ void SetSearchDirectory(const string &dirname) {
 }
 
 
-
+bool HasExtension(const string &filename, const string &ext) {
+    // Compare the suffix of _filename_ against _ext_, ignoring case
+    if (filename.size() < ext.size())
+        return false;
+    size_t offset = filename.size() - ext.size();
+    for (size_t i = 0; i < ext.size(); ++i)
+        if (tolower(filename[offset + i]) != tolower(ext[i]))
+            return false;
+    return true;
+}
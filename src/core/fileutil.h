@@ -46,6 +46,7 @@ string AbsolutePath(const string &filename);
 string ResolveFilename(const string &filename);
 string DirectoryContaining(const string &filename);
 void SetSearchDirectory(const string &dirname);
+bool HasExtension(const string &filename, const string &ext);
 
 #endif // PBRT_CORE_FILEUTIL_H
 
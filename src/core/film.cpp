@@ -35,11 +35,26 @@
 #include "film.h"
 #include "paramset.h"
 
+// FilmTile Method Definitions
+FilmTile::~FilmTile() {
+}
+
+
+
 // Film Method Definitions
 Film::~Film() {
 }
 
 
+FilmTile *Film::GetFilmTile(int xstart, int xend, int ystart, int yend) {
+    return NULL;
+}
+
+
+void Film::MergeFilmTile(FilmTile *tile) {
+}
+
+
 void Film::UpdateDisplay(int x0, int y0, int x1, int y1,
                          float splatScale) {
 }
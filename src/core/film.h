@@ -38,6 +38,17 @@
 // core/film.h*
 #include "pbrt.h"
 
+// FilmTile Declarations
+class FilmTile {
+public:
+    // FilmTile Interface
+    virtual ~FilmTile();
+    virtual void AddSample(const CameraSample &sample, const Spectrum &L,
+                           const Intersection &isect) = 0;
+    virtual void Splat(const CameraSample &sample, const Spectrum &L) = 0;
+};
+
+
 // Film Declarations
 class Film {
 public:
@@ -56,6 +67,9 @@ public:
     virtual void UpdateDisplay(int x0, int y0, int x1, int y1, float splatScale = 1.f);
     virtual void WriteImage(float splatScale = 1.f) = 0;
     virtual void SetSPP(int spp) = 0;
+    virtual FilmTile *GetFilmTile(int xstart, int xend,
+                                  int ystart, int yend);
+    virtual void MergeFilmTile(FilmTile *tile);
     // Film Public Data
     const int xResolution, yResolution;
 };
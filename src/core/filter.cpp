@@ -39,3 +39,15 @@ Filter::~Filter() {
 }
 
 
+
+
+float Filter::EvaluateX(float x) const {
+    Severe("Filter::EvaluateX() called for non-separable filter");
+    return 0.f;
+}
+
+
+float Filter::EvaluateY(float y) const {
+    Severe("Filter::EvaluateY() called for non-separable filter");
+    return 0.f;
+}
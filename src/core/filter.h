@@ -49,6 +49,11 @@ public:
     }
     virtual float Evaluate(float x, float y) const = 0;
 
+    // Separable filters satisfy $f(x,y) = f_x(x) f_y(y)$
+    virtual bool IsSeparable() const { return false; }
+    virtual float EvaluateX(float x) const;
+    virtual float EvaluateY(float y) const;
+
     // Filter Public Data
     const float xWidth, yWidth;
     const float invXWidth, invYWidth;
@@ -35,13 +35,21 @@
 #include "imageio.h"
 #include "spectrum.h"
 #include "targa.h"
+#include "parallel.h"
+#include <list>
 
 // ImageIO Local Declarations
+#ifdef PBRT_HAS_OPENEXR
 static RGBSpectrum *ReadImageEXR(const string &name, int *width, int *height);
 static void WriteImageEXR(const string &name, float *pixels,
         float *alpha, int xRes, int yRes,
         int totalXRes, int totalYRes,
         int xOffset, int yOffset);
+static void WriteImageLayersEXR(const string &name,
+        const vector<string> &layerNames, const vector<float *> &layers,
+        int xRes, int yRes, int totalXRes, int totalYRes,
+        int xOffset, int yOffset);
+#endif // PBRT_HAS_OPENEXR
 static void WriteImageTGA(const string &name, float *pixels,
         float *alpha, int xRes, int yRes,
         int totalXRes, int totalYRes,
@@ -104,6 +112,198 @@ void WriteImage(const string &name, float *pixels, float *alpha, int xRes,
 }
 
 
+void WriteImageLayers(const string &name, const vector<string> &layerNames,
+        const vector<float *> &layers, int xRes, int yRes, int totalXRes,
+        int totalYRes, int xOffset, int yOffset) {
+    Assert(layerNames.size() == layers.size() && layers.size() > 0);
+#ifdef PBRT_HAS_OPENEXR
+    if (name.size() >= 5) {
+        uint32_t suffixOffset = name.size() - 4;
+        if (!strcmp(name.c_str() + suffixOffset, ".exr") ||
+            !strcmp(name.c_str() + suffixOffset, ".EXR")) {
+            WriteImageLayersEXR(name, layerNames, layers, xRes, yRes,
+                                totalXRes, totalYRes, xOffset, yOffset);
+            return;
+        }
+    }
+#endif // PBRT_HAS_OPENEXR
+    // Write one image per layer for formats without multi-layer support
+    string base = name.substr(0, name.rfind("."));
+    string ext = name.substr(name.rfind("."));
+    for (uint32_t i = 0; i < layers.size(); ++i)
+        WriteImage(base + "_" + layerNames[i] + ext, layers[i], NULL, xRes,
+                   yRes, totalXRes, totalYRes, xOffset, yOffset);
+}
+
+
+// Asynchronous Image Writing Local Declarations
+struct ImageWriteRequest {
+    string name;
+    vector<string> layerNames;
+    vector<float *> layers;
+    float *alpha;
+    int xRes, yRes, totalXRes, totalYRes, xOffset, yOffset;
+};
+
+
+static Mutex *imageWriteQueueMutex = Mutex::Create();
+static std::list<ImageWriteRequest *> imageWriteQueue;
+static Semaphore *imageWriteSemaphore;
+static uint32_t numPendingImageWrites;
+static ConditionVariable *imageWritesPendingCondition;
+#if defined(PBRT_IS_WINDOWS)
+static HANDLE imageWriteThread;
+static DWORD WINAPI imageWriteEntry(LPVOID arg);
+#else
+static pthread_t *imageWriteThread;
+static void *imageWriteEntry(void *arg);
+#endif
+
+// Asynchronous Image Writing Definitions
+static void ProcessImageWrite(ImageWriteRequest *req) {
+    if (req->layers.size() == 1)
+        WriteImage(req->name, req->layers[0], req->alpha, req->xRes,
+                   req->yRes, req->totalXRes, req->totalYRes, req->xOffset,
+                   req->yOffset);
+    else
+        WriteImageLayers(req->name, req->layerNames, req->layers,
+                         req->xRes, req->yRes, req->totalXRes,
+                         req->totalYRes, req->xOffset, req->yOffset);
+    for (uint32_t i = 0; i < req->layers.size(); ++i)
+        delete[] req->layers[i];
+    delete[] req->alpha;
+    delete req;
+}
+
+
+static void EnqueueImageWriteRequest(ImageWriteRequest *req) {
+    if (PbrtOptions.nCores == 1) {
+        ProcessImageWrite(req);
+        return;
+    }
+    if (!imageWriteThread) {
+        // Launch background image writing thread
+        imageWriteSemaphore = new Semaphore;
+        imageWritesPendingCondition = new ConditionVariable;
+#if defined(PBRT_IS_WINDOWS)
+        imageWriteThread = CreateThread(NULL, 0, imageWriteEntry, NULL, 0, NULL);
+        if (imageWriteThread == NULL)
+            Severe("Error from CreateThread");
+#else
+        imageWriteThread = new pthread_t;
+        int err = pthread_create(imageWriteThread, NULL, &imageWriteEntry, NULL);
+        if (err != 0)
+            Severe("Error from pthread_create: %s", strerror(err));
+#endif // PBRT_IS_WINDOWS
+    }
+    { MutexLock lock(*imageWriteQueueMutex);
+    imageWriteQueue.push_back(req);
+    }
+    imageWritesPendingCondition->Lock();
+    ++numPendingImageWrites;
+    imageWritesPendingCondition->Unlock();
+    imageWriteSemaphore->Post();
+}
+
+
+#if defined(PBRT_IS_WINDOWS)
+static DWORD WINAPI imageWriteEntry(LPVOID arg) {
+#else
+static void *imageWriteEntry(void *arg) {
+#endif
+    while (true) {
+        imageWriteSemaphore->Wait();
+        // Take oldest request so repeated writes to a file land in order
+        ImageWriteRequest *req = NULL;
+        { MutexLock lock(*imageWriteQueueMutex);
+        if (imageWriteQueue.size() == 0)
+            break;
+        req = imageWriteQueue.front();
+        imageWriteQueue.pop_front();
+        }
+        ProcessImageWrite(req);
+        imageWritesPendingCondition->Lock();
+        int pending = --numPendingImageWrites;
+        if (pending == 0)
+            imageWritesPendingCondition->Signal();
+        imageWritesPendingCondition->Unlock();
+    }
+#if !defined(PBRT_IS_WINDOWS)
+    pthread_exit(NULL);
+#endif // !PBRT_IS_WINDOWS
+    return 0;
+}
+
+
+void EnqueueImageWrite(const string &name, const float *pixels,
+        const float *alpha, int xRes, int yRes, int totalXRes, int totalYRes,
+        int xOffset, int yOffset) {
+    // Copy image data so the caller may reuse its buffers immediately
+    ImageWriteRequest *req = new ImageWriteRequest;
+    req->name = name;
+    req->layerNames.push_back("");
+    req->layers.push_back(new float[3 * xRes * yRes]);
+    memcpy(req->layers[0], pixels, 3 * xRes * yRes * sizeof(float));
+    req->alpha = NULL;
+    if (alpha) {
+        req->alpha = new float[xRes * yRes];
+        memcpy(req->alpha, alpha, xRes * yRes * sizeof(float));
+    }
+    req->xRes = xRes;            req->yRes = yRes;
+    req->totalXRes = totalXRes;  req->totalYRes = totalYRes;
+    req->xOffset = xOffset;      req->yOffset = yOffset;
+    EnqueueImageWriteRequest(req);
+}
+
+
+void EnqueueImageLayersWrite(const string &name,
+        const vector<string> &layerNames, const vector<const float *> &layers,
+        int xRes, int yRes, int totalXRes, int totalYRes, int xOffset,
+        int yOffset) {
+    ImageWriteRequest *req = new ImageWriteRequest;
+    req->name = name;
+    req->layerNames = layerNames;
+    for (uint32_t i = 0; i < layers.size(); ++i) {
+        req->layers.push_back(new float[3 * xRes * yRes]);
+        memcpy(req->layers[i], layers[i], 3 * xRes * yRes * sizeof(float));
+    }
+    req->alpha = NULL;
+    req->xRes = xRes;            req->yRes = yRes;
+    req->totalXRes = totalXRes;  req->totalYRes = totalYRes;
+    req->xOffset = xOffset;      req->yOffset = yOffset;
+    EnqueueImageWriteRequest(req);
+}
+
+
+void WaitForImageWrites() {
+    if (!imageWritesPendingCondition)
+        return;  // no writes have been enqueued
+    imageWritesPendingCondition->Lock();
+    while (numPendingImageWrites > 0)
+        imageWritesPendingCondition->Wait();
+    imageWritesPendingCondition->Unlock();
+}
+
+
+void ImageWritesCleanup() {
+    if (!imageWriteThread)
+        return;
+    WaitForImageWrites();
+    // Wake up writer thread with an empty queue so that it exits
+    imageWriteSemaphore->Post();
+#if defined(PBRT_IS_WINDOWS)
+    WaitForSingleObject(imageWriteThread, INFINITE);
+    CloseHandle(imageWriteThread);
+#else
+    int err = pthread_join(*imageWriteThread, NULL);
+    if (err != 0)
+        Severe("Error from pthread_join: %s", strerror(err));
+    delete imageWriteThread;
+#endif // PBRT_IS_WINDOWS
+    imageWriteThread = NULL;
+}
+
+
 #ifdef PBRT_HAS_OPENEXR
 #if defined(PBRT_IS_WINDOWS)
 #define hypotf hypot // For the OpenEXR headers
@@ -112,10 +312,23 @@ void WriteImage(const string &name, float *pixels, float *alpha, int xRes,
 #include <ImfRgbaFile.h>
 #include <ImfChannelList.h>
 #include <ImfFrameBuffer.h>
+#include <ImfOutputFile.h>
+#include <ImfThreading.h>
+#include <IlmThread.h>
 #include <half.h>
 using namespace Imf;
 using namespace Imath;
 
+static void InitEXRThreading() {
+    // Let OpenEXR compress scanline blocks on all cores
+    static bool initialized = false;
+    if (!initialized) {
+        if (IlmThread::supportsThreads())
+            setGlobalThreadCount(NumSystemCores());
+        initialized = true;
+    }
+}
+
 // EXR Function Definitions
 static RGBSpectrum *ReadImageEXR(const string &name, int *width, int *height) {
     try {
@@ -165,6 +378,7 @@ static void WriteImageEXR(const string &name, float *pixels,
     Box2i displayWindow(V2i(0,0), V2i(totalXRes-1, totalYRes-1));
     Box2i dataWindow(V2i(xOffset, yOffset), V2i(xOffset + xRes - 1, yOffset + yRes - 1));
 
+    InitEXRThreading();
     try {
         RgbaOutputFile file(name.c_str(), displayWindow, dataWindow, WRITE_RGBA);
         file.setFrameBuffer(hrgba - xOffset - yOffset * xRes, 1, xRes);
@@ -179,6 +393,47 @@ static void WriteImageEXR(const string &name, float *pixels,
 }
 
 
+static void WriteImageLayersEXR(const string &name,
+        const vector<string> &layerNames, const vector<float *> &layers,
+        int xRes, int yRes, int totalXRes, int totalYRes,
+        int xOffset, int yOffset) {
+    Box2i displayWindow(V2i(0,0), V2i(totalXRes-1, totalYRes-1));
+    Box2i dataWindow(V2i(xOffset, yOffset), V2i(xOffset + xRes - 1, yOffset + yRes - 1));
+    Header header(displayWindow, dataWindow);
+    FrameBuffer frameBuffer;
+    const char *channels[3] = { "R", "G", "B" };
+    vector<half *> hrgb(layers.size());
+    for (uint32_t i = 0; i < layers.size(); ++i) {
+        hrgb[i] = new half[3 * xRes * yRes];
+        for (int j = 0; j < 3 * xRes * yRes; ++j)
+            hrgb[i][j] = layers[i][j];
+        // The first layer becomes the image's default _R_, _G_, _B_ channels
+        char *base = (char *)(hrgb[i] - 3 * (xOffset + yOffset * xRes));
+        for (int c = 0; c < 3; ++c) {
+            string channel = (i == 0) ? string(channels[c]) :
+                                        layerNames[i] + "." + channels[c];
+            header.channels().insert(channel.c_str(), Channel(HALF));
+            frameBuffer.insert(channel.c_str(), Slice(HALF, base + c * sizeof(half),
+                3 * sizeof(half), 3 * xRes * sizeof(half)));
+        }
+    }
+
+    InitEXRThreading();
+    try {
+        OutputFile file(name.c_str(), header);
+        file.setFrameBuffer(frameBuffer);
+        file.writePixels(yRes);
+    }
+    catch (const std::exception &e) {
+        Error("Unable to write image file \"%s\": %s", name.c_str(),
+            e.what());
+    }
+
+    for (uint32_t i = 0; i < hrgb.size(); ++i)
+        delete[] hrgb[i];
+}
+
+
 #endif // PBRT_HAS_OPENEXR
 
 
@@ -44,5 +44,17 @@ RGBSpectrum *ReadImage(const string &name, int *xSize, int *ySize);
 void WriteImage(const string &name, float *pixels, float *alpha,
     int XRes, int YRes, int totalXRes, int totalYRes, int xOffset,
     int yOffset);
+void WriteImageLayers(const string &name, const vector<string> &layerNames,
+    const vector<float *> &layers, int XRes, int YRes, int totalXRes,
+    int totalYRes, int xOffset, int yOffset);
+void EnqueueImageWrite(const string &name, const float *pixels,
+    const float *alpha, int XRes, int YRes, int totalXRes, int totalYRes,
+    int xOffset, int yOffset);
+void EnqueueImageLayersWrite(const string &name,
+    const vector<string> &layerNames, const vector<const float *> &layers,
+    int XRes, int YRes, int totalXRes, int totalYRes, int xOffset,
+    int yOffset);
+void WaitForImageWrites();
+void ImageWritesCleanup();
 
 #endif // PBRT_CORE_IMAGEIO_H
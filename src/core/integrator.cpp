@@ -36,6 +36,7 @@
 #include "scene.h"
 #include "intersection.h"
 #include "montecarlo.h"
+#include "lightbvh.h"
 
 // Integrator Method Definitions
 Integrator::~Integrator() {
@@ -84,17 +85,27 @@ Spectrum UniformSampleOneLight(const Scene *scene,
         const Normal &n, const Vector &wo, float rayEpsilon, float time,
         BSDF *bsdf, const Sample *sample, RNG &rng, int lightNumOffset,
         const LightSampleOffsets *lightSampleOffset,
-        const BSDFSampleOffsets *bsdfSampleOffset) {
+        const BSDFSampleOffsets *bsdfSampleOffset,
+        const LightBVH *lightBVH) {
     // Randomly choose a single light to sample, _light_
     int nLights = int(scene->lights.size());
     if (nLights == 0) return Spectrum(0.);
-    int lightNum;
-    if (lightNumOffset != -1)
-        lightNum = Floor2Int(sample->oneD[lightNumOffset][0] * nLights);
-    else
-        lightNum = Floor2Int(rng.RandomFloat() * nLights);
-    lightNum = min(lightNum, nLights-1);
-    Light *light = scene->lights[lightNum];
+    float uLight = (lightNumOffset != -1) ?
+        sample->oneD[lightNumOffset][0] : rng.RandomFloat();
+    const Light *light;
+    float lightWeight;
+    if (lightBVH) {
+        // Choose the light by its estimated contribution at _p_
+        float lightPdf;
+        light = lightBVH->Sample(p, n, uLight, &lightPdf);
+        if (!light) return Spectrum(0.);
+        lightWeight = 1.f / lightPdf;
+    }
+    else {
+        int lightNum = min(Floor2Int(uLight * nLights), nLights-1);
+        light = scene->lights[lightNum];
+        lightWeight = (float)nLights;
+    }
 
     // Initialize light and bsdf samples for single light sample
     LightSample lightSample;
@@ -107,7 +118,7 @@ Spectrum UniformSampleOneLight(const Scene *scene,
         lightSample = LightSample(rng);
         bsdfSample = BSDFSample(rng);
     }
-    return (float)nLights *
+    return lightWeight *
         EstimateDirect(scene, renderer, arena, light, p, n, wo,
                        rayEpsilon, time, bsdf, rng, lightSample,
                        bsdfSample, BxDFType(BSDF_ALL & ~BSDF_SPECULAR));
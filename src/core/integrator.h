@@ -58,6 +58,10 @@ public:
     virtual void RequestSamples(Sampler *sampler, Sample *sample,
                                 const Scene *scene) {
     }
+    // Called by multi-pass renderers after each rendering pass
+    virtual void FinishPass(const Scene *scene, const Camera *camera,
+                            const Renderer *renderer) {
+    }
 };
 
 
@@ -80,7 +84,8 @@ Spectrum UniformSampleOneLight(const Scene *scene, const Renderer *renderer,
     float rayEpsilon, float time, BSDF *bsdf,
     const Sample *sample, RNG &rng, int lightNumOffset = -1,
     const LightSampleOffsets *lightSampleOffset = NULL,
-    const BSDFSampleOffsets *bsdfSampleOffset = NULL);
+    const BSDFSampleOffsets *bsdfSampleOffset = NULL,
+    const LightBVH *lightBVH = NULL);
 Spectrum EstimateDirect(const Scene *scene, const Renderer *renderer,
     MemoryArena &arena, const Light *light, const Point &p,
     const Normal &n, const Vector &wo, float rayEpsilon, float time, const BSDF *bsdf,
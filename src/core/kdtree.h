@@ -39,6 +39,10 @@
 // core/kdtree.h*
 #include "pbrt.h"
 #include "geometry.h"
+#include "parallel.h"
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
 
 // KdTree Declarations
 struct KdNode {
@@ -60,6 +64,7 @@ struct KdNode {
 };
 
 
+template <typename NodeData> class KdTreeBuildTask;
 template <typename NodeData> class KdTree {
 public:
     // KdTree Public Methods
@@ -72,15 +77,35 @@ public:
             LookupProc &process, float &maxDistSquared) const;
 private:
     // KdTree Private Methods
+    friend class KdTreeBuildTask<NodeData>;
     void recursiveBuild(uint32_t nodeNum, int start, int end,
-        const NodeData **buildNodes);
+        const NodeData **buildNodes, int maxSerialSize,
+        vector<Task *> *buildTasks);
     template <typename LookupProc> void privateLookup(uint32_t nodeNum,
         const Point &p, LookupProc &process, float &maxDistSquared) const;
 
     // KdTree Private Data
     KdNode *nodes;
     NodeData *nodeData;
-    uint32_t nNodes, nextFreeNode;
+    uint32_t nNodes;
+};
+
+
+template <typename NodeData> class KdTreeBuildTask : public Task {
+public:
+    // KdTreeBuildTask Public Methods
+    KdTreeBuildTask(KdTree<NodeData> *t, uint32_t n, int s, int e,
+                    const NodeData **b)
+        : tree(t), nodeNum(n), start(s), end(e), buildNodes(b) { }
+    void Run() {
+        tree->recursiveBuild(nodeNum, start, end, buildNodes, 0, NULL);
+    }
+private:
+    // KdTreeBuildTask Private Data
+    KdTree<NodeData> *tree;
+    uint32_t nodeNum;
+    int start, end;
+    const NodeData **buildNodes;
 };
 
 
@@ -99,20 +124,39 @@ template <typename NodeData> struct CompareNode {
 template <typename NodeData>
 KdTree<NodeData>::KdTree(const vector<NodeData> &d) {
     nNodes = d.size();
-    nextFreeNode = 1;
     nodes = AllocAligned<KdNode>(nNodes);
     nodeData = AllocAligned<NodeData>(nNodes);
     vector<const NodeData *> buildNodes(nNodes, NULL);
     for (uint32_t i = 0; i < nNodes; ++i)
         buildNodes[i] = &d[i];
     // Begin the KdTree building process
-    recursiveBuild(0, 0, nNodes, &buildNodes[0]);
+    if (nNodes < 65536) {
+        recursiveBuild(0, 0, nNodes, &buildNodes[0], 0, NULL);
+        return;
+    }
+
+    // Split the top of the tree serially and build subtrees in parallel
+    int maxSerialSize = max(4096u, nNodes / (16 * NumSystemCores()));
+    vector<Task *> buildTasks;
+    recursiveBuild(0, 0, nNodes, &buildNodes[0], maxSerialSize, &buildTasks);
+    EnqueueTasks(buildTasks);
+    WaitForTasks(buildTasks);
+    for (uint32_t i = 0; i < buildTasks.size(); ++i)
+        delete buildTasks[i];
 }
 
 
 template <typename NodeData> void
 KdTree<NodeData>::recursiveBuild(uint32_t nodeNum, int start, int end,
-        const NodeData **buildNodes) {
+        const NodeData **buildNodes, int maxSerialSize,
+        vector<Task *> *buildTasks) {
+    // Defer small enough subtrees to a _KdTreeBuildTask_ if requested
+    if (buildTasks && end - start <= maxSerialSize) {
+        buildTasks->push_back(new KdTreeBuildTask<NodeData>(this, nodeNum,
+                                  start, end, buildNodes));
+        return;
+    }
+
     // Create leaf node of kd-tree if we've reached the bottom
     if (start + 1 == end) {
         nodes[nodeNum].initLeaf();
@@ -132,17 +176,21 @@ KdTree<NodeData>::recursiveBuild(uint32_t nodeNum, int start, int end,
                      &buildNodes[end], CompareNode<NodeData>(splitAxis));
 
     // Allocate kd-tree node and continue recursively
+
+    // A subtree over $n$ items occupies $n$ consecutive nodes, so child
+    // node indices follow from the split without a shared counter
     nodes[nodeNum].init(buildNodes[splitPos]->p[splitAxis], splitAxis);
     nodeData[nodeNum] = *buildNodes[splitPos];
     if (start < splitPos) {
         nodes[nodeNum].hasLeftChild = 1;
-        uint32_t childNum = nextFreeNode++;
-        recursiveBuild(childNum, start, splitPos, buildNodes);
+        uint32_t childNum = nodeNum + 1;
+        recursiveBuild(childNum, start, splitPos, buildNodes,
+                       maxSerialSize, buildTasks);
     }
     if (splitPos+1 < end) {
-        nodes[nodeNum].rightChild = nextFreeNode++;
+        nodes[nodeNum].rightChild = nodeNum + 1 + (splitPos - start);
         recursiveBuild(nodes[nodeNum].rightChild, splitPos+1,
-                       end, buildNodes);
+                       end, buildNodes, maxSerialSize, buildTasks);
     }
 }
 
@@ -184,4 +232,225 @@ void KdTree<NodeData>::privateLookup(uint32_t nodeNum, const Point &p,
 
 
 
+// BucketKdTree Declarations
+
+// A median-split kd-tree whose leaves hold up to _maxLeafSize_ items, with
+// leaf positions stored as padded SoA blocks for four-wide distance tests.
+// All leaves lie at the same depth, so nodes use an implicit heap layout.
+template <typename NodeData> class BucketKdTreeBuildTask;
+template <typename NodeData> class BucketKdTree {
+public:
+    // BucketKdTree Public Methods
+    BucketKdTree(const vector<NodeData> &data);
+    ~BucketKdTree() {
+        FreeAligned(splitPos);
+        FreeAligned(splitAxis);
+        FreeAligned(leafSoAStart);
+        FreeAligned(leafStart);
+        FreeAligned(soaX);
+        FreeAligned(soaY);
+        FreeAligned(soaZ);
+        FreeAligned(nodeData);
+    }
+    template <typename LookupProc> void Lookup(const Point &p,
+            LookupProc &process, float &maxDistSquared) const;
+    static const int maxLeafSize = 16;
+private:
+    // BucketKdTree Private Methods
+    friend class BucketKdTreeBuildTask<NodeData>;
+    void recursiveBuild(uint32_t nodeNum, int depth, int start, int end,
+        const NodeData **buildNodes, int maxSerialSize,
+        vector<Task *> *buildTasks);
+
+    // BucketKdTree Private Data
+    int depth;
+    uint32_t nItems, nInterior, nLeaves;
+    float *splitPos;
+    uint8_t *splitAxis;
+    uint32_t *leafSoAStart, *leafStart;
+    float *soaX, *soaY, *soaZ;
+    NodeData *nodeData;
+};
+
+
+template <typename NodeData> class BucketKdTreeBuildTask : public Task {
+public:
+    // BucketKdTreeBuildTask Public Methods
+    BucketKdTreeBuildTask(BucketKdTree<NodeData> *t, uint32_t n, int d,
+                          int s, int e, const NodeData **b)
+        : tree(t), nodeNum(n), depth(d), start(s), end(e), buildNodes(b) { }
+    void Run() {
+        tree->recursiveBuild(nodeNum, depth, start, end, buildNodes, 0, NULL);
+    }
+private:
+    // BucketKdTreeBuildTask Private Data
+    BucketKdTree<NodeData> *tree;
+    uint32_t nodeNum;
+    int depth, start, end;
+    const NodeData **buildNodes;
+};
+
+
+
+// BucketKdTree Method Definitions
+template <typename NodeData>
+BucketKdTree<NodeData>::BucketKdTree(const vector<NodeData> &d) {
+    // Choose depth so that every leaf holds at most _maxLeafSize_ items
+    nItems = d.size();
+    depth = 0;
+    while (((nItems + (1u << depth) - 1) >> depth) > (uint32_t)maxLeafSize)
+        ++depth;
+    nLeaves = 1u << depth;
+    nInterior = nLeaves - 1;
+    splitPos = AllocAligned<float>(max(nInterior, 1u));
+    splitAxis = AllocAligned<uint8_t>(max(nInterior, 1u));
+    leafSoAStart = AllocAligned<uint32_t>(nLeaves + 1);
+    leafStart = AllocAligned<uint32_t>(nLeaves + 1);
+
+    // Partition items into leaves, building subtrees in parallel if large
+    vector<const NodeData *> buildNodes(nItems, NULL);
+    for (uint32_t i = 0; i < nItems; ++i)
+        buildNodes[i] = &d[i];
+    if (nItems < 65536)
+        recursiveBuild(0, 0, 0, nItems, &buildNodes[0], 0, NULL);
+    else {
+        int maxSerialSize = max(4096u, nItems / (16 * NumSystemCores()));
+        vector<Task *> buildTasks;
+        recursiveBuild(0, 0, 0, nItems, &buildNodes[0], maxSerialSize,
+                       &buildTasks);
+        EnqueueTasks(buildTasks);
+        WaitForTasks(buildTasks);
+        for (uint32_t i = 0; i < buildTasks.size(); ++i)
+            delete buildTasks[i];
+    }
+
+    // Copy items in leaf order and build padded SoA position blocks
+    nodeData = AllocAligned<NodeData>(nItems);
+    for (uint32_t i = 0; i < nItems; ++i)
+        nodeData[i] = *buildNodes[i];
+    leafStart[nLeaves] = nItems;
+    leafSoAStart[0] = 0;
+    for (uint32_t i = 0; i < nLeaves; ++i)
+        leafSoAStart[i+1] = leafSoAStart[i] +
+            ((leafStart[i+1] - leafStart[i] + 3) & ~3u);
+    uint32_t nSoA = max(leafSoAStart[nLeaves], 4u);
+    soaX = AllocAligned<float>(nSoA);
+    soaY = AllocAligned<float>(nSoA);
+    soaZ = AllocAligned<float>(nSoA);
+    for (uint32_t i = 0; i < nLeaves; ++i) {
+        uint32_t count = leafStart[i+1] - leafStart[i];
+        for (uint32_t j = 0; j < leafSoAStart[i+1] - leafSoAStart[i]; ++j) {
+            // Pad partial blocks with positions that never pass a test
+            uint32_t k = leafSoAStart[i] + j;
+            if (j < count) {
+                const Point &p = nodeData[leafStart[i] + j].p;
+                soaX[k] = p.x; soaY[k] = p.y; soaZ[k] = p.z;
+            }
+            else
+                soaX[k] = soaY[k] = soaZ[k] = 1e18f;
+        }
+    }
+}
+
+
+template <typename NodeData> void
+BucketKdTree<NodeData>::recursiveBuild(uint32_t nodeNum, int nodeDepth,
+        int start, int end, const NodeData **buildNodes, int maxSerialSize,
+        vector<Task *> *buildTasks) {
+    // Record leaf item range once the leaf depth is reached
+    if (nodeDepth == depth) {
+        leafStart[nodeNum - nInterior] = start;
+        return;
+    }
+
+    // Defer small enough subtrees to a _BucketKdTreeBuildTask_ if requested
+    if (buildTasks && end - start <= maxSerialSize) {
+        buildTasks->push_back(new BucketKdTreeBuildTask<NodeData>(this,
+            nodeNum, nodeDepth, start, end, buildNodes));
+        return;
+    }
+
+    // Choose split direction and partition data at the median
+    BBox bound;
+    for (int i = start; i < end; ++i)
+        bound = Union(bound, buildNodes[i]->p);
+    int axis = bound.MaximumExtent();
+    int mid = (start+end)/2;
+    if (start < end)
+        std::nth_element(&buildNodes[start], &buildNodes[mid],
+                         &buildNodes[end], CompareNode<NodeData>(axis));
+    splitAxis[nodeNum] = axis;
+    splitPos[nodeNum] = mid < end ? buildNodes[mid]->p[axis] : 0.f;
+    recursiveBuild(2*nodeNum+1, nodeDepth+1, start, mid, buildNodes,
+                   maxSerialSize, buildTasks);
+    recursiveBuild(2*nodeNum+2, nodeDepth+1, mid, end, buildNodes,
+                   maxSerialSize, buildTasks);
+}
+
+
+template <typename NodeData> template <typename LookupProc>
+void BucketKdTree<NodeData>::Lookup(const Point &p, LookupProc &process,
+                                    float &maxDistSquared) const {
+    // Nodes still to visit, with squared distance to their splitting plane
+    struct StackEntry { uint32_t nodeNum; float dist2; };
+    StackEntry stack[64];
+    int stackTop = 0;
+    uint32_t nodeNum = 0;
+    while (true) {
+        if (nodeNum < nInterior) {
+            // Visit near child first and defer far child
+            float d = p[splitAxis[nodeNum]] - splitPos[nodeNum];
+            uint32_t nearChild = (d <= 0.f) ? 2*nodeNum+1 : 2*nodeNum+2;
+            stack[stackTop].nodeNum = (d <= 0.f) ? 2*nodeNum+2 : 2*nodeNum+1;
+            stack[stackTop++].dist2 = d * d;
+            nodeNum = nearChild;
+            continue;
+        }
+
+        // Test leaf items against _maxDistSquared_ four at a time
+        uint32_t leaf = nodeNum - nInterior;
+        uint32_t soaStart = leafSoAStart[leaf], soaEnd = leafSoAStart[leaf+1];
+        uint32_t count = leafStart[leaf+1] - leafStart[leaf];
+        const NodeData *data = &nodeData[leafStart[leaf]];
+#if defined(__SSE__)
+        __m128 px = _mm_set1_ps(p.x), py = _mm_set1_ps(p.y),
+               pz = _mm_set1_ps(p.z);
+        for (uint32_t k = soaStart; k < soaEnd; k += 4) {
+            __m128 dx = _mm_sub_ps(_mm_load_ps(&soaX[k]), px);
+            __m128 dy = _mm_sub_ps(_mm_load_ps(&soaY[k]), py);
+            __m128 dz = _mm_sub_ps(_mm_load_ps(&soaZ[k]), pz);
+            __m128 d2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx),
+                                              _mm_mul_ps(dy, dy)),
+                                   _mm_mul_ps(dz, dz));
+            int mask = _mm_movemask_ps(_mm_cmplt_ps(d2,
+                                       _mm_set1_ps(maxDistSquared)));
+            if (!mask) continue;
+            float dist2[4];
+            _mm_storeu_ps(dist2, d2);
+            uint32_t i = k - soaStart;
+            for (int j = 0; j < 4; ++j)
+                if ((mask & (1 << j)) && i + j < count &&
+                    dist2[j] < maxDistSquared)
+                    process(p, data[i+j], dist2[j], maxDistSquared);
+        }
+#else
+        for (uint32_t k = soaStart; k < soaStart + count; ++k) {
+            float dx = soaX[k] - p.x, dy = soaY[k] - p.y, dz = soaZ[k] - p.z;
+            float dist2 = dx*dx + dy*dy + dz*dz;
+            if (dist2 < maxDistSquared)
+                process(p, data[k - soaStart], dist2, maxDistSquared);
+        }
+#endif
+
+        // Pop next node whose splitting plane is within range
+        do {
+            if (stackTop == 0) return;
+            --stackTop;
+        } while (stack[stackTop].dist2 >= maxDistSquared);
+        nodeNum = stack[stackTop].nodeNum;
+    }
+}
+
+
+
 #endif // PBRT_CORE_KDTREE_H
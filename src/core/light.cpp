@@ -180,3 +180,53 @@ float ShapeSet::Pdf(const Point &p) const {
 }
 
 
+BBox ShapeSet::WorldBound() const {
+    BBox bounds;
+    for (uint32_t i = 0; i < shapes.size(); ++i)
+        bounds = Union(bounds, shapes[i]->WorldBound());
+    return bounds;
+}
+
+
+bool ShapeSet::GetNormalCone(Vector *axis, float *cosTheta) const {
+    if (!shapes[0]->GetNormalCone(axis, cosTheta)) return false;
+    for (uint32_t i = 1; i < shapes.size(); ++i) {
+        Vector w;
+        float cosW;
+        if (!shapes[i]->GetNormalCone(&w, &cosW)) return false;
+        ConeUnion(*axis, *cosTheta, w, cosW, axis, cosTheta);
+    }
+    return true;
+}
+
+
+void ConeUnion(const Vector &wa, float cosA, const Vector &wb, float cosB,
+               Vector *w, float *cosTheta) {
+    // Return one of the cones if it already contains the other
+    float thetaA = acosf(Clamp(cosA, -1.f, 1.f));
+    float thetaB = acosf(Clamp(cosB, -1.f, 1.f));
+    float thetaD = acosf(Clamp(Dot(wa, wb), -1.f, 1.f));
+    if (min(thetaD + thetaB, float(M_PI)) <= thetaA) {
+        *w = wa;
+        *cosTheta = cosA;
+        return;
+    }
+    if (min(thetaD + thetaA, float(M_PI)) <= thetaB) {
+        *w = wb;
+        *cosTheta = cosB;
+        return;
+    }
+
+    // Rotate _wa_ towards _wb_ to the axis of the enclosing cone
+    float thetaO = .5f * (thetaA + thetaD + thetaB);
+    Vector wr = Cross(wa, wb);
+    if (thetaO >= M_PI || wr.LengthSquared() == 0.f) {
+        *w = wa;
+        *cosTheta = -1.f;
+        return;
+    }
+    *w = Normalize(Rotate(Degrees(thetaO - thetaA), wr)(wa));
+    *cosTheta = cosf(thetaO);
+}
+
+
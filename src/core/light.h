@@ -45,6 +45,20 @@
 #include "memory.h"
 
 // Light Declarations
+struct LightBounds {
+    // LightBounds Public Methods
+    LightBounds() : axis(0.f, 0.f, 1.f), phi(0.f), cosThetaO(-1.f),
+                    cosThetaE(0.f) { }
+
+    // LightBounds Public Data
+    // Emitters lie in _bounds_ with normals within $\theta_o$ of _axis_,
+    // and emit within $\theta_e$ of their normal; _phi_ is the total power
+    BBox bounds;
+    Vector axis;
+    float phi, cosThetaO, cosThetaE;
+};
+
+
 class Light {
 public:
     // Light Interface
@@ -73,6 +87,8 @@ public:
     virtual void SHProject(const Point &p, float pEpsilon, int lmax,
         const Scene *scene, bool computeLightVisibility, float time,
         RNG &rng, Spectrum *coeffs) const;
+    // Returns false for lights without finite spatial bounds
+    virtual bool GetBounds(LightBounds *lb) const { return false; }
 
     // Light Public Data
     const int nSamples;
@@ -149,6 +165,8 @@ public:
     Point Sample(const LightSample &ls, Normal *Ns) const;
     float Pdf(const Point &p, const Vector &wi) const;
     float Pdf(const Point &p) const;
+    BBox WorldBound() const;
+    bool GetNormalCone(Vector *axis, float *cosTheta) const;
 private:
     // ShapeSet Private Data
     vector<Reference<Shape> > shapes;
@@ -158,5 +176,7 @@ private:
 };
 
 
+void ConeUnion(const Vector &wa, float cosA, const Vector &wb, float cosB,
+               Vector *w, float *cosTheta);
 
 #endif // PBRT_CORE_LIGHT_H
@@ -0,0 +1,293 @@
+
+/*
+    pbrt source code Copyright(c) 1998-2012 Matt Pharr and Greg Humphreys.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+// core/lightbvh.cpp*
+#include "stdafx.h"
+#include "lightbvh.h"
+#include "scene.h"
+#include "montecarlo.h"
+
+// LightBVH Local Declarations
+struct LightBVHPrimitive {
+    LightBVHPrimitive(uint32_t idx, const LightBounds &b)
+        : lightIndex(idx), lb(b) {
+        centroid = .5f * b.bounds.pMin + .5f * b.bounds.pMax;
+    }
+    uint32_t lightIndex;
+    LightBounds lb;
+    Point centroid;
+};
+
+
+struct CompareToLightBucket {
+    CompareToLightBucket(int split, int num, int d, const BBox &b)
+        : centroidBounds(b)
+    { splitBucket = split; nBuckets = num; dim = d; }
+    bool operator()(const LightBVHPrimitive &p) const {
+        int b = nBuckets * ((p.centroid[dim] - centroidBounds.pMin[dim]) /
+                (centroidBounds.pMax[dim] - centroidBounds.pMin[dim]));
+        if (b == nBuckets) b = nBuckets-1;
+        return b <= splitBucket;
+    }
+
+    int splitBucket, nBuckets, dim;
+    const BBox &centroidBounds;
+};
+
+
+static LightBounds Union(const LightBounds &a, const LightBounds &b) {
+    if (a.phi == 0.f) return b;
+    if (b.phi == 0.f) return a;
+    LightBounds ret;
+    ret.bounds = Union(a.bounds, b.bounds);
+    ConeUnion(a.axis, a.cosThetaO, b.axis, b.cosThetaO, &ret.axis,
+              &ret.cosThetaO);
+    ret.cosThetaE = min(a.cosThetaE, b.cosThetaE);
+    ret.phi = a.phi + b.phi;
+    return ret;
+}
+
+
+// Cost of a cluster in the surface area orientation heuristic: power
+// times the solid angle measure of its emission and its surface area
+static float SAOHCost(const LightBounds &lb, int dim) {
+    float thetaO = acosf(Clamp(lb.cosThetaO, -1.f, 1.f));
+    float thetaE = acosf(Clamp(lb.cosThetaE, -1.f, 1.f));
+    float thetaW = min(thetaO + thetaE, float(M_PI));
+    float sinThetaO = sqrtf(max(0.f, 1.f - lb.cosThetaO * lb.cosThetaO));
+    float mOmega = 2.f * M_PI * (1.f - lb.cosThetaO) +
+        M_PI / 2.f * (2.f * thetaW * sinThetaO - cosf(thetaO - 2.f * thetaW) -
+                      2.f * thetaO * sinThetaO + lb.cosThetaO);
+    // Penalize splitting thin boxes along their short side
+    Vector diag = lb.bounds.pMax - lb.bounds.pMin;
+    float maxExtent = max(diag.x, max(diag.y, diag.z));
+    float kr = diag[dim] > 0.f ? maxExtent / diag[dim] : 1.f;
+    return lb.phi * mOmega * kr * lb.bounds.SurfaceArea();
+}
+
+
+// Cosine of $\max(0, \theta_a - \theta_b)$ from sines and cosines
+static inline float CosSubClamped(float sinA, float cosA,
+                                  float sinB, float cosB) {
+    if (cosA > cosB) return 1.f;
+    return cosA * cosB + sinA * sinB;
+}
+
+
+static inline float SinSubClamped(float sinA, float cosA,
+                                  float sinB, float cosB) {
+    if (cosA > cosB) return 0.f;
+    return sinA * cosB - cosA * sinB;
+}
+
+
+// LightBVH Method Definitions
+LightBVH::LightBVH(const Scene *scene) {
+    // Split lights into the BVH and the unbounded ones sampled uniformly
+    vector<LightBVHPrimitive> primitives;
+    for (uint32_t i = 0; i < scene->lights.size(); ++i) {
+        const Light *light = scene->lights[i];
+        LightBounds lb;
+        if (!light->GetBounds(&lb)) {
+            infiniteLights.push_back(light);
+            continue;
+        }
+        lb.phi = light->Power(scene).y();
+        if (lb.phi <= 0.f) continue;
+        primitives.push_back(LightBVHPrimitive(bvhLights.size(), lb));
+        bvhLights.push_back(light);
+    }
+    if (primitives.size() > 0) {
+        nodes.reserve(2 * primitives.size() - 1);
+        recursiveBuild(primitives, 0, primitives.size());
+    }
+    Info("Light BVH: %d lights in %d nodes, %d unbounded lights",
+         (int)bvhLights.size(), (int)nodes.size(),
+         (int)infiniteLights.size());
+}
+
+
+uint32_t LightBVH::recursiveBuild(vector<LightBVHPrimitive> &primitives,
+                                  uint32_t start, uint32_t end) {
+    Assert(start < end);
+    uint32_t nodeNum = nodes.size();
+    nodes.push_back(LinearLightBVHNode());
+    if (end - start == 1) {
+        // Store single light in leaf node
+        nodes[nodeNum].lb = primitives[start].lb;
+        nodes[nodeNum].lightIndex = primitives[start].lightIndex;
+        nodes[nodeNum].isLeaf = true;
+        return nodeNum;
+    }
+
+    // Compute bounds of lights and of their centroids
+    LightBounds lb;
+    BBox centroidBounds;
+    for (uint32_t i = start; i < end; ++i) {
+        lb = Union(lb, primitives[i].lb);
+        centroidBounds = Union(centroidBounds, primitives[i].centroid);
+    }
+
+    // Find the SAOH bucket split with minimal cost over all axes
+    const int nBuckets = 12;
+    float minCost = INFINITY;
+    int minCostSplitBucket = -1, minCostSplitDim = -1;
+    for (int dim = 0; dim < 3; ++dim) {
+        if (centroidBounds.pMax[dim] == centroidBounds.pMin[dim]) continue;
+        LightBounds buckets[nBuckets];
+        for (uint32_t i = start; i < end; ++i) {
+            int b = nBuckets *
+                ((primitives[i].centroid[dim] - centroidBounds.pMin[dim]) /
+                 (centroidBounds.pMax[dim] - centroidBounds.pMin[dim]));
+            if (b == nBuckets) b = nBuckets-1;
+            buckets[b] = Union(buckets[b], primitives[i].lb);
+        }
+        for (int i = 0; i < nBuckets-1; ++i) {
+            LightBounds b0, b1;
+            for (int j = 0; j <= i; ++j)
+                b0 = Union(b0, buckets[j]);
+            for (int j = i+1; j < nBuckets; ++j)
+                b1 = Union(b1, buckets[j]);
+            if (b0.phi == 0.f || b1.phi == 0.f) continue;
+            float cost = SAOHCost(b0, dim) + SAOHCost(b1, dim);
+            if (cost < minCost) {
+                minCost = cost;
+                minCostSplitBucket = i;
+                minCostSplitDim = dim;
+            }
+        }
+    }
+
+    // Partition lights at the chosen split, or in half if none was found
+    uint32_t mid;
+    if (minCostSplitDim == -1)
+        mid = (start + end) / 2;
+    else {
+        LightBVHPrimitive *pmid = std::partition(&primitives[start],
+            &primitives[end-1]+1,
+            CompareToLightBucket(minCostSplitBucket, nBuckets,
+                                 minCostSplitDim, centroidBounds));
+        mid = pmid - &primitives[0];
+        if (mid == start || mid == end) mid = (start + end) / 2;
+    }
+
+    recursiveBuild(primitives, start, mid);
+    uint32_t second = recursiveBuild(primitives, mid, end);
+    nodes[nodeNum].lb = lb;
+    nodes[nodeNum].secondChildOffset = second;
+    nodes[nodeNum].isLeaf = false;
+    return nodeNum;
+}
+
+
+float LightBVH::Importance(const LightBounds &lb, const Point &p,
+                           const Normal &n) {
+    // Compute clamped squared distance to the center of _lb_
+    Point pc = .5f * lb.bounds.pMin + .5f * lb.bounds.pMax;
+    float d2 = DistanceSquared(p, pc);
+    d2 = max(d2, Distance(lb.bounds.pMin, lb.bounds.pMax) / 2.f);
+    Vector wi = p - pc;
+    float len = wi.Length();
+    wi = len > 0.f ? wi / len : Vector(0.f, 0.f, 1.f);
+
+    // Bound the angle subtended by _lb.bounds_ as seen from _p_
+    float cosThetaB = -1.f;
+    if (!lb.bounds.Inside(p)) {
+        Point c;
+        float r;
+        lb.bounds.BoundingSphere(&c, &r);
+        float sin2ThetaMax = r * r / DistanceSquared(c, p);
+        if (sin2ThetaMax < 1.f) cosThetaB = sqrtf(1.f - sin2ThetaMax);
+    }
+    float sinThetaB = sqrtf(max(0.f, 1.f - cosThetaB * cosThetaB));
+
+    // Find the minimal angle between the emission cone and _p_
+    float cosThetaW = Dot(lb.axis, wi);
+    float sinThetaW = sqrtf(max(0.f, 1.f - cosThetaW * cosThetaW));
+    float sinThetaO = sqrtf(max(0.f, 1.f - lb.cosThetaO * lb.cosThetaO));
+    float cosThetaX = CosSubClamped(sinThetaW, cosThetaW,
+                                    sinThetaO, lb.cosThetaO);
+    float sinThetaX = SinSubClamped(sinThetaW, cosThetaW,
+                                    sinThetaO, lb.cosThetaO);
+    float cosThetaP = CosSubClamped(sinThetaX, cosThetaX,
+                                    sinThetaB, cosThetaB);
+    if (cosThetaP < lb.cosThetaE) return 0.f;
+    float importance = lb.phi * cosThetaP / d2;
+
+    // Account for the incident angle at _p_
+    if (n.x != 0.f || n.y != 0.f || n.z != 0.f) {
+        float cosThetaI = AbsDot(wi, n);
+        float sinThetaI = sqrtf(max(0.f, 1.f - cosThetaI * cosThetaI));
+        importance *= CosSubClamped(sinThetaI, cosThetaI,
+                                    sinThetaB, cosThetaB);
+    }
+    return max(importance, 0.f);
+}
+
+
+const Light *LightBVH::Sample(const Point &p, const Normal &n, float u,
+                              float *pdf) const {
+    // Choose between the unbounded lights and the BVH
+    int nInfinite = infiniteLights.size();
+    float pInfinite = float(nInfinite) /
+        float(nInfinite + (nodes.empty() ? 0 : 1));
+    if (u < pInfinite) {
+        int index = min(Floor2Int(u / pInfinite * nInfinite), nInfinite-1);
+        *pdf = pInfinite / nInfinite;
+        return infiniteLights[index];
+    }
+    if (nodes.empty()) return NULL;
+    u = min((u - pInfinite) / (1.f - pInfinite), OneMinusEpsilon);
+
+    // Traverse the BVH choosing children by their estimated contribution
+    uint32_t nodeNum = 0;
+    float nodePdf = 1.f - pInfinite;
+    while (!nodes[nodeNum].isLeaf) {
+        uint32_t c0 = nodeNum + 1, c1 = nodes[nodeNum].secondChildOffset;
+        float ci0 = Importance(nodes[c0].lb, p, n);
+        float ci1 = Importance(nodes[c1].lb, p, n);
+        if (ci0 == 0.f && ci1 == 0.f) return NULL;
+        float p0 = ci0 / (ci0 + ci1);
+        if (u < p0) {
+            nodeNum = c0;
+            nodePdf *= p0;
+            u = min(u / p0, OneMinusEpsilon);
+        }
+        else {
+            nodeNum = c1;
+            nodePdf *= 1.f - p0;
+            u = min((u - p0) / (1.f - p0), OneMinusEpsilon);
+        }
+    }
+    *pdf = nodePdf;
+    return bvhLights[nodes[nodeNum].lightIndex];
+}
@@ -0,0 +1,74 @@
+
+/*
+    pbrt source code Copyright(c) 1998-2012 Matt Pharr and Greg Humphreys.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef PBRT_CORE_LIGHTBVH_H
+#define PBRT_CORE_LIGHTBVH_H
+
+// core/lightbvh.h*
+#include "pbrt.h"
+#include "light.h"
+
+// LightBVH Declarations
+struct LightBVHPrimitive;
+struct LinearLightBVHNode {
+    LightBounds lb;
+    union {
+        uint32_t lightIndex;          // leaf
+        uint32_t secondChildOffset;   // interior
+    };
+    bool isLeaf;
+};
+
+
+class LightBVH {
+public:
+    // LightBVH Public Methods
+    LightBVH(const Scene *scene);
+    const Light *Sample(const Point &p, const Normal &n, float u,
+                        float *pdf) const;
+private:
+    // LightBVH Private Methods
+    uint32_t recursiveBuild(vector<LightBVHPrimitive> &primitives,
+                            uint32_t start, uint32_t end);
+    static float Importance(const LightBounds &lb, const Point &p,
+                            const Normal &n);
+
+    // LightBVH Private Data
+    vector<const Light *> bvhLights, infiniteLights;
+    vector<LinearLightBVHNode> nodes;
+};
+
+
+#endif // PBRT_CORE_LIGHTBVH_H
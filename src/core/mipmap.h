@@ -47,17 +47,119 @@ typedef enum {
     TEXTURE_BLACK,
     TEXTURE_CLAMP
 } ImageWrap;
+typedef enum {
+    TEXEL_FLOAT,
+    TEXEL_HALF,
+    TEXEL_BYTE,
+    TEXEL_SRGB8
+} TexelFormat;
+
+
+// Texel Encoding Inline Functions
+inline uint16_t FloatToHalf(float f) {
+    uint32_t x;
+    memcpy(&x, &f, sizeof(float));
+    uint16_t sign = (x >> 16) & 0x8000;
+    uint32_t exponent = (x >> 23) & 0xff, mantissa = x & 0x7fffff;
+    if (exponent == 0xff)
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    int e = int(exponent) - 127 + 15;
+    if (e >= 31) return sign | 0x7c00;
+    if (e <= 0) {
+        // Convert to denormalized half, or flush to zero if too small
+        if (e < -10) return sign;
+        mantissa |= 0x800000;
+        uint32_t shift = 14 - e;
+        uint16_t h = sign | (mantissa >> shift);
+        if ((mantissa >> (shift - 1)) & 1) ++h;
+        return h;
+    }
+    uint16_t h = sign | (e << 10) | (mantissa >> 13);
+    // Round to nearest; a carry out of the mantissa correctly bumps the exponent
+    if (mantissa & 0x1000) ++h;
+    return h;
+}
+
+
+inline float HalfToFloat(uint16_t h) {
+    uint32_t sign = uint32_t(h & 0x8000) << 16;
+    uint32_t exponent = (h >> 10) & 0x1f, mantissa = h & 0x3ff;
+    if (exponent == 0) {
+        float f = mantissa * (1.f / 16777216.f);
+        return sign ? -f : f;
+    }
+    uint32_t x = (exponent == 31) ? (sign | 0x7f800000 | (mantissa << 13)) :
+        (sign | ((exponent + 112) << 23) | (mantissa << 13));
+    float f;
+    memcpy(&f, &x, sizeof(float));
+    return f;
+}
+
+
+inline uint8_t FloatToByte(float v) {
+    return uint8_t(Clamp(255.f * v + 0.5f, 0.f, 255.f));
+}
+
+
+inline uint8_t FloatToSRGB8(float v) {
+    v = Clamp(v, 0.f, 1.f);
+    float s = (v <= 0.0031308f) ? 12.92f * v :
+                                  1.055f * powf(v, 1.f / 2.4f) - 0.055f;
+    return FloatToByte(s);
+}
+
+
+inline float SRGB8ToFloat(uint8_t b) {
+    float s = b / 255.f;
+    return (s <= 0.04045f) ? s / 12.92f : powf((s + 0.055f) / 1.055f, 2.4f);
+}
+
+
+// TexelTraits Declarations
+template <typename T> struct TexelTraits {
+    static const int nChannels = 3;
+    static void ToChannels(const T &v, float c[3]) { v.ToRGB(c); }
+    static T FromChannels(const float c[3]) { return T::FromRGB(c); }
+};
+
+
+template <> struct TexelTraits<float> {
+    static const int nChannels = 1;
+    static void ToChannels(float v, float c[1]) { c[0] = v; }
+    static float FromChannels(const float c[1]) { return c[0]; }
+};
+
+
+template <int nChannels> struct HalfTexel {
+    uint16_t c[nChannels];
+};
+
+
+template <int nChannels> struct ByteTexel {
+    uint8_t c[nChannels];
+};
+
+
 template <typename T> class MIPMap {
 public:
     // MIPMap Public Methods
-    MIPMap() { pyramid = NULL; width = height = nLevels = 0; }
+    MIPMap() {
+        pyramid = NULL;
+        halfPyramid = NULL;
+        bytePyramid = NULL;
+        levelWidth = levelHeight = NULL;
+        texelFormat = TEXEL_FLOAT;
+        width = height = nLevels = 0;
+    }
     MIPMap(uint32_t xres, uint32_t yres, const T *data, bool doTri = false,
-           float maxAniso = 8.f, ImageWrap wrapMode = TEXTURE_REPEAT);
+           float maxAniso = 8.f, ImageWrap wrapMode = TEXTURE_REPEAT,
+           TexelFormat texelFormat = TEXEL_FLOAT);
     ~MIPMap();
     uint32_t Width() const { return width; }
     uint32_t Height() const { return height; }
     uint32_t Levels() const { return nLevels; }
-    const T &Texel(uint32_t level, int s, int t) const;
+    TexelFormat Format() const { return texelFormat; }
+    T Texel(uint32_t level, int s, int t) const;
     T Lookup(float s, float t, float width = 0.f) const;
     T Lookup(float s, float t, float ds0, float dt0,
         float ds1, float dt1) const;
@@ -90,19 +192,26 @@ private:
     SampledSpectrum clamp(const SampledSpectrum &v) { return v.Clamp(0.f, INFINITY); }
     T triangle(uint32_t level, float s, float t) const;
     T EWA(uint32_t level, float s, float t, float ds0, float dt0, float ds1, float dt1) const;
+    void encodePyramid();
 
     // MIPMap Private Data
+    static const int nChannels = TexelTraits<T>::nChannels;
     bool doTrilinear;
     float maxAnisotropy;
     ImageWrap wrapMode;
+    TexelFormat texelFormat;
     struct ResampleWeight {
         int firstTexel;
         float weight[4];
     };
     BlockedArray<T> **pyramid;
+    BlockedArray<HalfTexel<nChannels> > **halfPyramid;
+    BlockedArray<ByteTexel<nChannels> > **bytePyramid;
+    uint32_t *levelWidth, *levelHeight;
     uint32_t width, height, nLevels;
 #define WEIGHT_LUT_SIZE 128
     static float *weightLut;
+    static float *srgb8Lut;
 };
 
 
@@ -110,10 +219,13 @@ private:
 // MIPMap Method Definitions
 template <typename T>
 MIPMap<T>::MIPMap(uint32_t sres, uint32_t tres, const T *img, bool doTri,
-                  float maxAniso, ImageWrap wm) {
+                  float maxAniso, ImageWrap wm, TexelFormat tf) {
     doTrilinear = doTri;
     maxAnisotropy = maxAniso;
     wrapMode = wm;
+    texelFormat = TEXEL_FLOAT;
+    halfPyramid = NULL;
+    bytePyramid = NULL;
     T *resampledImage = NULL;
     if (!IsPowerOf2(sres) || !IsPowerOf2(tres)) {
         // Resample image to power-of-two resolution
@@ -171,14 +283,20 @@ MIPMap<T>::MIPMap(uint32_t sres, uint32_t tres, const T *img, bool doTri,
     // Initialize levels of MIPMap from image
     nLevels = 1 + Log2Int(float(max(sres, tres)));
     pyramid = new BlockedArray<T> *[nLevels];
+    levelWidth = new uint32_t[nLevels];
+    levelHeight = new uint32_t[nLevels];
 
     // Initialize most detailed level of MIPMap
     pyramid[0] = new BlockedArray<T>(sres, tres, img);
+    levelWidth[0] = sres;
+    levelHeight[0] = tres;
     for (uint32_t i = 1; i < nLevels; ++i) {
         // Initialize $i$th MIPMap level from $i-1$st level
         uint32_t sRes = max(1u, pyramid[i-1]->uSize()/2);
         uint32_t tRes = max(1u, pyramid[i-1]->vSize()/2);
         pyramid[i] = new BlockedArray<T>(sRes, tRes);
+        levelWidth[i] = sRes;
+        levelHeight[i] = tRes;
 
         // Filter four texels from finer level of pyramid
         for (uint32_t t = 0; t < tRes; ++t)
@@ -188,6 +306,23 @@ MIPMap<T>::MIPMap(uint32_t sres, uint32_t tres, const T *img, bool doTri,
                     Texel(i-1, 2*s, 2*t+1) + Texel(i-1, 2*s+1, 2*t+1));
     }
     if (resampledImage) delete[] resampledImage;
+
+    // Convert pyramid to compact texel storage if requested
+    if (tf == TEXEL_BYTE || tf == TEXEL_SRGB8) {
+        // Use half storage instead if texels don't fit in 8-bit $[0,1]$ range
+        for (uint32_t t = 0; t < height && tf != TEXEL_HALF; ++t)
+            for (uint32_t s = 0; s < width; ++s) {
+                float c[nChannels];
+                TexelTraits<T>::ToChannels((*pyramid[0])(s, t), c);
+                for (int j = 0; j < nChannels; ++j)
+                    if (c[j] > 1.f) tf = TEXEL_HALF;
+            }
+    }
+    if (tf != TEXEL_FLOAT) {
+        texelFormat = tf;
+        encodePyramid();
+    }
+
     // Initialize EWA filter weights if needed
     if (!weightLut) {
         weightLut = AllocAligned<float>(WEIGHT_LUT_SIZE);
@@ -201,37 +336,110 @@ MIPMap<T>::MIPMap(uint32_t sres, uint32_t tres, const T *img, bool doTri,
 
 
 template <typename T>
-const T &MIPMap<T>::Texel(uint32_t level, int s, int t) const {
+void MIPMap<T>::encodePyramid() {
+    if (texelFormat == TEXEL_SRGB8 && !srgb8Lut) {
+        srgb8Lut = AllocAligned<float>(256);
+        for (int i = 0; i < 256; ++i)
+            srgb8Lut[i] = SRGB8ToFloat(uint8_t(i));
+    }
+    if (texelFormat == TEXEL_HALF)
+        halfPyramid = new BlockedArray<HalfTexel<nChannels> > *[nLevels];
+    else
+        bytePyramid = new BlockedArray<ByteTexel<nChannels> > *[nLevels];
+    for (uint32_t i = 0; i < nLevels; ++i) {
+        // Encode texels of level _i_ and release its floating-point version
+        const BlockedArray<T> &l = *pyramid[i];
+        if (texelFormat == TEXEL_HALF)
+            halfPyramid[i] = new BlockedArray<HalfTexel<nChannels> >(l.uSize(), l.vSize());
+        else
+            bytePyramid[i] = new BlockedArray<ByteTexel<nChannels> >(l.uSize(), l.vSize());
+        for (uint32_t t = 0; t < l.vSize(); ++t)
+            for (uint32_t s = 0; s < l.uSize(); ++s) {
+                float c[nChannels];
+                TexelTraits<T>::ToChannels(l(s, t), c);
+                for (int j = 0; j < nChannels; ++j) {
+                    switch (texelFormat) {
+                    case TEXEL_HALF:
+                        (*halfPyramid[i])(s, t).c[j] = FloatToHalf(c[j]);
+                        break;
+                    case TEXEL_BYTE:
+                        (*bytePyramid[i])(s, t).c[j] = FloatToByte(c[j]);
+                        break;
+                    default:
+                        (*bytePyramid[i])(s, t).c[j] = FloatToSRGB8(c[j]);
+                        break;
+                    }
+                }
+            }
+        delete pyramid[i];
+    }
+    delete[] pyramid;
+    pyramid = NULL;
+}
+
+
+template <typename T>
+T MIPMap<T>::Texel(uint32_t level, int s, int t) const {
     Assert(level < nLevels);
-    const BlockedArray<T> &l = *pyramid[level];
+    int sRes = levelWidth[level], tRes = levelHeight[level];
     // Compute texel $(s,t)$ accounting for boundary conditions
     switch (wrapMode) {
         case TEXTURE_REPEAT:
-            s = Mod(s, l.uSize());
-            t = Mod(t, l.vSize());
+            s = Mod(s, sRes);
+            t = Mod(t, tRes);
             break;
         case TEXTURE_CLAMP:
-            s = Clamp(s, 0, l.uSize() - 1);
-            t = Clamp(t, 0, l.vSize() - 1);
+            s = Clamp(s, 0, sRes - 1);
+            t = Clamp(t, 0, tRes - 1);
             break;
         case TEXTURE_BLACK: {
-            static const T black = 0.f;
-            if (s < 0 || s >= (int)l.uSize() ||
-                t < 0 || t >= (int)l.vSize())
-                return black;
+            if (s < 0 || s >= sRes || t < 0 || t >= tRes)
+                return T(0.f);
             break;
         }
     }
     PBRT_ACCESSED_TEXEL(const_cast<MIPMap<T> *>(this), level, s, t);
-    return l(s, t);
+
+    // Decode texel $(s,t)$ from the level's storage format
+    float c[nChannels];
+    switch (texelFormat) {
+        case TEXEL_FLOAT:
+            return (*pyramid[level])(s, t);
+        case TEXEL_HALF: {
+            const HalfTexel<nChannels> &h = (*halfPyramid[level])(s, t);
+            for (int j = 0; j < nChannels; ++j)
+                c[j] = HalfToFloat(h.c[j]);
+            break;
+        }
+        case TEXEL_BYTE: {
+            const ByteTexel<nChannels> &b = (*bytePyramid[level])(s, t);
+            for (int j = 0; j < nChannels; ++j)
+                c[j] = b.c[j] * (1.f / 255.f);
+            break;
+        }
+        default: {
+            const ByteTexel<nChannels> &b = (*bytePyramid[level])(s, t);
+            for (int j = 0; j < nChannels; ++j)
+                c[j] = srgb8Lut[b.c[j]];
+            break;
+        }
+    }
+    return TexelTraits<T>::FromChannels(c);
 }
 
 
 template <typename T>
 MIPMap<T>::~MIPMap() {
-    for (uint32_t i = 0; i < nLevels; ++i)
-        delete pyramid[i];
+    for (uint32_t i = 0; i < nLevels; ++i) {
+        if (pyramid) delete pyramid[i];
+        if (halfPyramid) delete halfPyramid[i];
+        if (bytePyramid) delete bytePyramid[i];
+    }
     delete[] pyramid;
+    delete[] halfPyramid;
+    delete[] bytePyramid;
+    delete[] levelWidth;
+    delete[] levelHeight;
 }
 
 
@@ -258,8 +466,8 @@ T MIPMap<T>::Lookup(float s, float t, float width) const {
 template <typename T>
 T MIPMap<T>::triangle(uint32_t level, float s, float t) const {
     level = Clamp(level, 0, nLevels-1);
-    s = s * pyramid[level]->uSize() - 0.5f;
-    t = t * pyramid[level]->vSize() - 0.5f;
+    s = s * levelWidth[level] - 0.5f;
+    t = t * levelHeight[level] - 0.5f;
     int s0 = Floor2Int(s), t0 = Floor2Int(t);
     float ds = s - s0, dt = t - t0;
     return (1.f-ds) * (1.f-dt) * Texel(level, s0, t0) +
@@ -321,12 +529,12 @@ T MIPMap<T>::EWA(uint32_t level, float s, float t, float ds0, float dt0,
                  float ds1, float dt1) const {
     if (level >= nLevels) return Texel(nLevels-1, 0, 0);
     // Convert EWA coordinates to appropriate scale for level
-    s = s * pyramid[level]->uSize() - 0.5f;
-    t = t * pyramid[level]->vSize() - 0.5f;
-    ds0 *= pyramid[level]->uSize();
-    dt0 *= pyramid[level]->vSize();
-    ds1 *= pyramid[level]->uSize();
-    dt1 *= pyramid[level]->vSize();
+    s = s * levelWidth[level] - 0.5f;
+    t = t * levelHeight[level] - 0.5f;
+    ds0 *= levelWidth[level];
+    dt0 *= levelHeight[level];
+    ds1 *= levelWidth[level];
+    dt1 *= levelHeight[level];
 
     // Compute ellipse coefficients to bound EWA filter region
     float A = dt0*dt0 + dt1*dt1 + 1;
@@ -368,5 +576,6 @@ T MIPMap<T>::EWA(uint32_t level, float s, float t, float ds0, float dt0,
 
 
 template <typename T> float *MIPMap<T>::weightLut = NULL;
+template <typename T> float *MIPMap<T>::srgb8Lut = NULL;
 
 #endif // PBRT_CORE_MIPMAP_H
@@ -372,6 +372,27 @@ Distribution2D::Distribution2D(const float *func, int nu, int nv) {
 }
 
 
+void Distribution2D::SampleContinuous(const float *u, int n, float *uv,
+                                      float *pdf) const {
+    // Sample _n_ interleaved $(u_0,u_1)$ pairs in fixed-size chunks; rows are
+    // found for a whole chunk first so the conditional lookups run back to back
+    const int chunkSize = 64;
+    int rows[chunkSize];
+    for (int start = 0; start < n; start += chunkSize) {
+        int end = min(start + chunkSize, n);
+        for (int i = start; i < end; ++i)
+            uv[2*i+1] = pMarginal->SampleContinuous(u[2*i+1], &pdf[i],
+                                                    &rows[i-start]);
+        for (int i = start; i < end; ++i) {
+            float pdfU;
+            uv[2*i] = pConditionalV[rows[i-start]]->SampleContinuous(u[2*i],
+                                                                     &pdfU);
+            pdf[i] *= pdfU;
+        }
+    }
+}
+
+
 Distribution2D::~Distribution2D() {
     delete pMarginal;
     for (uint32_t i = 0; i < pConditionalV.size(); ++i)
@@ -73,15 +73,23 @@ struct Distribution1D {
             for (int i = 1; i < n+1; ++i)
                 cdf[i] /= funcInt;
         }
+
+        // Build guide table mapping uniform $u$ cells to CDF segments
+        guide = new int[n];
+        for (int k = 0, i = 0; k < n; ++k) {
+            float uk = float(k) / float(n);
+            while (i < n-1 && cdf[i+1] <= uk) ++i;
+            guide[k] = i;
+        }
     }
     ~Distribution1D() {
         delete[] func;
         delete[] cdf;
+        delete[] guide;
     }
     float SampleContinuous(float u, float *pdf, int *off = NULL) const {
         // Find surrounding CDF segments and _offset_
-        float *ptr = std::upper_bound(cdf, cdf+count+1, u);
-        int offset = max(0, int(ptr-cdf-1));
+        int offset = FindSegment(u);
         if (off) *off = offset;
         Assert(offset < count);
         Assert(u >= cdf[offset] && u < cdf[offset+1]);
@@ -98,17 +106,25 @@ struct Distribution1D {
     }
     int SampleDiscrete(float u, float *pdf) const {
         // Find surrounding CDF segments and _offset_
-        float *ptr = std::upper_bound(cdf, cdf+count+1, u);
-        int offset = max(0, int(ptr-cdf-1));
+        int offset = FindSegment(u);
         Assert(offset < count);
         Assert(u >= cdf[offset] && u < cdf[offset+1]);
         if (pdf) *pdf = func[offset] / (funcInt * count);
         return offset;
     }
 private:
+    // Returns the last segment with $\mathrm{cdf}_i \le u$, like a binary
+    // search over _cdf_, in expected constant time using the guide table
+    int FindSegment(float u) const {
+        int offset = guide[Clamp(Float2Int(u * count), 0, count-1)];
+        while (offset > 0 && cdf[offset] > u) --offset;
+        while (offset < count-1 && cdf[offset+1] <= u) ++offset;
+        return offset;
+    }
     friend struct Distribution2D;
     // Distribution1D Private Data
     float *func, *cdf;
+    int *guide;
     float funcInt;
     int count;
 };
@@ -151,6 +167,8 @@ struct Distribution2D {
         uv[0] = pConditionalV[v]->SampleContinuous(u0, &pdfs[0]);
         *pdf = pdfs[0] * pdfs[1];
     }
+    void SampleContinuous(const float *u, int n, float *uv,
+                          float *pdf) const;
     float Pdf(float u, float v) const {
         int iu = Clamp(Float2Int(u * pConditionalV[0]->count), 0,
                        pConditionalV[0]->count-1);
@@ -247,6 +265,10 @@ inline float VanDerCorput(uint32_t n, uint32_t scramble = 0);
 inline float Sobol2(uint32_t n, uint32_t scramble = 0);
 inline float LarcherPillichshammer2(uint32_t n, uint32_t scramble = 0);
 inline void Sample02(uint32_t n, const uint32_t scramble[2], float sample[2]);
+inline uint32_t OwenScramble(uint32_t v, uint32_t seed);
+inline uint32_t SobolSeed(int x, int y, uint32_t dim);
+inline float ScrambledSobol1D(uint32_t index, uint32_t seed);
+inline void ScrambledSobol2D(uint32_t index, uint32_t seed, float sample[2]);
 int LDPixelSampleFloatsNeeded(const Sample *sample, int nPixelSamples);
 void LDPixelSample(int xPos, int yPos, float shutterOpen,
     float shutterClose, int nPixelSamples, Sample *samples, float *buf, RNG &rng);
@@ -301,6 +323,70 @@ LarcherPillichshammer2(uint32_t n, uint32_t scramble) {
 }
 
 
+inline uint32_t ReverseBits32(uint32_t n) {
+    n = (n << 16) | (n >> 16);
+    n = ((n & 0x00ff00ff) << 8) | ((n & 0xff00ff00) >> 8);
+    n = ((n & 0x0f0f0f0f) << 4) | ((n & 0xf0f0f0f0) >> 4);
+    n = ((n & 0x33333333) << 2) | ((n & 0xcccccccc) >> 2);
+    n = ((n & 0x55555555) << 1) | ((n & 0xaaaaaaaa) >> 1);
+    return n;
+}
+
+
+inline uint32_t MixBits32(uint32_t v) {
+    v ^= v >> 16;
+    v *= 0x7feb352du;
+    v ^= v >> 15;
+    v *= 0x846ca68bu;
+    v ^= v >> 16;
+    return v;
+}
+
+
+// Owen scrambling of the binary fraction in _v_: every bit is flipped
+// by a hash of the more significant bits (the Laine-Karras permutation,
+// with the constants of Burley's "Practical Hash-based Owen Scrambling")
+inline uint32_t OwenScramble(uint32_t v, uint32_t seed) {
+    v = ReverseBits32(v);
+    v += seed;
+    v ^= v * 0x6c50b47cu;
+    v ^= v * 0xb82f1e52u;
+    v ^= v * 0xc7afe638u;
+    v ^= v * 0x8d22f6e6u;
+    return ReverseBits32(v);
+}
+
+
+inline uint32_t SobolSeed(int x, int y, uint32_t dim) {
+    return MixBits32(MixBits32(MixBits32(uint32_t(x) + 0x9e3779b9u) ^
+                               uint32_t(y)) ^ dim);
+}
+
+
+// Point _index_ of a shuffled, Owen-scrambled Sobol' (0,2)-sequence. The
+// whole sequence follows from _seed_, so points can be generated in any
+// order and power-of-two runs of indices remain stratified.
+inline float ScrambledSobol1D(uint32_t index, uint32_t seed) {
+    uint32_t v = ReverseBits32(OwenScramble(index, seed));
+    v = OwenScramble(v, MixBits32(seed));
+    return min((v >> 8) / float(1 << 24), OneMinusEpsilon);
+}
+
+
+inline void ScrambledSobol2D(uint32_t index, uint32_t seed,
+                             float sample[2]) {
+    index = OwenScramble(index, seed);
+    uint32_t v0 = ReverseBits32(index), v1 = 0;
+    for (uint32_t v = 1u << 31; index != 0; index >>= 1, v ^= v >> 1)
+        if (index & 0x1) v1 ^= v;
+    seed = MixBits32(seed);
+    v0 = OwenScramble(v0, seed);
+    v1 = OwenScramble(v1, MixBits32(seed));
+    sample[0] = min((v0 >> 8) / float(1 << 24), OneMinusEpsilon);
+    sample[1] = min((v1 >> 8) / float(1 << 24), OneMinusEpsilon);
+}
+
+
 inline void LDShuffleScrambled1D(int nSamples, int nPixel,
                                  float *samples, RNG &rng) {
     uint32_t scramble = rng.RandomUInt();
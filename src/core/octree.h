@@ -39,19 +39,37 @@
 // core/octree.h*
 #include "pbrt.h"
 #include "geometry.h"
+#include "parallel.h"
 
 // Octree Declarations
+
+// Octree nodes are append-only: children and data items are published
+// with atomic compare-and-swap, so lookups need no locking while other
+// threads add items
+template <typename NodeData> struct OctDataItem {
+    OctDataItem(const NodeData &d) : data(d), next(NULL) { }
+    NodeData data;
+    OctDataItem *next;
+};
+
+
 template <typename NodeData> struct OctNode {
     OctNode() {
         for (int i = 0; i < 8; ++i)
             children[i] = NULL;
+        dataHead = NULL;
     }
     ~OctNode() {
         for (int i = 0; i < 8; ++i)
             delete children[i];
+        while (dataHead) {
+            OctDataItem<NodeData> *next = dataHead->next;
+            delete dataHead;
+            dataHead = next;
+        }
     }
     OctNode *children[8];
-    vector<NodeData> data;
+    OctDataItem<NodeData> *dataHead;
 };
 
 
@@ -107,7 +125,14 @@ void Octree<NodeData>::addPrivate(
     // Possibly add data item to current octree node
     if (depth == maxDepth ||
         DistanceSquared(nodeBound.pMin, nodeBound.pMax) < diag2) {
-        node->data.push_back(dataItem);
+        // Publish data item at the head of the node's item list
+        OctDataItem<NodeData> *item = new OctDataItem<NodeData>(dataItem);
+        OctDataItem<NodeData> *head;
+        do {
+            head = node->dataHead;
+            item->next = head;
+        } while (AtomicCompareAndSwapPointer(&node->dataHead, item,
+                                             head) != head);
         return;
     }
 
@@ -125,10 +150,19 @@ void Octree<NodeData>::addPrivate(
     for (int child = 0; child < 8; ++child) {
         if (!over[child]) continue;
         // Allocate octree node if needed and continue recursive traversal
-        if (!node->children[child])
-            node->children[child] = new OctNode<NodeData>;
+        OctNode<NodeData> *childNode = node->children[child];
+        if (!childNode) {
+            // Publish new child; use the winner if another thread raced us
+            OctNode<NodeData> *newNode = new OctNode<NodeData>;
+            childNode = AtomicCompareAndSwapPointer(&node->children[child],
+                newNode, (OctNode<NodeData> *)NULL);
+            if (childNode == NULL)
+                childNode = newNode;
+            else
+                delete newNode;
+        }
         BBox childBound = octreeChildBound(child, nodeBound, pMid);
-        addPrivate(node->children[child], childBound,
+        addPrivate(childNode, childBound,
                    dataItem, dataBound, diag2, depth+1);
     }
 }
@@ -137,17 +171,19 @@ void Octree<NodeData>::addPrivate(
 template <typename NodeData> template <typename LookupProc>
 bool Octree<NodeData>::lookupPrivate(OctNode<NodeData> *node,
         const BBox &nodeBound, const Point &p, LookupProc &process) {
-    for (uint32_t i = 0; i < node->data.size(); ++i)
-        if (!process(node->data[i]))
+    for (const OctDataItem<NodeData> *item = node->dataHead; item;
+         item = item->next)
+        if (!process(item->data))
             return false;
     // Determine which octree child node _p_ is inside
     Point pMid = .5f * nodeBound.pMin + .5f * nodeBound.pMax;
     int child = (p.x > pMid.x ? 4 : 0) + (p.y > pMid.y ? 2 : 0) +
                 (p.z > pMid.z ? 1 : 0);
-    if (!node->children[child])
+    OctNode<NodeData> *childNode = node->children[child];
+    if (!childNode)
         return true;
     BBox childBound = octreeChildBound(child, nodeBound, pMid);
-    return lookupPrivate(node->children[child], childBound, p, process);
+    return lookupPrivate(childNode, childBound, p, process);
 }
 
 
@@ -65,6 +65,10 @@ static std::vector<Task *> taskQueue;
 static Semaphore *workerSemaphore;
 static uint32_t numUnfinishedTasks;
 static ConditionVariable *tasksRunningCondition;
+// Protected by _tasksRunningCondition_
+static std::vector<Task *> runningTasks;
+static int numTaskGroupWaiters;
+static bool tasksShuttingDown;
 #endif // PBRT_USE_GRAND_CENTRAL_DISPATCH
 #ifndef PBRT_USE_GRAND_CENTRAL_DISPATCH
 static
@@ -162,12 +166,12 @@ RWMutex::~RWMutex() {
 RWMutexLock::RWMutexLock(RWMutex &m, RWMutexLockType t) : type(t), mutex(m) {
     int err;
     if (t == READ) {
-        err = pthread_rwlock_rdlock(&m.mutex);
-        Severe("Error from pthread_rwlock_rdlock: %s", strerror(err));
+        if ((err = pthread_rwlock_rdlock(&m.mutex)) != 0)
+            Severe("Error from pthread_rwlock_rdlock: %s", strerror(err));
     }
     else {
-        err = pthread_rwlock_wrlock(&m.mutex); 
-        Severe("Error from pthread_rwlock_wrlock: %s", strerror(err));
+        if ((err = pthread_rwlock_wrlock(&m.mutex)) != 0)
+            Severe("Error from pthread_rwlock_wrlock: %s", strerror(err));
     }
 }
 
@@ -635,6 +639,13 @@ void ConditionVariable::Signal() {
 }
 
 
+void ConditionVariable::Broadcast() {
+    int err;
+    if ((err = pthread_cond_broadcast(&cond)) != 0)
+        Severe("Error from pthread_cond_broadcast: %s", strerror(err));
+}
+
+
 #endif // !PBRT_IS_WINDOWS
 #if defined(PBRT_IS_WINDOWS)
 
@@ -724,6 +735,16 @@ void ConditionVariable::Signal() {
 }
 
 
+void ConditionVariable::Broadcast() {
+    EnterCriticalSection(&waitersCountMutex);
+    int haveWaiters = (waitersCount > 0);
+    LeaveCriticalSection(&waitersCountMutex);
+
+    if (haveWaiters)
+        SetEvent(events[BROADCAST]);
+}
+
+
 #endif // PBRT_IS_WINDOWS
 void TasksInit() {
     if (PbrtOptions.nCores == 1)
@@ -734,6 +755,7 @@ void TasksInit() {
     static const int nThreads = NumSystemCores();
     workerSemaphore = new Semaphore;
     tasksRunningCondition = new ConditionVariable;
+    tasksShuttingDown = false;
 #if !defined(PBRT_IS_WINDOWS)
     threads = new pthread_t[nThreads];
     for (int i = 0; i < nThreads; ++i) {
@@ -763,6 +785,7 @@ void TasksCleanup() {
         return;
     { MutexLock lock(*taskQueueMutex);
     Assert(taskQueue.size() == 0);
+    tasksShuttingDown = true;
     }
 
     static const int nThreads = NumSystemCores();
@@ -840,10 +863,16 @@ static void *taskEntry(void *arg) {
         // Try to get task from task queue
         Task *myTask = NULL;
         { MutexLock lock(*taskQueueMutex);
-        if (taskQueue.size() == 0)
-            break;
+        if (taskQueue.size() == 0) {
+            // _WaitForTasks()_ may have taken the task this wakeup was for
+            if (tasksShuttingDown) break;
+            continue;
+        }
         myTask = taskQueue.back();
         taskQueue.pop_back();
+        tasksRunningCondition->Lock();
+        runningTasks.push_back(myTask);
+        tasksRunningCondition->Unlock();
         }
 
         // Do work for _myTask_
@@ -851,9 +880,11 @@ static void *taskEntry(void *arg) {
         myTask->Run();
         PBRT_FINISHED_TASK(myTask);
         tasksRunningCondition->Lock();
+        runningTasks.erase(std::find(runningTasks.begin(), runningTasks.end(),
+                                     myTask));
         int unfinished = --numUnfinishedTasks;
-        if (unfinished == 0)
-            tasksRunningCondition->Signal();
+        if (unfinished == 0 || numTaskGroupWaiters > 0)
+            tasksRunningCondition->Broadcast();
         tasksRunningCondition->Unlock();
     }
     // Cleanup from task thread and exit
@@ -881,6 +912,49 @@ void WaitForAllTasks() {
 }
 
 
+void WaitForTasks(const vector<Task *> &tasks) {
+    if (PbrtOptions.nCores == 1)
+        return; // enqueue just runs them immediately in this case
+#ifdef PBRT_USE_GRAND_CENTRAL_DISPATCH
+    dispatch_group_wait(gcdGroup, DISPATCH_TIME_FOREVER);
+#else
+    if (!tasksRunningCondition)
+        return;
+    // Run tasks that no worker has started yet on the calling thread, so
+    // that waiting from inside a task cannot starve the worker pool
+    vector<Task *> unstarted;
+    { MutexLock lock(*taskQueueMutex);
+    for (uint32_t i = 0; i < tasks.size(); ++i) {
+        vector<Task *>::iterator it = std::find(taskQueue.begin(),
+                                                taskQueue.end(), tasks[i]);
+        if (it != taskQueue.end()) {
+            taskQueue.erase(it);
+            unstarted.push_back(tasks[i]);
+        }
+    }
+    }
+    for (uint32_t i = 0; i < unstarted.size(); ++i) {
+        PBRT_STARTED_TASK(unstarted[i]);
+        unstarted[i]->Run();
+        PBRT_FINISHED_TASK(unstarted[i]);
+    }
+
+    // Wait for the remaining tasks, which are running on workers
+    tasksRunningCondition->Lock();
+    numUnfinishedTasks -= unstarted.size();
+    if (numUnfinishedTasks == 0)
+        tasksRunningCondition->Broadcast();
+    ++numTaskGroupWaiters;
+    for (uint32_t i = 0; i < tasks.size(); ++i)
+        while (std::find(runningTasks.begin(), runningTasks.end(),
+                         tasks[i]) != runningTasks.end())
+            tasksRunningCondition->Wait();
+    --numTaskGroupWaiters;
+    tasksRunningCondition->Unlock();
+#endif
+}
+
+
 int NumSystemCores() {
     if (PbrtOptions.nCores > 0) return PbrtOptions.nCores;
 #if defined(PBRT_IS_WINDOWS)
@@ -204,6 +204,24 @@ inline float AtomicAdd(volatile float *val, float delta) {
 }
 
 
+#ifdef PBRT_HAS_64_BIT_ATOMICS
+inline double AtomicAdd(volatile double *val, double delta) {
+    PBRT_ATOMIC_MEMORY_OP();
+    union bits { double f; int64_t i; };
+    bits oldVal, newVal;
+    do {
+#if (defined(__i386__) || defined(__amd64__))
+        __asm__ __volatile__ ("pause\n");
+#endif
+        oldVal.f = *val;
+        newVal.f = oldVal.f + delta;
+    } while (AtomicCompareAndSwap(((AtomicInt64 *)val),
+                                  newVal.i, oldVal.i) != oldVal.i);
+    return newVal.f;
+}
+#endif // PBRT_HAS_64_BIT_ATOMICS
+
+
 struct MutexLock;
 class Mutex {
 public:
@@ -313,6 +331,7 @@ public:
     void Unlock();
     void Wait();
     void Signal();
+    void Broadcast();
 private:
     // ConditionVariable Private Data
 #if !defined(PBRT_IS_WINDOWS)
@@ -341,6 +360,7 @@ public:
 
 void EnqueueTasks(const vector<Task *> &tasks);
 void WaitForAllTasks();
+void WaitForTasks(const vector<Task *> &tasks);
 int NumSystemCores();
 
 #endif // PBRT_CORE_PARALLEL_H
@@ -423,6 +423,45 @@ void ParamSet::Clear() {
 }
 
 
+template <typename T> static uint64_t HashItems(
+        const vector<Reference<ParamSetItem<T> > > &items, uint64_t hash) {
+    uint32_t nItems = items.size();
+    hash = HashBytes(&nItems, sizeof(nItems), hash);
+    for (uint32_t i = 0; i < items.size(); ++i) {
+        const ParamSetItem<T> &item = *items[i].GetPtr();
+        hash = HashBytes(item.name.c_str(), item.name.size() + 1, hash);
+        hash = HashBytes(&item.nItems, sizeof(item.nItems), hash);
+        hash = HashBytes(item.data, item.nItems * sizeof(T), hash);
+    }
+    return hash;
+}
+
+
+static uint64_t HashItems(
+        const vector<Reference<ParamSetItem<string> > > &items, uint64_t hash) {
+    uint32_t nItems = items.size();
+    hash = HashBytes(&nItems, sizeof(nItems), hash);
+    for (uint32_t i = 0; i < items.size(); ++i) {
+        const ParamSetItem<string> &item = *items[i].GetPtr();
+        hash = HashBytes(item.name.c_str(), item.name.size() + 1, hash);
+        for (int j = 0; j < item.nItems; ++j)
+            hash = HashBytes(item.data[j].c_str(), item.data[j].size() + 1, hash);
+    }
+    return hash;
+}
+
+
+uint64_t ParamSet::Hash(uint64_t hash) const {
+    // Hash parameter names and values of each type in turn
+    hash = HashItems(ints, hash);     hash = HashItems(bools, hash);
+    hash = HashItems(floats, hash);   hash = HashItems(points, hash);
+    hash = HashItems(vectors, hash);  hash = HashItems(normals, hash);
+    hash = HashItems(spectra, hash);  hash = HashItems(strings, hash);
+    hash = HashItems(textures, hash);
+    return hash;
+}
+
+
 string ParamSet::ToString() const {
     string ret;
     uint32_t i;
@@ -98,6 +98,7 @@ public:
     void ReportUnused() const;
     void Clear();
     string ToString() const;
+    uint64_t Hash(uint64_t hash) const;
     
 private:
     // ParamSet Private Data
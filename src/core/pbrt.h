@@ -158,6 +158,7 @@ struct CameraSample;
 struct Sample;
 class Filter;
 class Film;
+class FilmTile;
 class BxDF;
 class BRDF;
 class BTDF;
@@ -169,6 +170,7 @@ class BSSRDF;
 class Light;
 struct VisibilityTester;
 class AreaLight;
+class LightBVH;
 struct Distribution1D;
 struct Distribution2D;
 struct BSDFSample;
@@ -274,6 +276,18 @@ inline uint32_t RoundUpPow2(uint32_t v) {
 }
 
 
+inline uint64_t HashBytes(const void *data, size_t size,
+                          uint64_t hash = 14695981039346656037ull) {
+    // Accumulate FNV-1a hash of _data_
+    const unsigned char *bytes = (const unsigned char *)data;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+
 inline int Floor2Int(float val) {
     return (int)floorf(val);
 }
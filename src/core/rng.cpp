@@ -35,75 +35,57 @@
 #include "rng.h"
 
 // Random Number Method Definitions
-#define M 397
-#define MATRIX_A 0x9908b0dfUL   /* constant vector a */
-#define UPPER_MASK 0x80000000UL /* most significant w-r bits */
-#define LOWER_MASK 0x7fffffffUL /* least significant r bits */
-
-void RNG::Seed(uint32_t seed) const {
-    mt[0]= seed & 0xffffffffUL;
-    for (mti=1; mti<N; mti++) {
-        mt[mti] =
-        (1812433253UL * (mt[mti-1] ^ (mt[mti-1] >> 30)) + mti);
-        /* See Knuth TAOCP Vol2. 3rd Ed. P.106 for multiplier. */
-        /* In the previous versions, MSBs of the seed affect   */
-        /* only MSBs of the array mt[].                        */
-        /* 2002/01/09 modified by Makoto Matsumoto             */
-        mt[mti] &= 0xffffffffUL;
-        /* for >32 bit machines */
-    }
+void RNG::SetSequence(uint64_t sequence, uint64_t initState) const {
+    state = 0u;
+    inc = (sequence << 1u) | 1u;
+    RandomUInt();
+    state += initState;
+    RandomUInt();
 }
 
 
-/* generates a random number on [0,1)-real-interval */
-float RNG::RandomFloat() const
-{
-    PBRT_RNG_STARTED_RANDOM_FLOAT();
-    float v = (RandomUInt() & 0xffffff) / float(1 << 24);
-    PBRT_RNG_FINISHED_RANDOM_FLOAT();
-    return v;
+void RNG::Advance(int64_t delta) const {
+    // Accumulate the multiplier and increment of _delta_ steps by squaring
+    uint64_t curMult = PCG32_MULT, curPlus = inc, accMult = 1u, accPlus = 0u;
+    uint64_t d = (uint64_t)delta;
+    while (d > 0) {
+        if (d & 1) {
+            accMult *= curMult;
+            accPlus = accPlus * curMult + curPlus;
+        }
+        curPlus = (curMult + 1) * curPlus;
+        curMult *= curMult;
+        d /= 2;
+    }
+    state = accMult * state + accPlus;
 }
 
 
-
-// Random Number Functions
-uint32_t RNG::RandomUInt() const
-{
-    unsigned long y;
-    static unsigned long mag01[2]={0x0UL, MATRIX_A};
-    /* mag01[x] = x * MATRIX_A  for x=0,1 */
-
-    if (mti >= N) { /* generate N words at one time */
-        PBRT_RNG_STARTED_TABLEGEN();
-        int kk;
-
-        if (mti == N+1)   /* if Seed() has not been called, */
-            Seed(5489UL); /* default initial seed */
-
-        for (kk=0;kk<N-M;kk++) {
-            y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
-            mt[kk] = mt[kk+M] ^ (y >> 1) ^ mag01[y & 0x1UL];
-        }
-        for (;kk<N-1;kk++) {
-            y = (mt[kk]&UPPER_MASK)|(mt[kk+1]&LOWER_MASK);
-            mt[kk] = mt[kk+(M-N)] ^ (y >> 1) ^ mag01[y & 0x1UL];
+void RNG::RandomFloats(float *v, int n) const {
+    // The states of a block of four numbers are computed directly from the
+    // state at its start, so the output permutation of the four has no
+    // serial dependency and can be vectorized
+    const int block = 4;
+    uint64_t mult[block+1], plus[block+1];
+    mult[0] = 1u;
+    plus[0] = 0u;
+    for (int k = 1; k <= block; ++k) {
+        mult[k] = mult[k-1] * PCG32_MULT;
+        plus[k] = plus[k-1] * PCG32_MULT + inc;
+    }
+    int i = 0;
+    for (; i + block <= n; i += block) {
+        for (int k = 0; k < block; ++k) {
+            uint64_t s = mult[k] * state + plus[k];
+            uint32_t xorShifted = (uint32_t)(((s >> 18u) ^ s) >> 27u);
+            uint32_t rot = (uint32_t)(s >> 59u);
+            uint32_t r = (xorShifted >> rot) | (xorShifted << ((~rot + 1u) & 31));
+            v[i+k] = (r >> 8) / float(1 << 24);
         }
-        y = (mt[N-1]&UPPER_MASK)|(mt[0]&LOWER_MASK);
-        mt[N-1] = mt[M-1] ^ (y >> 1) ^ mag01[y & 0x1UL];
-
-        mti = 0;
-        PBRT_RNG_FINISHED_TABLEGEN();
+        state = mult[block] * state + plus[block];
     }
-
-    y = mt[mti++];
-
-    /* Tempering */
-    y ^= (y >> 11);
-    y ^= (y << 7) & 0x9d2c5680UL;
-    y ^= (y << 15) & 0xefc60000UL;
-    y ^= (y >> 18);
-
-    return y;
+    for (; i < n; ++i)
+        v[i] = RandomFloat();
 }
 
 
@@ -41,23 +41,57 @@
 #include "probes.h"
 
 // Random Number Declarations
+#define PCG32_DEFAULT_STATE  0x853c49e6748fea9bULL
+#define PCG32_DEFAULT_STREAM 0xda3e39cb94b95bdbULL
+#define PCG32_MULT           0x5851f42d4c957f2dULL
+
+// PCG32 generator (O'Neill, "PCG: A Family of Simple Fast Space-Efficient
+// Statistically Good Algorithms for Random Number Generation").  The state
+// is two 64-bit words, so generators are cheap to create and seed, and the
+// seed selects one of 2^63 independent streams.
 class RNG {
 public:
-    RNG(uint32_t seed = 5489UL) {
-        mti = N+1; /* mti==N+1 means mt[N] is not initialized */
+    RNG(uint32_t seed = 5489UL) : state(0u), inc(1u) {
         Seed(seed);
     }
+    RNG(uint64_t sequence, uint64_t initState) : state(0u), inc(1u) {
+        SetSequence(sequence, initState);
+    }
 
-    void Seed(uint32_t seed) const;
-    float RandomFloat() const;
-    uint32_t RandomUInt() const;
+    void Seed(uint32_t seed) const {
+        SetSequence(seed, PCG32_DEFAULT_STATE);
+    }
+    // Starts stream _sequence_, reproducible for a given pixel or task index
+    void SetSequence(uint64_t sequence, uint64_t initState = PCG32_DEFAULT_STATE) const;
+    // Skips _delta_ numbers ahead (or back) in the stream in O(log delta)
+    void Advance(int64_t delta) const;
+    inline float RandomFloat() const;
+    inline uint32_t RandomUInt() const;
+    // Fills _v_ with the next _n_ numbers of RandomFloat()
+    void RandomFloats(float *v, int n) const;
 
 private:
-    static const int N = 624;
-    mutable unsigned long mt[N]; /* the array for the state vector  */
-    mutable int mti;
+    mutable uint64_t state, inc;
 };
 
 
+inline uint32_t RNG::RandomUInt() const {
+    uint64_t oldState = state;
+    state = oldState * PCG32_MULT + inc;
+    uint32_t xorShifted = (uint32_t)(((oldState >> 18u) ^ oldState) >> 27u);
+    uint32_t rot = (uint32_t)(oldState >> 59u);
+    return (xorShifted >> rot) | (xorShifted << ((~rot + 1u) & 31));
+}
+
+
+/* generates a random number on [0,1)-real-interval */
+inline float RNG::RandomFloat() const {
+    PBRT_RNG_STARTED_RANDOM_FLOAT();
+    float v = (RandomUInt() >> 8) / float(1 << 24);
+    PBRT_RNG_FINISHED_RANDOM_FLOAT();
+    return v;
+}
+
+
 
 #endif // PBRT_CORE_RNG_H
@@ -0,0 +1,218 @@
+
+/*
+    pbrt source code Copyright(c) 1998-2012 Matt Pharr and Greg Humphreys.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+
+// core/samplebuffer.cpp*
+#include "stdafx.h"
+#include "samplebuffer.h"
+#include "sampler.h"
+#include "intersection.h"
+
+// SampleBuffer Local Declarations
+static const int featureSizes[] = { 3, 2, 2, 1, 3, 3, 1, 3, 3, 3 };
+
+// SampleBuffer Method Definitions
+SampleBuffer::SampleBuffer(int xStart, int yStart, int xCount, int yCount,
+        uint32_t feats, int maxSamplesPerPixel, float maxMB)
+    : xPixelStart(xStart), yPixelStart(yStart),
+      xPixelCount(xCount), yPixelCount(yCount), features(feats),
+      maxMegabytes(maxMB), allocated(false) {
+    // Lay out the requested features in a record
+    recordSize = 0;
+    for (int i = 0; i < nFeatures; ++i) {
+        if (features & (1u << i)) {
+            featureOffsets[i] = recordSize;
+            recordSize += featureSizes[i];
+        }
+        else
+            featureOffsets[i] = -1;
+    }
+
+    // Create one reservoir tile for each _tileSize_ square of pixels
+    nTilesX = (xPixelCount + tileSize - 1) / tileSize;
+    nTilesY = (yPixelCount + tileSize - 1) / tileSize;
+    tiles.resize(nTilesX * nTilesY);
+    for (uint32_t i = 0; i < tiles.size(); ++i) {
+        tiles[i].mutex = Mutex::Create();
+        tiles[i].rng.Seed(i);
+        tiles[i].records = NULL;
+        tiles[i].seen = NULL;
+        tiles[i].stored = tiles[i].reserved = NULL;
+    }
+    SetMaxSamplesPerPixel(maxSamplesPerPixel);
+}
+
+
+SampleBuffer::~SampleBuffer() {
+    for (uint32_t i = 0; i < tiles.size(); ++i) {
+        Tile &tile = tiles[i];
+        Mutex::Destroy(tile.mutex);
+        if (!tile.records) continue;
+        int tx = i % nTilesX, ty = i / nTilesX;
+        int nPixels = min(tileSize, xPixelCount - tx * tileSize) *
+                      min(tileSize, yPixelCount - ty * tileSize);
+        for (int p = 0; p < nPixels; ++p)
+            delete[] tile.records[p];
+        delete[] tile.records;
+        delete[] tile.seen;
+        delete[] tile.stored;
+        delete[] tile.reserved;
+    }
+}
+
+
+void SampleBuffer::SetMaxSamplesPerPixel(int spp) {
+    if (allocated) {
+        Warning("Sample buffer already holds samples, ignoring new "
+                "per-pixel sample limit %d", spp);
+        return;
+    }
+    // Limit the reservoir size so that all pixels fit in _maxMegabytes_
+    double pixelBytes = double(recordSize) * sizeof(float) *
+                        xPixelCount * yPixelCount;
+    int fit = int(min(maxMegabytes * 1048576. / pixelBytes, 1e6));
+    capacity = max(1, min(spp, fit));
+    requestedSpp = spp;
+}
+
+
+void SampleBuffer::AllocateTile(int tileIndex) {
+    int tx = tileIndex % nTilesX, ty = tileIndex / nTilesX;
+    int nPixels = min(tileSize, xPixelCount - tx * tileSize) *
+                  min(tileSize, yPixelCount - ty * tileSize);
+    Tile &tile = tiles[tileIndex];
+    tile.records = new float *[nPixels];
+    tile.seen = new uint32_t[nPixels];
+    tile.stored = new int[nPixels];
+    tile.reserved = new int[nPixels];
+    memset(tile.records, 0, nPixels * sizeof(float *));
+    memset(tile.seen, 0, nPixels * sizeof(uint32_t));
+    memset(tile.stored, 0, nPixels * sizeof(int));
+    memset(tile.reserved, 0, nPixels * sizeof(int));
+}
+
+
+void SampleBuffer::AddSample(const CameraSample &sample, const Spectrum &L,
+                             const Intersection &isect) {
+    int x = Floor2Int(sample.imageX) - xPixelStart;
+    int y = Floor2Int(sample.imageY) - yPixelStart;
+    if (x < 0 || y < 0 || x >= xPixelCount || y >= yPixelCount)
+        return;
+
+    // Gather the sample's features before taking the tile lock
+    float *record = ALLOCA(float, recordSize);
+    float *r = record;
+    if (features & SAMPLE_COLOR) {
+        L.ToRGB(r);
+        r += 3;
+    }
+    if (features & SAMPLE_IMAGE_POS) {
+        *r++ = sample.imageX;
+        *r++ = sample.imageY;
+    }
+    if (features & SAMPLE_LENS_POS) {
+        *r++ = sample.lensU;
+        *r++ = sample.lensV;
+    }
+    if (features & SAMPLE_TIME)
+        *r++ = sample.time;
+    if (features & SAMPLE_NORMAL)
+        for (int i = 0; i < 3; ++i) *r++ = isect.shadingN[i];
+    if (features & SAMPLE_RHO) {
+        isect.rho.ToRGB(r);
+        r += 3;
+    }
+    if (features & SAMPLE_DEPTH)
+        *r++ = isect.depth;
+    if (features & SAMPLE_SECOND_NORMAL)
+        for (int i = 0; i < 3; ++i) *r++ = isect.secondNormal[i];
+    if (features & SAMPLE_SECOND_ORIGIN)
+        for (int i = 0; i < 3; ++i) *r++ = isect.secondOrigin[i];
+    if (features & SAMPLE_THIRD_ORIGIN)
+        for (int i = 0; i < 3; ++i) *r++ = isect.thirdOrigin[i];
+
+    // Insert the record into the pixel's reservoir
+    int tileIndex = TileIndex(x, y);
+    Tile &tile = tiles[tileIndex];
+    MutexLock lock(*tile.mutex);
+    if (!tile.records) {
+        if (!allocated && capacity < requestedSpp)
+            Warning("Keeping %d of up to %d samples per pixel to stay "
+                    "within the %g MB sample memory limit", capacity,
+                    requestedSpp, maxMegabytes);
+        AllocateTile(tileIndex);
+        allocated = true;
+    }
+    int p = TilePixel(x, y);
+    uint32_t seen = ++tile.seen[p];
+    int slot;
+    if (tile.stored[p] < capacity) {
+        if (tile.stored[p] == tile.reserved[p]) {
+            // Grow the pixel's reservoir geometrically up to _capacity_
+            int n = min(capacity, max(4, 2 * tile.reserved[p]));
+            float *records = new float[size_t(n) * recordSize];
+            memcpy(records, tile.records[p],
+                   size_t(tile.stored[p]) * recordSize * sizeof(float));
+            delete[] tile.records[p];
+            tile.records[p] = records;
+            tile.reserved[p] = n;
+        }
+        slot = tile.stored[p]++;
+    }
+    else {
+        // Keep a uniform subset of the _seen_ samples
+        uint32_t j = tile.rng.RandomUInt() % seen;
+        if (j >= uint32_t(capacity)) return;
+        slot = int(j);
+    }
+    memcpy(tile.records[p] + size_t(slot) * recordSize, record,
+           recordSize * sizeof(float));
+}
+
+
+int SampleBuffer::StoredSamples(int x, int y) const {
+    const Tile &tile = tiles[TileIndex(x, y)];
+    return tile.stored ? tile.stored[TilePixel(x, y)] : 0;
+}
+
+
+uint32_t SampleBuffer::TotalSamples(int x, int y) const {
+    const Tile &tile = tiles[TileIndex(x, y)];
+    return tile.seen ? tile.seen[TilePixel(x, y)] : 0;
+}
+
+
+const float *SampleBuffer::GetSample(int x, int y, int i) const {
+    const Tile &tile = tiles[TileIndex(x, y)];
+    return tile.records[TilePixel(x, y)] + size_t(i) * recordSize;
+}
+
+
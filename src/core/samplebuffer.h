@@ -0,0 +1,119 @@
+
+/*
+    pbrt source code Copyright(c) 1998-2012 Matt Pharr and Greg Humphreys.
+
+    This file is part of pbrt.
+
+    Redistribution and use in source and binary forms, with or without
+    modification, are permitted provided that the following conditions are
+    met:
+
+    - Redistributions of source code must retain the above copyright
+      notice, this list of conditions and the following disclaimer.
+
+    - Redistributions in binary form must reproduce the above copyright
+      notice, this list of conditions and the following disclaimer in the
+      documentation and/or other materials provided with the distribution.
+
+    THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS
+    IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED
+    TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A
+    PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+    HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+    SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+    LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+    DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+    THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+    (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+    OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+ */
+
+#if defined(_MSC_VER)
+#pragma once
+#endif
+
+#ifndef PBRT_CORE_SAMPLEBUFFER_H
+#define PBRT_CORE_SAMPLEBUFFER_H
+
+// core/samplebuffer.h*
+#include "pbrt.h"
+#include "parallel.h"
+#include "rng.h"
+
+// Per-sample features a _SampleBuffer_ can record, one bit each
+enum SampleFeature {
+    SAMPLE_COLOR         = 1 << 0,  // RGB radiance, 3 floats
+    SAMPLE_IMAGE_POS     = 1 << 1,  // Raster position, 2 floats
+    SAMPLE_LENS_POS      = 1 << 2,  // Lens position, 2 floats
+    SAMPLE_TIME          = 1 << 3,  // 1 float
+    SAMPLE_NORMAL        = 1 << 4,  // First hit shading normal, 3 floats
+    SAMPLE_RHO           = 1 << 5,  // First hit albedo, 3 floats
+    SAMPLE_DEPTH         = 1 << 6,  // First hit distance, 1 float
+    SAMPLE_SECOND_NORMAL = 1 << 7,  // Second hit normal, 3 floats
+    SAMPLE_SECOND_ORIGIN = 1 << 8,  // Second hit position, 3 floats
+    SAMPLE_THIRD_ORIGIN  = 1 << 9   // Third hit position, 3 floats
+};
+
+
+// SampleBuffer Declarations
+class SampleBuffer {
+public:
+    // SampleBuffer Public Methods
+    SampleBuffer(int xStart, int yStart, int xCount, int yCount,
+                 uint32_t features, int maxSamplesPerPixel,
+                 float maxMegabytes);
+    ~SampleBuffer();
+    void SetMaxSamplesPerPixel(int spp);
+    void AddSample(const CameraSample &sample, const Spectrum &L,
+                   const Intersection &isect);
+    uint32_t Features() const { return features; }
+    // Offset of feature _f_ within a record, -1 if it isn't recorded
+    int FeatureOffset(SampleFeature f) const {
+        int i = 0;
+        while (!(uint32_t(f) & (1u << i))) ++i;
+        return featureOffsets[i];
+    }
+    int RecordSize() const { return recordSize; }
+    int MaxSamplesPerPixel() const { return capacity; }
+    int StoredSamples(int x, int y) const;
+    uint32_t TotalSamples(int x, int y) const;
+    const float *GetSample(int x, int y, int i) const;
+private:
+    // SampleBuffer Private Methods
+    void AllocateTile(int tileIndex);
+    int TileIndex(int x, int y) const {
+        return (y / tileSize) * nTilesX + x / tileSize;
+    }
+    int TilePixel(int x, int y) const {
+        int x0 = (x / tileSize) * tileSize, y0 = (y / tileSize) * tileSize;
+        return (y - y0) * min(tileSize, xPixelCount - x0) + (x - x0);
+    }
+
+    // SampleBuffer Private Data
+    static const int tileSize = 16;
+    static const int nFeatures = 10;
+    int xPixelStart, yPixelStart, xPixelCount, yPixelCount;
+    int nTilesX, nTilesY;
+    uint32_t features;
+    int featureOffsets[nFeatures];
+    int recordSize;
+    int capacity, requestedSpp;
+    float maxMegabytes;
+    bool allocated;
+    // Each tile keeps a reservoir of at most _capacity_ records per
+    // pixel; reservoirs are allocated on the first sample that lands in
+    // the tile and grow with the pixel's sample count
+    struct Tile {
+        Mutex *mutex;
+        RNG rng;
+        float **records;
+        uint32_t *seen;
+        int *stored, *reserved;
+    };
+    vector<Tile> tiles;
+};
+
+
+
+#endif // PBRT_CORE_SAMPLEBUFFER_H
@@ -55,6 +55,7 @@ Scene::Scene(Primitive *accel, const vector<Light *> &lts,
     lights = lts;
     aggregate = accel;
     volumeRegion = vr;
+    descriptionHash = 0;
     // Scene Constructor Implementation
     bound = aggregate->WorldBound();
     if (volumeRegion) bound = Union(bound, volumeRegion->WorldBound());
@@ -66,6 +66,7 @@ public:
     vector<Light *> lights;
     VolumeRegion *volumeRegion;
     BBox bound;
+    uint64_t descriptionHash;
 };
 
 
@@ -41,6 +41,8 @@
 #include <float.h>
 
 // Spherical Harmonics Local Definitions
+#define SH_BLOCK_SIZE 64
+#define SH_MAX_BLOCK_LMAX 28
 static void legendrep(float x, int lmax, float *out) {
 #define P(l,m) out[SHIndex(l,m)]
     // Compute $m=0$ Legendre values using recurrence
@@ -218,6 +220,107 @@ void SHEvaluate(const Vector &w, int lmax, float *out) {
 }
 
 
+static void shEvaluateBlock(const Vector *w, int nw, int stride, int lmax,
+                            const float *Klm, float *out) {
+    // Compute Legendre polynomial values for $\cos\theta$ of each direction
+#define P(l,m) (&out[SHIndex(l,m) * stride])
+    for (int i = 0; i < nw; ++i) {
+        P(0,0)[i] = 1.f;
+        if (lmax > 0) P(1,0)[i] = w[i].z;
+    }
+    for (int l = 2; l <= lmax; ++l) {
+        float *pl = P(l,0);
+        const float *pl1 = P(l-1,0), *pl2 = P(l-2,0);
+        for (int i = 0; i < nw; ++i)
+            pl[i] = ((2*l-1)*w[i].z*pl1[i] - (l-1)*pl2[i]) / l;
+    }
+    float xroot[SH_BLOCK_SIZE], xpow[SH_BLOCK_SIZE];
+    for (int i = 0; i < nw; ++i)
+        xpow[i] = xroot[i] = sqrtf(max(0.f, 1.f - w[i].z*w[i].z));
+    float neg = -1.f, dfact = 1.f;
+    for (int l = 1; l <= lmax; ++l) {
+        float *pll = P(l,l);
+        for (int i = 0; i < nw; ++i) {
+            pll[i] = neg * dfact * xpow[i];
+            xpow[i] *= xroot[i];
+        }
+        neg *= -1.f;
+        dfact *= 2*l + 1;
+    }
+    for (int l = 2; l <= lmax; ++l) {
+        float *pl = P(l,l-1);
+        const float *pl1 = P(l-1,l-1);
+        for (int i = 0; i < nw; ++i)
+            pl[i] = w[i].z * (2*l-1) * pl1[i];
+    }
+    for (int l = 3; l <= lmax; ++l)
+        for (int m = 1; m <= l-2; ++m) {
+            float *pl = P(l,m);
+            const float *pl1 = P(l-1,m), *pl2 = P(l-2,m);
+            for (int i = 0; i < nw; ++i)
+                pl[i] = ((2 * (l-1) + 1) * w[i].z * pl1[i] -
+                         (l-1+m) * pl2[i]) / (l - m);
+        }
+
+    // Compute $\sin m\phi$ and $\cos m\phi$ values for each direction
+    float sins[(SH_MAX_BLOCK_LMAX+1) * SH_BLOCK_SIZE];
+    float coss[(SH_MAX_BLOCK_LMAX+1) * SH_BLOCK_SIZE];
+    for (int i = 0; i < nw; ++i) {
+        float xyLen = sqrtf(max(0.f, 1.f - w[i].z*w[i].z));
+        float s = 0.f, c = 1.f;
+        if (xyLen != 0.f) { s = w[i].y / xyLen; c = w[i].x / xyLen; }
+        float si = 0.f, ci = 1.f;
+        for (int m = 0; m <= lmax; ++m) {
+            sins[m * SH_BLOCK_SIZE + i] = si;
+            coss[m * SH_BLOCK_SIZE + i] = ci;
+            float oldsi = si;
+            si = si * c + ci * s;
+            ci = ci * c - oldsi * s;
+        }
+    }
+
+    // Apply SH definitions to compute final $(l,m)$ values
+    static const float sqrt2 = sqrtf(2.f);
+    for (int l = 0; l <= lmax; ++l) {
+        for (int m = -l; m < 0; ++m) {
+            float *plm = P(l,m);
+            const float *pl = P(l,-m), *sm = &sins[-m * SH_BLOCK_SIZE];
+            float k = sqrt2 * Klm[SHIndex(l, m)];
+            for (int i = 0; i < nw; ++i)
+                plm[i] = k * pl[i] * sm[i];
+        }
+        float *pl0 = P(l,0);
+        for (int i = 0; i < nw; ++i)
+            pl0[i] *= Klm[SHIndex(l, 0)];
+        for (int m = 1; m <= l; ++m) {
+            float *plm = P(l,m);
+            const float *cm = &coss[m * SH_BLOCK_SIZE];
+            float k = sqrt2 * Klm[SHIndex(l, m)];
+            for (int i = 0; i < nw; ++i)
+                plm[i] *= k * cm[i];
+        }
+    }
+#undef P
+}
+
+
+void SHEvaluate(const Vector *w, int nw, int lmax, float *out) {
+    // Evaluate SH basis for _nw_ directions; _out[k*nw+i]_ is term _k_ of _w[i]_
+    if (lmax > SH_MAX_BLOCK_LMAX) {
+        Error("SHEvaluate() runs out of numerical precision for lmax > 28. "
+               "If you need more bands, try recompiling using doubles.");
+        exit(1);
+    }
+    float *Klm = ALLOCA(float, SHTerms(lmax));
+    for (int l = 0; l <= lmax; ++l)
+        for (int m = -l; m <= l; ++m)
+            Klm[SHIndex(l, m)] = K(l, m);
+    for (int i = 0; i < nw; i += SH_BLOCK_SIZE)
+        shEvaluateBlock(&w[i], min(SH_BLOCK_SIZE, nw - i), nw, lmax, Klm,
+                        &out[i]);
+}
+
+
 #if 0
 // Believe this is correct, but not well tested
 void SHEvaluate(float costheta, float cosphi, float sinphi, int lmax, float *out) {
@@ -307,11 +410,9 @@ void SHProjectIncidentIndirectRadiance(const Point &p, float pEpsilon,
         // Fill in values in _sample_ for radiance probe ray
         sample->time = time;
         for (uint32_t j = 0; j < sample->n1D.size(); ++j)
-            for (uint32_t k = 0; k < sample->n1D[j]; ++k)
-                sample->oneD[j][k] = rng.RandomFloat();
+            rng.RandomFloats(sample->oneD[j], sample->n1D[j]);
         for (uint32_t j = 0; j < sample->n2D.size(); ++j)
-            for (uint32_t k = 0; k < 2 * sample->n2D[j]; ++k)
-                sample->twoD[j][k] = rng.RandomFloat();
+            rng.RandomFloats(sample->twoD[j], 2 * sample->n2D[j]);
         Li = renderer->Li(scene, ray, sample, rng, arena);
 
         // Update SH coefficients for probe sample point
@@ -424,24 +525,88 @@ void SHComputeDiffuseTransfer(const Point &p, const Normal &n,
 void SHComputeTransferMatrix(const Point &p, float rayEpsilon,
         const Scene *scene, RNG &rng, int nSamples, int lmax,
         Spectrum *T) {
-    for (int i = 0; i < SHTerms(lmax)*SHTerms(lmax); ++i)
-        T[i] = 0.f;
+    int nTerms = SHTerms(lmax);
+    float *Tf = new float[nTerms*nTerms];
+    for (int i = 0; i < nTerms*nTerms; ++i)
+        Tf[i] = 0.f;
     uint32_t scramble[2] = { rng.RandomUInt(), rng.RandomUInt() };
-    float *Ylm = ALLOCA(float, SHTerms(lmax));
+    Vector w[SH_BLOCK_SIZE];
+    float *Ylm = new float[nTerms * SH_BLOCK_SIZE];
+    int nw = 0;
     for (int i = 0; i < nSamples; ++i) {
         // Compute Monte Carlo estimate of $i$th sample for transfer matrix
         float u[2];
         Sample02(i, scramble, u);
-        Vector w = UniformSampleSphere(u[0], u[1]);
-        float pdf = UniformSpherePdf();
-        if (!scene->IntersectP(Ray(p, w, rayEpsilon))) {
-            // Update transfer matrix for unoccluded direction
-            SHEvaluate(w, lmax, Ylm);
-            for (int j = 0; j < SHTerms(lmax); ++j)
-                for (int k = 0; k < SHTerms(lmax); ++k)
-                    T[j*SHTerms(lmax)+k] += (Ylm[j] * Ylm[k]) / (pdf * nSamples);
+        w[nw] = UniformSampleSphere(u[0], u[1]);
+        if (!scene->IntersectP(Ray(p, w[nw], rayEpsilon)))
+            ++nw;
+        if (nw == SH_BLOCK_SIZE || (i == nSamples-1 && nw > 0)) {
+            // Add outer products of a block of unoccluded directions' SH values
+            SHEvaluate(w, nw, lmax, Ylm);
+            for (int j = 0; j < nTerms; ++j) {
+                const float *Yj = &Ylm[j*nw];
+                for (int k = j; k < nTerms; ++k) {
+                    const float *Yk = &Ylm[k*nw];
+                    float sum = 0.f;
+                    for (int d = 0; d < nw; ++d)
+                        sum += Yj[d] * Yk[d];
+                    Tf[j*nTerms+k] += sum;
+                }
+            }
+            nw = 0;
+        }
+    }
+
+    // Scale and mirror upper triangle of symmetric transfer matrix
+    float scale = 1.f / (UniformSpherePdf() * nSamples);
+    for (int j = 0; j < nTerms; ++j)
+        for (int k = j; k < nTerms; ++k)
+            T[j*nTerms+k] = T[k*nTerms+j] = Spectrum(scale * Tf[j*nTerms+k]);
+    delete[] Ylm;
+    delete[] Tf;
+}
+
+
+void SHComputeTransferredRadiance(const Point &p, float rayEpsilon,
+        const Scene *scene, RNG &rng, int nSamples, int lmax,
+        const Spectrum *c_in, Spectrum *c_t) {
+    // Accumulate the transfer matrix times _c\_in_ without forming the matrix
+    int nTerms = SHTerms(lmax);
+    for (int i = 0; i < nTerms; ++i)
+        c_t[i] = 0.f;
+    uint32_t scramble[2] = { rng.RandomUInt(), rng.RandomUInt() };
+    Vector w[SH_BLOCK_SIZE];
+    Spectrum Li[SH_BLOCK_SIZE];
+    float *Ylm = new float[nTerms * SH_BLOCK_SIZE];
+    int nw = 0;
+    for (int i = 0; i < nSamples; ++i) {
+        // Collect unoccluded sample directions into blocks
+        float u[2];
+        Sample02(i, scramble, u);
+        w[nw] = UniformSampleSphere(u[0], u[1]);
+        if (!scene->IntersectP(Ray(p, w[nw], rayEpsilon)))
+            ++nw;
+        if (nw == SH_BLOCK_SIZE || (i == nSamples-1 && nw > 0)) {
+            // Project incident radiance for each direction back into SH
+            SHEvaluate(w, nw, lmax, Ylm);
+            for (int d = 0; d < nw; ++d)
+                Li[d] = 0.f;
+            for (int k = 0; k < nTerms; ++k)
+                for (int d = 0; d < nw; ++d)
+                    Li[d] += Ylm[k*nw+d] * c_in[k];
+            for (int k = 0; k < nTerms; ++k) {
+                Spectrum sum = 0.f;
+                for (int d = 0; d < nw; ++d)
+                    sum += Ylm[k*nw+d] * Li[d];
+                c_t[k] += sum;
+            }
+            nw = 0;
         }
     }
+    float scale = 1.f / (UniformSpherePdf() * nSamples);
+    for (int i = 0; i < nTerms; ++i)
+        c_t[i] *= scale;
+    delete[] Ylm;
 }
 
 
@@ -496,10 +661,27 @@ void SHComputeBSDFMatrix(const Spectrum &Kd, const Spectrum &Ks,
 
 void SHMatrixVectorMultiply(const Spectrum *M, const Spectrum *v,
         Spectrum *vout, int lmax) {
-    for (int i = 0; i < SHTerms(lmax); ++i) {
-        vout[i] = 0.f;
-        for (int j = 0; j < SHTerms(lmax); ++j)
-            vout[i] += M[SHTerms(lmax) * i + j] * v[j];
+    int n = SHTerms(lmax), i = 0;
+    // Compute blocks of four rows so each _v[j]_ is loaded once per block
+    for (; i + 3 < n; i += 4) {
+        const Spectrum *m0 = &M[n*i], *m1 = m0 + n, *m2 = m1 + n, *m3 = m2 + n;
+        Spectrum s0 = 0.f, s1 = 0.f, s2 = 0.f, s3 = 0.f;
+        for (int j = 0; j < n; ++j) {
+            s0 += m0[j] * v[j];
+            s1 += m1[j] * v[j];
+            s2 += m2[j] * v[j];
+            s3 += m3[j] * v[j];
+        }
+        vout[i] = s0;
+        vout[i+1] = s1;
+        vout[i+2] = s2;
+        vout[i+3] = s3;
+    }
+    for (; i < n; ++i) {
+        Spectrum sum = 0.f;
+        for (int j = 0; j < n; ++j)
+            sum += M[n*i + j] * v[j];
+        vout[i] = sum;
     }
 }
 
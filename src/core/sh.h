@@ -53,6 +53,7 @@ inline int SHIndex(int l, int m) {
 
 
 void SHEvaluate(const Vector &v, int lmax, float *out);
+void SHEvaluate(const Vector *w, int nw, int lmax, float *out);
 void SHWriteImage(const char *filename, const Spectrum *c, int lmax, int yres);
 template <typename Func>
 void SHProjectCube(Func func, const Point &p, int res, int lmax,
@@ -120,6 +121,9 @@ void SHComputeDiffuseTransfer(const Point &p, const Normal &n, float rayEpsilon,
     const Scene *scene, RNG &rng, int nSamples, int lmax, Spectrum *c_transfer);
 void SHComputeTransferMatrix(const Point &p, float rayEpsilon,
     const Scene *scene, RNG &rng, int nSamples, int lmax, Spectrum *T);
+void SHComputeTransferredRadiance(const Point &p, float rayEpsilon,
+    const Scene *scene, RNG &rng, int nSamples, int lmax,
+    const Spectrum *c_in, Spectrum *c_t);
 void SHComputeBSDFMatrix(const Spectrum &Kd, const Spectrum &Ks,
     float roughness, RNG &rng, int nSamples, int lmax, Spectrum *B);
 void SHMatrixVectorMultiply(const Spectrum *M, const Spectrum *v,
@@ -74,6 +74,10 @@ public:
         return Sample(u1, u2, Ns);
     }
     virtual float Pdf(const Point &p, const Vector &wi) const;
+    // Bounds the surface normals by a cone; false if they are unbounded
+    virtual bool GetNormalCone(Vector *axis, float *cosTheta) const {
+        return false;
+    }
 
     // Shape Public Data
     const Transform *ObjectToWorld, *WorldToObject;
@@ -361,6 +361,99 @@ void AnimatedTransform::Decompose(const Matrix4x4 &m, Vector *T,
 }
 
 
+void AnimatedTransform::PrecomputeSlerp() {
+    // Cache the angle and orthogonal quaternion that _Slerp()_ would
+    // recompute for every interpolation between _R[0]_ and _R[1]_
+    float cosTheta = Dot(R[0], R[1]);
+    slerpLinear = cosTheta > .9995f;
+    slerpTheta = 0.f;
+    if (!slerpLinear) {
+        slerpTheta = acosf(Clamp(cosTheta, -1.f, 1.f));
+        slerpPerp = Normalize(R[1] - R[0] * cosTheta);
+    }
+}
+
+
+// Rotation matrix of a unit quaternion, as applied by _ToTransform()_
+static void RotationMatrix(const Quaternion &q, float r[3][3]) {
+    float xx = q.v.x * q.v.x, yy = q.v.y * q.v.y, zz = q.v.z * q.v.z;
+    float xy = q.v.x * q.v.y, xz = q.v.x * q.v.z, yz = q.v.y * q.v.z;
+    float wx = q.v.x * q.w,   wy = q.v.y * q.w,   wz = q.v.z * q.w;
+    r[0][0] = 1.f - 2.f * (yy + zz);
+    r[0][1] =       2.f * (xy - wz);
+    r[0][2] =       2.f * (xz + wy);
+    r[1][0] =       2.f * (xy + wz);
+    r[1][1] = 1.f - 2.f * (xx + zz);
+    r[1][2] =       2.f * (yz - wx);
+    r[2][0] =       2.f * (xz - wy);
+    r[2][1] =       2.f * (yz + wx);
+    r[2][2] = 1.f - 2.f * (xx + yy);
+}
+
+
+void AnimatedTransform::Interpolate(float dt, Matrix4x4 *m,
+                                    Matrix4x4 *mInv) const {
+    // Interpolate translation at _dt_
+    Vector trans = (1.f - dt) * T[0] + dt * T[1];
+
+    // Interpolate rotation at _dt_
+    Quaternion q;
+    if (slerpLinear)
+        q = Normalize((1.f - dt) * R[0] + dt * R[1]);
+    else {
+        float thetap = slerpTheta * dt;
+        q = R[0] * cosf(thetap) + slerpPerp * sinf(thetap);
+    }
+    float r[3][3];
+    RotationMatrix(q, r);
+
+    // Interpolate scale at _dt_
+    float s[3][3];
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+            s[i][j] = Lerp(dt, S[0].m[i][j], S[1].m[i][j]);
+
+    // Compute interpolated matrix $\VEC{T} \VEC{R} \VEC{S}$ directly
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j)
+            m->m[i][j] = r[i][0] * s[0][j] + r[i][1] * s[1][j] +
+                         r[i][2] * s[2][j];
+        m->m[i][3] = trans[i];
+        m->m[3][i] = 0.f;
+    }
+    m->m[3][3] = 1.f;
+    if (!mInv) return;
+
+    // Compute inverse as $\VEC{S}^{-1} \VEC{R}^T$ and inverted translation
+    float c[3][3];
+    c[0][0] = s[1][1] * s[2][2] - s[1][2] * s[2][1];
+    c[0][1] = s[0][2] * s[2][1] - s[0][1] * s[2][2];
+    c[0][2] = s[0][1] * s[1][2] - s[0][2] * s[1][1];
+    c[1][0] = s[1][2] * s[2][0] - s[1][0] * s[2][2];
+    c[1][1] = s[0][0] * s[2][2] - s[0][2] * s[2][0];
+    c[1][2] = s[0][2] * s[1][0] - s[0][0] * s[1][2];
+    c[2][0] = s[1][0] * s[2][1] - s[1][1] * s[2][0];
+    c[2][1] = s[0][1] * s[2][0] - s[0][0] * s[2][1];
+    c[2][2] = s[0][0] * s[1][1] - s[0][1] * s[1][0];
+    float det = s[0][0] * c[0][0] + s[0][1] * c[1][0] + s[0][2] * c[2][0];
+    if (det == 0.f) {
+        *mInv = Inverse(*m);
+        return;
+    }
+    float invDet = 1.f / det;
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j)
+            mInv->m[i][j] = invDet * (c[i][0] * r[j][0] + c[i][1] * r[j][1] +
+                                      c[i][2] * r[j][2]);
+        mInv->m[3][i] = 0.f;
+    }
+    for (int i = 0; i < 3; ++i)
+        mInv->m[i][3] = -(mInv->m[i][0] * trans.x + mInv->m[i][1] * trans.y +
+                          mInv->m[i][2] * trans.z);
+    mInv->m[3][3] = 1.f;
+}
+
+
 void AnimatedTransform::Interpolate(float time, Transform *t) const {
     // Handle boundary conditions for matrix interpolation
     if (!actuallyAnimated || time <= startTime) {
@@ -372,34 +465,197 @@ void AnimatedTransform::Interpolate(float time, Transform *t) const {
         return;
     }
     float dt = (time - startTime) / (endTime - startTime);
-    // Interpolate translation at _dt_
-    Vector trans = (1.f - dt) * T[0] + dt * T[1];
+    Matrix4x4 m, mInv;
+    Interpolate(dt, &m, &mInv);
+    *t = Transform(m, mInv);
+}
 
-    // Interpolate rotation at _dt_
-    Quaternion rotate = Slerp(dt, R[0], R[1]);
 
-    // Interpolate scale at _dt_
-    Matrix4x4 scale;
+// Apply the affine matrices built by _Interpolate()_, no homogeneous divide
+static inline Point AffinePoint(const Matrix4x4 &m, const Point &p) {
+    return Point(m.m[0][0]*p.x + m.m[0][1]*p.y + m.m[0][2]*p.z + m.m[0][3],
+                 m.m[1][0]*p.x + m.m[1][1]*p.y + m.m[1][2]*p.z + m.m[1][3],
+                 m.m[2][0]*p.x + m.m[2][1]*p.y + m.m[2][2]*p.z + m.m[2][3]);
+}
+
+
+static inline Vector AffineVector(const Matrix4x4 &m, const Vector &v) {
+    return Vector(m.m[0][0]*v.x + m.m[0][1]*v.y + m.m[0][2]*v.z,
+                  m.m[1][0]*v.x + m.m[1][1]*v.y + m.m[1][2]*v.z,
+                  m.m[2][0]*v.x + m.m[2][1]*v.y + m.m[2][2]*v.z);
+}
+
+
+static inline void AffineRay(const Matrix4x4 &m, const RayDifferential &r,
+                             RayDifferential *tr) {
+    tr->o = AffinePoint(m, r.o);
+    tr->d = AffineVector(m, r.d);
+    tr->mint = r.mint;
+    tr->maxt = r.maxt;
+    tr->depth = r.depth;
+    tr->hasDifferentials = r.hasDifferentials;
+    tr->rxOrigin = AffinePoint(m, r.rxOrigin);
+    tr->ryOrigin = AffinePoint(m, r.ryOrigin);
+    tr->rxDirection = AffineVector(m, r.rxDirection);
+    tr->ryDirection = AffineVector(m, r.ryDirection);
+}
+
+
+// Bounds of the points $\VEC{R}(\alpha) \VEC{q}$ for $\VEC{q}$ on the segment
+// from _q0_ to _q1_ and rotation by $\alpha \in [\alpha_0, \alpha_1]$ about
+// the unit _axis_; a zero _axis_ stands for an unknown rotation
+static BBox BoundRotatedSegment(const Vector &q0, const Vector &q1,
+        const Vector &axis, float alphaMin, float alphaMax) {
+    if (axis.LengthSquared() == 0.f) {
+        float r = max(q0.Length(), q1.Length());
+        return BBox(Point(-r, -r, -r), Point(r, r, r));
+    }
+    // Component along _axis_ is unaffected by the rotation
+    Point origin(0.f, 0.f, 0.f);
+    BBox axial(origin + Dot(q0, axis) * axis, origin + Dot(q1, axis) * axis);
+
+    // Find polar coordinates of segment in the plane orthogonal to _axis_
+    Vector e1, e2;
+    CoordinateSystem(axis, &e1, &e2);
+    float x0 = Dot(q0, e1), y0 = Dot(q0, e2);
+    float x1 = Dot(q1, e1), y1 = Dot(q1, e2);
+    float rMax = max(sqrtf(x0*x0 + y0*y0), sqrtf(x1*x1 + y1*y1));
+    if (rMax == 0.f) return axial;
+    bool fullCircle;
+    float betaMin = 0.f, betaMax = 0.f;
+    float dx = x1 - x0, dy = y1 - y0, len2 = dx*dx + dy*dy;
+    float tc = len2 > 0.f ? Clamp(-(x0*dx + y0*dy) / len2, 0.f, 1.f) : 0.f;
+    float cx = x0 + tc * dx, cy = y0 + tc * dy;
+    if (cx*cx + cy*cy < 1e-6f * rMax * rMax)
+        // Segment passes through the axis and covers all angles
+        fullCircle = true;
+    else {
+        betaMin = atan2f(y0, x0);
+        float dBeta = atan2f(y1, x1) - betaMin;
+        if (dBeta > M_PI) dBeta -= 2.f * M_PI;
+        else if (dBeta < -M_PI) dBeta += 2.f * M_PI;
+        betaMax = betaMin + dBeta;
+        if (betaMax < betaMin) swap(betaMin, betaMax);
+        betaMin += alphaMin;
+        betaMax += alphaMax;
+        fullCircle = betaMax - betaMin >= 2.f * M_PI;
+    }
+
+    // Bound the annular sector one world axis at a time
+    BBox perp(origin);
+    for (int k = 0; k < 3; ++k) {
+        float a = e1[k], b = e2[k];
+        float extent = rMax * sqrtf(a*a + b*b);
+        if (fullCircle) {
+            perp.pMin[k] = -extent;
+            perp.pMax[k] = extent;
+            continue;
+        }
+        float v0 = rMax * (a * cosf(betaMin) + b * sinf(betaMin));
+        float v1 = rMax * (a * cosf(betaMax) + b * sinf(betaMax));
+        perp.pMin[k] = min(perp.pMin[k], min(v0, v1));
+        perp.pMax[k] = max(perp.pMax[k], max(v0, v1));
+        // Include the extrema of $r_{\max} (a \cos \beta + b \sin \beta)$
+        float gamma = atan2f(b, a);
+        for (int e = 0; e < 2; ++e) {
+            float g = gamma + e * float(M_PI);
+            g += 2.f * float(M_PI) * ceilf((betaMin - g) / (2.f * M_PI));
+            if (g <= betaMax) {
+                perp.pMin[k] = min(perp.pMin[k], e ? -extent : extent);
+                perp.pMax[k] = max(perp.pMax[k], e ? -extent : extent);
+            }
+        }
+    }
+    return BBox(axial.pMin + Vector(perp.pMin), axial.pMax + Vector(perp.pMax));
+}
+
+
+BBox AnimatedTransform::BoundPointMotion(const Point &p,
+                                         bool useInverse) const {
+    BBox ret = useInverse ?
+        Union(BBox(Inverse(*startTransform)(p)), Inverse(*endTransform)(p)) :
+        Union(BBox((*startTransform)(p)), (*endTransform)(p));
+
+    // Find fixed axis and angle $\phi$ of the rotation from _R[0]_ to _R[1]_
+    float r0[3][3], r1[3][3];
+    RotationMatrix(R[0], r0);
+    RotationMatrix(R[1], r1);
+    float rel[3][3];
     for (int i = 0; i < 3; ++i)
         for (int j = 0; j < 3; ++j)
-            scale.m[i][j] = Lerp(dt, S[0].m[i][j], S[1].m[i][j]);
+            rel[i][j] = r1[i][0] * r0[j][0] + r1[i][1] * r0[j][1] +
+                        r1[i][2] * r0[j][2];
+    Vector axis(rel[2][1] - rel[1][2], rel[0][2] - rel[2][0],
+                rel[1][0] - rel[0][1]);
+    float phi = 2.f * acosf(Clamp(Dot(R[0], R[1]), -1.f, 1.f));
+    if (axis.LengthSquared() > 1e-8f)
+        axis = Normalize(phi > M_PI ? -axis : axis);
+    else
+        axis = Vector(0.f, 0.f, 0.f);
+    // Pad the angle for the limited precision of _acosf()_
+    const float phiPad = 1e-3f;
+
+    if (!useInverse) {
+        // Bound $\VEC{T}(t) + \VEC{R}(t) \VEC{S}(t) p$ with $\VEC{R}(t)$
+        // rotating $\VEC{R}_0$ by $t \phi$ about _axis_
+        Vector w[2];
+        for (int s = 0; s < 2; ++s) {
+            Vector sp = AffineVector(S[s], Vector(p));
+            w[s] = Vector(r0[0][0]*sp.x + r0[0][1]*sp.y + r0[0][2]*sp.z,
+                          r0[1][0]*sp.x + r0[1][1]*sp.y + r0[1][2]*sp.z,
+                          r0[2][0]*sp.x + r0[2][1]*sp.y + r0[2][2]*sp.z);
+        }
+        BBox b = BoundRotatedSegment(w[0], w[1], axis, -phiPad, phi + phiPad);
+        Point origin(0.f, 0.f, 0.f);
+        BBox trans(origin + T[0], origin + T[1]);
+        return Union(ret, BBox(b.pMin + Vector(trans.pMin),
+                               b.pMax + Vector(trans.pMax)));
+    }
 
-    // Compute interpolated matrix as product of interpolated components
-    *t = Translate(trans) * rotate.ToTransform() * Transform(scale);
+    bool constantScale = true;
+    for (int i = 0; i < 3; ++i)
+        for (int j = 0; j < 3; ++j)
+            constantScale &= (S[0].m[i][j] == S[1].m[i][j]);
+    if (!constantScale) {
+        // Sample the inverse motion of _p_ when the scale is animated
+        const int nSteps = 128;
+        for (int i = 1; i < nSteps - 1; ++i) {
+            Transform t;
+            float time = Lerp(float(i)/float(nSteps-1), startTime, endTime);
+            Interpolate(time, &t);
+            ret = Union(ret, Inverse(t)(p));
+        }
+        return ret;
+    }
+
+    // Bound $\VEC{S}^{-1} \VEC{R}_0^T \VEC{R}(t)^{-1} (p - \VEC{T}(t))$
+    BBox b = BoundRotatedSegment(Vector(p) - T[0], Vector(p) - T[1], axis,
+                                 -phi - phiPad, phiPad);
+    Matrix4x4 r0t(r0[0][0], r0[1][0], r0[2][0], 0.f,
+                  r0[0][1], r0[1][1], r0[2][1], 0.f,
+                  r0[0][2], r0[1][2], r0[2][2], 0.f,
+                  0.f,      0.f,      0.f,      1.f);
+    Matrix4x4 l = Matrix4x4::Mul(Inverse(S[0]), r0t);
+    for (int i = 0; i < 8; ++i) {
+        Point c((i & 1) ? b.pMax.x : b.pMin.x, (i & 2) ? b.pMax.y : b.pMin.y,
+                (i & 4) ? b.pMax.z : b.pMin.z);
+        ret = Union(ret, AffinePoint(l, c));
+    }
+    return ret;
 }
 
 
 BBox AnimatedTransform::MotionBounds(const BBox &b,
                                      bool useInverse) const {
-    if (!actuallyAnimated) return Inverse(*startTransform)(b);
+    if (!actuallyAnimated)
+        return useInverse ? Inverse(*startTransform)(b) : (*startTransform)(b);
+    // Union the bounds of each corner's motion; the interpolated transforms
+    // are affine, so these also bound the moving box
     BBox ret;
-    const int nSteps = 128;
-    for (int i = 0; i < nSteps; ++i) {
-        Transform t;
-        float time = Lerp(float(i)/float(nSteps-1), startTime, endTime);
-        Interpolate(time, &t);
-        if (useInverse) t = Inverse(t);
-        ret = Union(ret, t(b));
+    for (int i = 0; i < 8; ++i) {
+        Point c((i & 1) ? b.pMax.x : b.pMin.x, (i & 2) ? b.pMax.y : b.pMin.y,
+                (i & 4) ? b.pMax.z : b.pMin.z);
+        ret = Union(ret, BoundPointMotion(c, useInverse));
     }
     return ret;
 }
@@ -411,9 +667,14 @@ void AnimatedTransform::operator()(const Ray &r, Ray *tr) const {
     else if (r.time >= endTime)
         (*endTransform)(r, tr);
     else {
-        Transform t;
-        Interpolate(r.time, &t);
-        t(r, tr);
+        // Transform ray by the interpolated matrix, skipping its inverse
+        Matrix4x4 m;
+        Interpolate((r.time - startTime) / (endTime - startTime), &m, NULL);
+        tr->o = AffinePoint(m, r.o);
+        tr->d = AffineVector(m, r.d);
+        tr->mint = r.mint;
+        tr->maxt = r.maxt;
+        tr->depth = r.depth;
     }
     tr->time = r.time;
 }
@@ -426,22 +687,48 @@ void AnimatedTransform::operator()(const RayDifferential &r,
     else if (r.time >= endTime)
         (*endTransform)(r, tr);
     else {
-        Transform t;
-        Interpolate(r.time, &t);
-        t(r, tr);
+        Matrix4x4 m;
+        Interpolate((r.time - startTime) / (endTime - startTime), &m, NULL);
+        AffineRay(m, r, tr);
     }
     tr->time = r.time;
 }
 
 
+void AnimatedTransform::operator()(const RayDifferential *r, int n,
+    RayDifferential *tr) const {
+    // Interpolate once for each run of rays that share a time
+    Matrix4x4 m;
+    bool haveM = false;
+    float mTime = 0.f;
+    for (int i = 0; i < n; ++i) {
+        float time = r[i].time;
+        if (!actuallyAnimated || time <= startTime)
+            (*startTransform)(r[i], &tr[i]);
+        else if (time >= endTime)
+            (*endTransform)(r[i], &tr[i]);
+        else {
+            if (!haveM || time != mTime) {
+                Interpolate((time - startTime) / (endTime - startTime),
+                            &m, NULL);
+                haveM = true;
+                mTime = time;
+            }
+            AffineRay(m, r[i], &tr[i]);
+        }
+        tr[i].time = time;
+    }
+}
+
+
 Point AnimatedTransform::operator()(float time, const Point &p) const {
     if (!actuallyAnimated || time <= startTime)
         return (*startTransform)(p);
     else if (time >= endTime)
         return (*endTransform)(p);
-    Transform t;
-    Interpolate(time, &t);
-    return t(p);
+    Matrix4x4 m;
+    Interpolate((time - startTime) / (endTime - startTime), &m, NULL);
+    return AffinePoint(m, p);
 }
 
 
@@ -450,9 +737,9 @@ Vector AnimatedTransform::operator()(float time, const Vector &v) const {
         return (*startTransform)(v);
     else if (time >= endTime)
         return (*endTransform)(v);
-    Transform t;
-    Interpolate(time, &t);
-    return t(v);
+    Matrix4x4 m;
+    Interpolate((time - startTime) / (endTime - startTime), &m, NULL);
+    return AffineVector(m, v);
 }
 
 
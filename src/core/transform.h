@@ -306,17 +306,25 @@ public:
           actuallyAnimated(*startTransform != *endTransform) {
         Decompose(startTransform->m, &T[0], &R[0], &S[0]);
         Decompose(endTransform->m, &T[1], &R[1], &S[1]);
+        PrecomputeSlerp();
     }
     static void Decompose(const Matrix4x4 &m, Vector *T, Quaternion *R, Matrix4x4 *S);
     void Interpolate(float time, Transform *t) const;
     void operator()(const Ray &r, Ray *tr) const;
     void operator()(const RayDifferential &r, RayDifferential *tr) const;
+    void operator()(const RayDifferential *r, int n,
+                    RayDifferential *tr) const;
     Point operator()(float time, const Point &p) const;
     Vector operator()(float time, const Vector &v) const;
     Ray operator()(const Ray &r) const;
     BBox MotionBounds(const BBox &b, bool useInverse) const;
     bool HasScale() const { return startTransform->HasScale() || endTransform->HasScale(); }
 private:
+    // AnimatedTransform Private Methods
+    void PrecomputeSlerp();
+    void Interpolate(float dt, Matrix4x4 *m, Matrix4x4 *mInv) const;
+    BBox BoundPointMotion(const Point &p, bool useInverse) const;
+
     // AnimatedTransform Private Data
     const float startTime, endTime;
     const Transform *startTransform, *endTransform;
@@ -324,6 +332,10 @@ private:
     Vector T[2];
     Quaternion R[2];
     Matrix4x4 S[2];
+    // Rotation interpolation data shared by all _Interpolate()_ calls
+    bool slerpLinear;
+    float slerpTheta;
+    Quaternion slerpPerp;
 };
 
 
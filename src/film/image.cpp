@@ -36,6 +36,9 @@
 #include "spectrum.h"
 #include "parallel.h"
 #include "imageio.h"
+#if defined(__SSE__)
+#include <xmmintrin.h>
+#endif
 
 // ImageFilm Method Definitions
 ImageFilm::ImageFilm(int xres, int yres, Filter *filt, const float crop[4],
@@ -67,6 +70,20 @@ ImageFilm::ImageFilm(int xres, int yres, Filter *filt, const float crop[4],
         }
     }
 
+    // Precompute 1D weight tables for separable filters
+#define MAX_FILTER_FOOTPRINT 16
+    separable = filter->IsSeparable() &&
+        Floor2Int(2.f * filter->xWidth) + 1 <= MAX_FILTER_FOOTPRINT &&
+        Floor2Int(2.f * filter->yWidth) + 1 <= MAX_FILTER_FOOTPRINT;
+    filterTableX = new float[FILTER_TABLE_SIZE];
+    filterTableY = new float[FILTER_TABLE_SIZE];
+    for (int i = 0; i < FILTER_TABLE_SIZE; ++i) {
+        filterTableX[i] = separable ? filter->EvaluateX(((float)i + .5f) *
+            filter->xWidth / FILTER_TABLE_SIZE) : 0.f;
+        filterTableY[i] = separable ? filter->EvaluateY(((float)i + .5f) *
+            filter->yWidth / FILTER_TABLE_SIZE) : 0.f;
+    }
+
     // Possibly open window for image display
     if (openWindow || PbrtOptions.openWindow) {
         Warning("Support for opening image display window not available in this build.");
@@ -74,70 +91,279 @@ ImageFilm::ImageFilm(int xres, int yres, Filter *filt, const float crop[4],
 }
 
 
-void ImageFilm::AddSample(const CameraSample &sample,
-                          const Spectrum &L,
-                          const Intersection &/*isect*/) {
+bool ImageFilm::ComputeRasterExtent(const CameraSample &sample,
+        float *dimageX, float *dimageY, int *x0, int *x1,
+        int *y0, int *y1) const {
     // Compute sample's raster extent
-    float dimageX = sample.imageX - 0.5f;
-    float dimageY = sample.imageY - 0.5f;
-    int x0 = Ceil2Int (dimageX - filter->xWidth);
-    int x1 = Floor2Int(dimageX + filter->xWidth);
-    int y0 = Ceil2Int (dimageY - filter->yWidth);
-    int y1 = Floor2Int(dimageY + filter->yWidth);
-    x0 = max(x0, xPixelStart);
-    x1 = min(x1, xPixelStart + xPixelCount - 1);
-    y0 = max(y0, yPixelStart);
-    y1 = min(y1, yPixelStart + yPixelCount - 1);
-    if ((x1-x0) < 0 || (y1-y0) < 0)
-    {
-        PBRT_SAMPLE_OUTSIDE_IMAGE_EXTENT(const_cast<CameraSample *>(&sample));
-        return;
-    }
+    *dimageX = sample.imageX - 0.5f;
+    *dimageY = sample.imageY - 0.5f;
+    *x0 = max(Ceil2Int (*dimageX - filter->xWidth), xPixelStart);
+    *x1 = min(Floor2Int(*dimageX + filter->xWidth),
+              xPixelStart + xPixelCount - 1);
+    *y0 = max(Ceil2Int (*dimageY - filter->yWidth), yPixelStart);
+    *y1 = min(Floor2Int(*dimageY + filter->yWidth),
+              yPixelStart + yPixelCount - 1);
+    return (*x1 - *x0) >= 0 && (*y1 - *y0) >= 0;
+}
 
-    // Loop over filter support and add sample to pixel arrays
-    float xyz[3];
-    L.ToXYZ(xyz);
 
+void ImageFilm::ComputeFilterOffsets(float dimageX, float dimageY,
+        int x0, int x1, int y0, int y1, int *ifx, int *ify) const {
     // Precompute $x$ and $y$ filter table offsets
-    int *ifx = ALLOCA(int, x1 - x0 + 1);
     for (int x = x0; x <= x1; ++x) {
         float fx = fabsf((x - dimageX) *
                          filter->invXWidth * FILTER_TABLE_SIZE);
         ifx[x-x0] = min(Floor2Int(fx), FILTER_TABLE_SIZE-1);
     }
-    int *ify = ALLOCA(int, y1 - y0 + 1);
     for (int y = y0; y <= y1; ++y) {
         float fy = fabsf((y - dimageY) *
                          filter->invYWidth * FILTER_TABLE_SIZE);
         ify[y-y0] = min(Floor2Int(fy), FILTER_TABLE_SIZE-1);
     }
-    bool syncNeeded = (filter->xWidth > 0.5f || filter->yWidth > 0.5f);
+}
+
+
+void ImageFilm::ComputeFilterWeights(float dimageX, float dimageY,
+        int x0, int x1, int y0, int y1, float *wx, float *wy) const {
+    // Look up 1D filter weights for the footprint of a separable filter
+    for (int x = x0; x <= x1; ++x) {
+        float fx = fabsf((x - dimageX) *
+                         filter->invXWidth * FILTER_TABLE_SIZE);
+        wx[x-x0] = filterTableX[min(Floor2Int(fx), FILTER_TABLE_SIZE-1)];
+    }
     for (int y = y0; y <= y1; ++y) {
-        for (int x = x0; x <= x1; ++x) {
-            // Evaluate filter value at $(x,y)$ pixel
-            int offset = ify[y-y0]*FILTER_TABLE_SIZE + ifx[x-x0];
-            float filterWt = filterTable[offset];            
-
-            // Update pixel values with filtered sample contribution
-            Pixel &pixel = (*pixels)(x - xPixelStart, y - yPixelStart);            
-            if (!syncNeeded) {
+        float fy = fabsf((y - dimageY) *
+                         filter->invYWidth * FILTER_TABLE_SIZE);
+        wy[y-y0] = filterTableY[min(Floor2Int(fy), FILTER_TABLE_SIZE-1)];
+    }
+}
+
+
+void ImageFilm::AddToPixel(int x, int y, float filterWt, const float xyz[3],
+                           bool syncNeeded) {
+    // Update pixel values with filtered sample contribution
+    Pixel &pixel = (*pixels)(x - xPixelStart, y - yPixelStart);
+    if (!syncNeeded) {
+        pixel.Lxyz[0] += filterWt * xyz[0];
+        pixel.Lxyz[1] += filterWt * xyz[1];
+        pixel.Lxyz[2] += filterWt * xyz[2];
+        pixel.weightSum += filterWt;
+    }
+    else {
+        // Safely update _Lxyz_ and _weightSum_ even with concurrency
+        AtomicAdd(&pixel.Lxyz[0], filterWt * xyz[0]);
+        AtomicAdd(&pixel.Lxyz[1], filterWt * xyz[1]);
+        AtomicAdd(&pixel.Lxyz[2], filterWt * xyz[2]);
+        AtomicAdd(&pixel.weightSum, filterWt);
+    }
+}
+
+
+void ImageFilm::AddSample(const CameraSample &sample,
+                          const Spectrum &L,
+                          const Intersection &/*isect*/) {
+    float dimageX, dimageY;
+    int x0, x1, y0, y1;
+    if (!ComputeRasterExtent(sample, &dimageX, &dimageY, &x0, &x1, &y0, &y1))
+    {
+        PBRT_SAMPLE_OUTSIDE_IMAGE_EXTENT(const_cast<CameraSample *>(&sample));
+        return;
+    }
+
+    // Loop over filter support and add sample to pixel arrays
+    float xyz[3];
+    L.ToXYZ(xyz);
+    bool syncNeeded = (filter->xWidth > 0.5f || filter->yWidth > 0.5f);
+    if (separable) {
+        float wx[MAX_FILTER_FOOTPRINT], wy[MAX_FILTER_FOOTPRINT];
+        ComputeFilterWeights(dimageX, dimageY, x0, x1, y0, y1, wx, wy);
+        for (int y = y0; y <= y1; ++y)
+            for (int x = x0; x <= x1; ++x)
+                AddToPixel(x, y, wy[y-y0] * wx[x-x0], xyz, syncNeeded);
+    }
+    else {
+        int *ifx = ALLOCA(int, x1 - x0 + 1);
+        int *ify = ALLOCA(int, y1 - y0 + 1);
+        ComputeFilterOffsets(dimageX, dimageY, x0, x1, y0, y1, ifx, ify);
+        for (int y = y0; y <= y1; ++y) {
+            for (int x = x0; x <= x1; ++x) {
+                // Evaluate filter value at $(x,y)$ pixel
+                int offset = ify[y-y0]*FILTER_TABLE_SIZE + ifx[x-x0];
+                AddToPixel(x, y, filterTable[offset], xyz, syncNeeded);
+            }
+        }
+    }
+}
+
+
+FilmTile *ImageFilm::GetFilmTile(int xstart, int xend,
+                                 int ystart, int yend) {
+    // Compute pixel bounds touched by samples in $[xstart,xend)\times[ystart,yend)$
+    int x0 = max(Ceil2Int (xstart - 0.5f - filter->xWidth), xPixelStart);
+    int x1 = min(Floor2Int(xend   - 0.5f + filter->xWidth),
+                 xPixelStart + xPixelCount - 1);
+    int y0 = max(Ceil2Int (ystart - 0.5f - filter->yWidth), yPixelStart);
+    int y1 = min(Floor2Int(yend   - 0.5f + filter->yWidth),
+                 yPixelStart + yPixelCount - 1);
+    if ((x1-x0) < 0 || (y1-y0) < 0) return NULL;
+    return new ImageFilmTile(this, x0, x1, y0, y1);
+}
+
+
+void ImageFilm::MergeFilmTile(FilmTile *t) {
+    // Add _tile_'s contents to the film and clear it so it can be reused
+    ImageFilmTile *tile = (ImageFilmTile *)t;
+    int nTilePixels = tile->xTileCount * tile->yTileCount;
+    if (tile->pixels) {
+        // Tiles of neighboring tasks overlap only in the filter halo
+        bool syncNeeded = (filter->xWidth > 0.5f || filter->yWidth > 0.5f);
+        const ImageFilmTile::TilePixel *tp = tile->pixels;
+        for (int y = 0; y < tile->yTileCount; ++y) {
+            for (int x = 0; x < tile->xTileCount; ++x, ++tp) {
+                if (tp->weightSum == 0.f && tp->Lxyz[0] == 0.f &&
+                    tp->Lxyz[1] == 0.f && tp->Lxyz[2] == 0.f)
+                    continue;
+                Pixel &pixel = (*pixels)(tile->xTileStart + x - xPixelStart,
+                                         tile->yTileStart + y - yPixelStart);
+                if (!syncNeeded) {
+                    pixel.Lxyz[0] += tp->Lxyz[0];
+                    pixel.Lxyz[1] += tp->Lxyz[1];
+                    pixel.Lxyz[2] += tp->Lxyz[2];
+                    pixel.weightSum += tp->weightSum;
+                }
+                else {
+                    AtomicAdd(&pixel.Lxyz[0], tp->Lxyz[0]);
+                    AtomicAdd(&pixel.Lxyz[1], tp->Lxyz[1]);
+                    AtomicAdd(&pixel.Lxyz[2], tp->Lxyz[2]);
+                    AtomicAdd(&pixel.weightSum, tp->weightSum);
+                }
+            }
+        }
+        memset(tile->pixels, 0, nTilePixels * sizeof(ImageFilmTile::TilePixel));
+    }
+    if (tile->splatXYZ) {
+        // Splat tiles may cover the whole image, so always merge atomically
+        const float *sp = tile->splatXYZ;
+        for (int y = 0; y < tile->yTileCount; ++y) {
+            for (int x = 0; x < tile->xTileCount; ++x, sp += 3) {
+                if (sp[0] == 0.f && sp[1] == 0.f && sp[2] == 0.f)
+                    continue;
+                Pixel &pixel = (*pixels)(tile->xTileStart + x - xPixelStart,
+                                         tile->yTileStart + y - yPixelStart);
+                AtomicAdd(&pixel.splatXYZ[0], sp[0]);
+                AtomicAdd(&pixel.splatXYZ[1], sp[1]);
+                AtomicAdd(&pixel.splatXYZ[2], sp[2]);
+            }
+        }
+        memset(tile->splatXYZ, 0, 3 * nTilePixels * sizeof(float));
+    }
+}
+
+
+// ImageFilmTile Method Definitions
+ImageFilmTile::ImageFilmTile(ImageFilm *f, int x0, int x1, int y0, int y1) {
+    film = f;
+    xTileStart = x0;
+    yTileStart = y0;
+    xTileCount = x1 - x0 + 1;
+    yTileCount = y1 - y0 + 1;
+    pixels = NULL;
+    splatXYZ = NULL;
+}
+
+
+void ImageFilmTile::AddSample(const CameraSample &sample,
+                              const Spectrum &L,
+                              const Intersection &isect) {
+    float dimageX, dimageY;
+    int x0, x1, y0, y1;
+    if (!film->ComputeRasterExtent(sample, &dimageX, &dimageY,
+                                   &x0, &x1, &y0, &y1)) {
+        PBRT_SAMPLE_OUTSIDE_IMAGE_EXTENT(const_cast<CameraSample *>(&sample));
+        return;
+    }
+    if (x0 < xTileStart || x1 >= xTileStart + xTileCount ||
+        y0 < yTileStart || y1 >= yTileStart + yTileCount) {
+        // Hand samples whose footprint leaves the tile to the shared film
+        film->AddSample(sample, L, isect);
+        return;
+    }
+    if (!pixels) {
+        pixels = AllocAligned<TilePixel>(xTileCount * yTileCount);
+        memset(pixels, 0, xTileCount * yTileCount * sizeof(TilePixel));
+    }
+
+    // Loop over filter support and add sample to tile pixels
+    float xyz[3];
+    L.ToXYZ(xyz);
+    if (film->separable) {
+        // Accumulate the outer product of the 1D filter weights
+        float wx[MAX_FILTER_FOOTPRINT], wy[MAX_FILTER_FOOTPRINT];
+        film->ComputeFilterWeights(dimageX, dimageY, x0, x1, y0, y1, wx, wy);
+        int nx = x1 - x0 + 1;
+#if defined(__SSE__)
+        __m128 Lw = _mm_set_ps(1.f, xyz[2], xyz[1], xyz[0]);
+#endif
+        for (int y = y0; y <= y1; ++y) {
+            TilePixel *row = &pixels[(y - yTileStart) * xTileCount +
+                                     (x0 - xTileStart)];
+            float wyv = wy[y-y0];
+            for (int i = 0; i < nx; ++i) {
+                float filterWt = wyv * wx[i];
+#if defined(__SSE__)
+                float *p = row[i].Lxyz;
+                _mm_store_ps(p, _mm_add_ps(_mm_load_ps(p),
+                    _mm_mul_ps(_mm_set1_ps(filterWt), Lw)));
+#else
+                row[i].Lxyz[0] += filterWt * xyz[0];
+                row[i].Lxyz[1] += filterWt * xyz[1];
+                row[i].Lxyz[2] += filterWt * xyz[2];
+                row[i].weightSum += filterWt;
+#endif
+            }
+        }
+    }
+    else {
+        int *ifx = ALLOCA(int, x1 - x0 + 1);
+        int *ify = ALLOCA(int, y1 - y0 + 1);
+        film->ComputeFilterOffsets(dimageX, dimageY, x0, x1, y0, y1, ifx, ify);
+        for (int y = y0; y <= y1; ++y) {
+            TilePixel *row = &pixels[(y - yTileStart) * xTileCount];
+            const float *filterRow = &film->filterTable[ify[y-y0]*FILTER_TABLE_SIZE];
+            for (int x = x0; x <= x1; ++x) {
+                float filterWt = filterRow[ifx[x-x0]];
+                TilePixel &pixel = row[x - xTileStart];
                 pixel.Lxyz[0] += filterWt * xyz[0];
                 pixel.Lxyz[1] += filterWt * xyz[1];
                 pixel.Lxyz[2] += filterWt * xyz[2];
                 pixel.weightSum += filterWt;
             }
-            else {
-                // Safely update _Lxyz_ and _weightSum_ even with concurrency
-                AtomicAdd(&pixel.Lxyz[0], filterWt * xyz[0]);
-                AtomicAdd(&pixel.Lxyz[1], filterWt * xyz[1]);
-                AtomicAdd(&pixel.Lxyz[2], filterWt * xyz[2]);
-                AtomicAdd(&pixel.weightSum, filterWt);
-            }
         }
     }
 }
 
 
+void ImageFilmTile::Splat(const CameraSample &sample, const Spectrum &L) {
+    int x = Floor2Int(sample.imageX), y = Floor2Int(sample.imageY);
+    if (L.HasNaNs() || x < xTileStart || x - xTileStart >= xTileCount ||
+        y < yTileStart || y - yTileStart >= yTileCount) {
+        // Let the film report or discard splats it would reject
+        film->Splat(sample, L);
+        return;
+    }
+    if (!splatXYZ) {
+        splatXYZ = AllocAligned<float>(3 * xTileCount * yTileCount);
+        memset(splatXYZ, 0, 3 * xTileCount * yTileCount * sizeof(float));
+    }
+    float xyz[3];
+    L.ToXYZ(xyz);
+    float *sp = &splatXYZ[3 * ((y - yTileStart) * xTileCount + (x - xTileStart))];
+    sp[0] += xyz[0];
+    sp[1] += xyz[1];
+    sp[2] += xyz[2];
+}
+
+
 void ImageFilm::Splat(const CameraSample &sample, const Spectrum &L) {
     if (L.HasNaNs()) {
         Warning("ImageFilm ignoring splatted spectrum with NaN values");
@@ -205,9 +431,9 @@ void ImageFilm::WriteImage(float splatScale) {
         }
     }
 
-    // Write RGB image
-    ::WriteImage(filename, rgb, NULL, xPixelCount, yPixelCount,
-                 xResolution, yResolution, xPixelStart, yPixelStart);
+    // Write RGB image in the background
+    EnqueueImageWrite(filename, rgb, NULL, xPixelCount, yPixelCount,
+                      xResolution, yResolution, xPixelStart, yPixelStart);
 
     // Release temporary image memory
     delete[] rgb;
@@ -57,6 +57,8 @@ public:
         delete pixels;
         delete filter;
         delete[] filterTable;
+        delete[] filterTableX;
+        delete[] filterTableY;
     }
     void AddSample(const CameraSample &sample, const Spectrum &L, 
             const Intersection &isect);
@@ -66,7 +68,20 @@ public:
     void WriteImage(float splatScale);
     void UpdateDisplay(int x0, int y0, int x1, int y1, float splatScale);
     void SetSPP(int spp);
+    FilmTile *GetFilmTile(int xstart, int xend, int ystart, int yend);
+    void MergeFilmTile(FilmTile *tile);
 private:
+    // ImageFilm Private Methods
+    friend class ImageFilmTile;
+    bool ComputeRasterExtent(const CameraSample &sample, float *dimageX,
+        float *dimageY, int *x0, int *x1, int *y0, int *y1) const;
+    void ComputeFilterOffsets(float dimageX, float dimageY, int x0, int x1,
+        int y0, int y1, int *ifx, int *ify) const;
+    void ComputeFilterWeights(float dimageX, float dimageY, int x0, int x1,
+        int y0, int y1, float *wx, float *wy) const;
+    void AddToPixel(int x, int y, float filterWt, const float xyz[3],
+                    bool syncNeeded);
+
     // ImageFilm Private Data
     Filter *filter;
     float cropWindow[4];
@@ -84,6 +99,36 @@ private:
     };
     BlockedArray<Pixel> *pixels;
     float *filterTable;
+    bool separable;
+    float *filterTableX, *filterTableY;
+};
+
+
+// ImageFilmTile Declarations
+class ImageFilmTile : public FilmTile {
+public:
+    // ImageFilmTile Public Methods
+    ImageFilmTile(ImageFilm *film, int x0, int x1, int y0, int y1);
+    ~ImageFilmTile() {
+        FreeAligned(pixels);
+        FreeAligned(splatXYZ);
+    }
+    void AddSample(const CameraSample &sample, const Spectrum &L,
+                   const Intersection &isect);
+    void Splat(const CameraSample &sample, const Spectrum &L);
+private:
+    // ImageFilmTile Private Data
+    friend class ImageFilm;
+    ImageFilm *film;
+    int xTileStart, yTileStart, xTileCount, yTileCount;
+    struct TilePixel {
+        // _Lxyz_ and _weightSum_ form one aligned 4-float vector
+        float Lxyz[3];
+        float weightSum;
+    };
+    // Tile buffers are allocated on first use
+    TilePixel *pixels;
+    float *splatXYZ;
 };
 
 
@@ -41,7 +41,8 @@
 // SBFImageFilm Method Definitions
 RPFImageFilm::RPFImageFilm(int xres, int yres, Filter *filt, const float crop[4],
                      const string &fn, const bool dp,
-                     const float jouni, const string qual, const string randomParams)
+                     const float jouni, const string qual, const string randomParams,
+                     int captureSamples, float captureMemory)
     : Film(xres, yres) {
 	filter = filt;
     memcpy(cropWindow, crop, 4 * sizeof(float));
@@ -53,7 +54,8 @@ RPFImageFilm::RPFImageFilm(int xres, int yres, Filter *filt, const float crop[4]
     yPixelCount = max(1, Ceil2Int(yResolution * cropWindow[3]) - yPixelStart);
 
     dump = dp;
-    rpf = new RPF(xPixelStart, yPixelStart, xPixelCount, yPixelCount, jouni, qual, randomParams);
+    rpf = new RPF(xPixelStart, yPixelStart, xPixelCount, yPixelCount, jouni, qual, randomParams,
+                  captureSamples, captureMemory);
 }
 
 
@@ -126,7 +128,11 @@ RPFImageFilm *CreateRPFImageFilm(const ParamSet &params, Filter *filt) {
     float jouni = params.FindOneFloat("jouni", 0.02f);
     string qual = params.FindOneString("quality", "medium");
     string randomParams = params.FindOneString("randomparams", "all");
+    // Zero keeps as many samples per pixel as the sampler takes
+    int captureSamples = params.FindOneInt("capturesamples", 0);
+    float captureMemory = params.FindOneFloat("capturememory", 1024.f);
     return new RPFImageFilm(xres, yres, filt, crop, filename,
-                            debug, jouni, qual, randomParams);
+                            debug, jouni, qual, randomParams,
+                            captureSamples, captureMemory);
 }
 
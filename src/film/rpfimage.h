@@ -48,7 +48,11 @@ class RPFImageFilm : public Film {
 public:
     RPFImageFilm(int xres, int yres, Filter *filt, const float crop[4],
               const string &filename, const bool dp,
-              const float jouni, const string qual, const string randomParams);
+              const float jouni, const string qual, const string randomParams,
+              int captureSamples, float captureMemory);
+    ~RPFImageFilm() {
+        delete rpf;
+    }
     void AddSample(const CameraSample &sample, const Spectrum &L,
             const Intersection &isect);
     void Splat(const CameraSample &sample, const Spectrum &L);
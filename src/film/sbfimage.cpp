@@ -39,10 +39,10 @@
 
 // SBFImageFilm Method Definitions
 SBFImageFilm::SBFImageFilm(int xres, int yres, Filter *filt, const float crop[4],
-                     const string &fn, bool dp, SBF::FilterType type, 
+                     const string &fn, bool dp, bool ml, SBF::FilterType type, 
                      const vector<float> &interParams, const vector<float> &finalParams,
                      float sigmaN, float sigmaR, float sigmaD,
-                     float interMseSigma, float finalMseSigma)
+                     float interMseSigma, float finalMseSigma, RPF *r)
     : Film(xres, yres) {
     filter = filt;
     memcpy(cropWindow, crop, 4 * sizeof(float));
@@ -54,6 +54,8 @@ SBFImageFilm::SBFImageFilm(int xres, int yres, Filter *filt, const float crop[4]
     yPixelCount = max(1, Ceil2Int(yResolution * cropWindow[3]) - yPixelStart);   
 
     dump = dp;
+    multiLayer = ml;
+    rpf = r;
     sbf = new SBF(xPixelStart, yPixelStart, xPixelCount, yPixelCount, 
                   filter, type, interParams, finalParams, 
                   sigmaN, sigmaR, sigmaD, interMseSigma, finalMseSigma);
@@ -64,6 +66,7 @@ void SBFImageFilm::AddSample(const CameraSample &sample,
                           const Spectrum &L,
                           const Intersection &isect) {
     sbf->AddSample(sample, L, isect);
+    if (rpf) rpf->AddSample(sample, L, isect);
 }
 
 
@@ -95,11 +98,13 @@ void SBFImageFilm::GetPixelExtent(int *xstart, int *xend,
 
 
 void SBFImageFilm::WriteImage(float splatScale) {
-    sbf->WriteImage(filename, xResolution, yResolution, dump);
+    sbf->WriteImage(filename, xResolution, yResolution, dump, multiLayer);
+    if (rpf) rpf->WriteImage(filename, xPixelCount, yPixelCount, dump);
 }
 
-void SBFImageFilm::GetAdaptPixels(float avgSpp, vector<vector<int> > &pixOff, vector<vector<int> > &pixSam) {
-    sbf->GetAdaptPixels(avgSpp, pixOff, pixSam);
+void SBFImageFilm::GetAdaptPixels(float avgSpp, vector<vector<int> > &pixOff, vector<vector<int> > &pixSam,
+                                  bool minOneSample) {
+    sbf->GetAdaptPixels(avgSpp, pixOff, pixSam, minOneSample);
 }
 
 SBFImageFilm *CreateSBFImageFilm(const ParamSet &params, Filter *filter) {
@@ -125,6 +130,7 @@ SBFImageFilm *CreateSBFImageFilm(const ParamSet &params, Filter *filter) {
         crop[3] = Clamp(max(cr[2], cr[3]), 0., 1.);
     }
     bool debug = params.FindOneBool("dumpfeaturebuffer", false);
+    bool multiLayer = params.FindOneBool("multilayer", false);
     string filterType = params.FindOneString("filter", "cbf");
     SBF::FilterType type;
     if(filterType == "cbf") {
@@ -161,9 +167,22 @@ SBFImageFilm *CreateSBFImageFilm(const ParamSet &params, Filter *filter) {
     float interMseSigma = params.FindOneFloat("intermsesigma", 4.f);
     float finalMseSigma = params.FindOneFloat("finalmsesigma", 8.f);
 
+    // Optionally run RPF on the adaptively sampled render as well
+    RPF *rpf = NULL;
+    if (params.FindOneBool("rpf", false)) {
+        int xs = Ceil2Int(xres * crop[0]), ys = Ceil2Int(yres * crop[2]);
+        int w = max(1, Ceil2Int(xres * crop[1]) - xs);
+        int h = max(1, Ceil2Int(yres * crop[3]) - ys);
+        rpf = new RPF(xs, ys, w, h, params.FindOneFloat("jouni", 0.02f),
+                      params.FindOneString("quality", "medium"),
+                      params.FindOneString("randomparams", "all"),
+                      params.FindOneInt("capturesamples", 0),
+                      params.FindOneFloat("capturememory", 1024.f));
+    }
+
     return new SBFImageFilm(xres, yres, filter, crop, filename, 
-                            debug, type, interParamsV, finalParamsV,
+                            debug, multiLayer, type, interParamsV, finalParamsV,
                             sigmaN, sigmaR, sigmaD,
-                            interMseSigma, finalMseSigma);
+                            interMseSigma, finalMseSigma, rpf);
 }
 
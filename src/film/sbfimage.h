@@ -44,17 +44,19 @@
 #include "parallel.h"
 
 #include "sbf/sbf.h"
+#include "rpf/rpf.h"
 
 class SBFImageFilm : public Film {
 public:
     // SBFImageFilm Public Methods
     SBFImageFilm(int xres, int yres, Filter *filt, const float crop[4],
-              const string &filename, bool dp, SBF::FilterType type, 
+              const string &filename, bool dp, bool ml, SBF::FilterType type, 
               const vector<float> &interParams, const vector<float> &finalParams,
               float sigmaN, float sigmaR, float sigmaD,
-              float interMseSigmaS, float finalMseSigmaS);
+              float interMseSigmaS, float finalMseSigmaS, RPF *rpf);
     ~SBFImageFilm() {
         delete sbf;
+        delete rpf;
     }
     void AddSample(const CameraSample &sample, const Spectrum &L, 
             const Intersection &isect);
@@ -63,8 +65,10 @@ public:
     void GetPixelExtent(int *xstart, int *xend, int *ystart, int *yend) const;
     void WriteImage(float splatScale);
     void UpdateDisplay(int x0, int y0, int x1, int y1, float splatScale) {}
-    void GetAdaptPixels(float avgSpp, vector<vector<int> > &pixOff, vector<vector<int> > &pixSmp);
-    void SetSPP(int s) { /*Do nothing here */};
+    void GetAdaptPixels(float avgSpp, vector<vector<int> > &pixOff, vector<vector<int> > &pixSmp,
+                        bool minOneSample = true);
+    float GetMeanEstimatedMSE() const { return sbf->MeanEstimatedMSE(); }
+    void SetSPP(int s) { if (rpf) rpf->SetSPP(s); }
 private:
     // SBFImageFilm Private Data
     Filter *filter;
@@ -73,7 +77,10 @@ private:
     int xPixelStart, yPixelStart, xPixelCount, yPixelCount;
     
     SBF *sbf;
+    // Also filters the captured samples with RPF when present
+    RPF *rpf;
     bool dump;
+    bool multiLayer;
 };
 
 SBFImageFilm *CreateSBFImageFilm(const ParamSet &params, Filter *filter);
@@ -41,6 +41,16 @@ float BoxFilter::Evaluate(float x, float y) const {
 }
 
 
+float BoxFilter::EvaluateX(float x) const {
+    return 1.f;
+}
+
+
+float BoxFilter::EvaluateY(float y) const {
+    return 1.f;
+}
+
+
 BoxFilter *CreateBoxFilter(const ParamSet &ps) {
     float xw = ps.FindOneFloat("xwidth", 0.5f);
     float yw = ps.FindOneFloat("ywidth", 0.5f);
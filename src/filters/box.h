@@ -44,6 +44,9 @@ class BoxFilter : public Filter {
 public:
     BoxFilter(float xw, float yw) : Filter(xw, yw) { }
     float Evaluate(float x, float y) const;
+    bool IsSeparable() const { return true; }
+    float EvaluateX(float x) const;
+    float EvaluateY(float y) const;
 };
 
 
@@ -41,6 +41,16 @@ float GaussianFilter::Evaluate(float x, float y) const {
 }
 
 
+float GaussianFilter::EvaluateX(float x) const {
+    return Gaussian(x, expX);
+}
+
+
+float GaussianFilter::EvaluateY(float y) const {
+    return Gaussian(y, expY);
+}
+
+
 GaussianFilter *CreateGaussianFilter(const ParamSet &ps) {
     // Find common filter parameters
     float xw = ps.FindOneFloat("xwidth", 2.f);
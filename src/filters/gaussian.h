@@ -47,6 +47,9 @@ public:
         : Filter(xw, yw), alpha(a), expX(expf(-alpha * xWidth * xWidth)),
           expY(expf(-alpha * yWidth * yWidth)) { }
     float Evaluate(float x, float y) const;
+    bool IsSeparable() const { return true; }
+    float EvaluateX(float x) const;
+    float EvaluateY(float y) const;
 private:
     // GaussianFilter Private Data
     const float alpha;
@@ -41,6 +41,16 @@ float MitchellFilter::Evaluate(float x, float y) const {
 }
 
 
+float MitchellFilter::EvaluateX(float x) const {
+    return Mitchell1D(x * invXWidth);
+}
+
+
+float MitchellFilter::EvaluateY(float y) const {
+    return Mitchell1D(y * invYWidth);
+}
+
+
 MitchellFilter *CreateMitchellFilter(const ParamSet &ps) {
     // Find common filter parameters
     float xw = ps.FindOneFloat("xwidth", 2.f);
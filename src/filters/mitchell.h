@@ -47,6 +47,9 @@ public:
         : Filter(xw, yw), B(b), C(c) {
     }
     float Evaluate(float x, float y) const;
+    bool IsSeparable() const { return true; }
+    float EvaluateX(float x) const;
+    float EvaluateY(float y) const;
     float Mitchell1D(float x) const {
         x = fabsf(2.f * x);
         if (x > 1.f)
@@ -41,6 +41,16 @@ float LanczosSincFilter::Evaluate(float x, float y) const {
 }
 
 
+float LanczosSincFilter::EvaluateX(float x) const {
+    return Sinc1D(x * invXWidth);
+}
+
+
+float LanczosSincFilter::EvaluateY(float y) const {
+    return Sinc1D(y * invYWidth);
+}
+
+
 LanczosSincFilter *CreateSincFilter(const ParamSet &ps) {
     float xw = ps.FindOneFloat("xwidth", 4.);
     float yw = ps.FindOneFloat("ywidth", 4.);
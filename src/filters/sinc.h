@@ -46,6 +46,9 @@ public:
     LanczosSincFilter(float xw, float yw, float t)
         : Filter(xw, yw), tau(t) { }
     float Evaluate(float x, float y) const;
+    bool IsSeparable() const { return true; }
+    float EvaluateX(float x) const;
+    float EvaluateY(float y) const;
     float Sinc1D(float x) const {
         x = fabsf(x);
         if (x < 1e-5) return 1.f;
@@ -42,6 +42,16 @@ float TriangleFilter::Evaluate(float x, float y) const {
 }
 
 
+float TriangleFilter::EvaluateX(float x) const {
+    return max(0.f, xWidth - fabsf(x));
+}
+
+
+float TriangleFilter::EvaluateY(float y) const {
+    return max(0.f, yWidth - fabsf(y));
+}
+
+
 TriangleFilter *CreateTriangleFilter(const ParamSet &ps) {
     // Find common filter parameters
     float xw = ps.FindOneFloat("xwidth", 2.f);
@@ -43,6 +43,7 @@
 #include "octree.h"
 #include "camera.h"
 #include "floatfile.h"
+#include "parallel.h"
 struct DiffusionReflectance;
 
 // DipoleSubsurfaceIntegrator Local Declarations
@@ -111,22 +112,27 @@ struct SubsurfaceOctreeNode {
         }
         else {
             // Init interior _SubsurfaceOctreeNode_
-            float sumWt = 0.f;
-            uint32_t nChildren = 0;
-            for (uint32_t i = 0; i < 8; ++i) {
-                if (!children[i]) continue;
-                ++nChildren;
-                children[i]->InitHierarchy();
-                float wt = children[i]->E.y();
-                E += children[i]->E;
-                p += wt * children[i]->p;
-                sumWt += wt;
-                sumArea += children[i]->sumArea;
-            }
-            if (sumWt > 0.f) p /= sumWt;
-            E /= nChildren;
+            for (uint32_t i = 0; i < 8; ++i)
+                if (children[i]) children[i]->InitHierarchy();
+            InitFromChildren();
         }
     }
+    void InitFromChildren() {
+        // Init interior node from already-initialized children
+        float sumWt = 0.f;
+        uint32_t nChildren = 0;
+        for (uint32_t i = 0; i < 8; ++i) {
+            if (!children[i]) continue;
+            ++nChildren;
+            float wt = children[i]->E.y();
+            E += children[i]->E;
+            p += wt * children[i]->p;
+            sumWt += wt;
+            sumArea += children[i]->sumArea;
+        }
+        if (sumWt > 0.f) p /= sumWt;
+        E /= nChildren;
+    }
     Spectrum Mo(const BBox &nodeBound, const Point &p, const DiffusionReflectance &Rd,
                 float maxError);
 
@@ -170,11 +176,177 @@ struct DiffusionReflectance {
 };
 
 
+class SubsurfaceIrradianceTask : public Task {
+public:
+    SubsurfaceIrradianceTask(const Scene *sc, const Camera *c,
+            const Renderer *r, const vector<SurfacePoint> &p,
+            vector<IrradiancePoint> &ip, uint32_t s, uint32_t e, int tn,
+            ProgressReporter &pr)
+        : scene(sc), camera(c), renderer(r), pts(p), irradiancePoints(ip),
+          start(s), end(e), taskNum(tn), progress(pr) { }
+    void Run();
+private:
+    const Scene *scene;
+    const Camera *camera;
+    const Renderer *renderer;
+    const vector<SurfacePoint> &pts;
+    vector<IrradiancePoint> &irradiancePoints;
+    uint32_t start, end;
+    int taskNum;
+    ProgressReporter &progress;
+};
+
+
+class SubsurfaceOctreeBuildTask : public Task {
+public:
+    SubsurfaceOctreeBuildTask(SubsurfaceOctreeNode *n, const BBox &b,
+            const vector<IrradiancePoint *> &p, MemoryArena *a)
+        : node(n), bound(b), ips(p), arena(a) { }
+    void Run() {
+        // Build subtree for _node_ in the task's own _MemoryArena_
+        for (uint32_t i = 0; i < ips.size(); ++i)
+            node->Insert(bound, ips[i], *arena);
+        node->InitHierarchy();
+    }
+private:
+    SubsurfaceOctreeNode *node;
+    BBox bound;
+    vector<IrradiancePoint *> ips;
+    MemoryArena *arena;
+};
+
+
+static void SplitSubsurfaceOctree(SubsurfaceOctreeNode *node,
+        const BBox &nodeBound, const vector<IrradiancePoint *> &ips,
+        int depth, MemoryArena &arena,
+        vector<SubsurfaceOctreeNode *> &interiorNodes,
+        vector<Task *> &buildTasks, vector<MemoryArena *> &buildArenas) {
+    // Hand small or deep subtrees off to a build task
+    if (depth == 0 || ips.size() < 4096) {
+        MemoryArena *taskArena = new MemoryArena;
+        buildArenas.push_back(taskArena);
+        buildTasks.push_back(new SubsurfaceOctreeBuildTask(node, nodeBound,
+                                                           ips, taskArena));
+        return;
+    }
+
+    // Make _node_ interior and partition _ips_ among its children
+    // (this is the same split _Insert()_ performs once a node holds more
+    // than eight points, so the resulting tree matches a serial build)
+    node->isLeaf = false;
+    for (int i = 0; i < 8; ++i)
+        node->children[i] = NULL;
+    interiorNodes.push_back(node);
+    Point pMid = .5f * nodeBound.pMin + .5f * nodeBound.pMax;
+    vector<IrradiancePoint *> childIps[8];
+    for (uint32_t i = 0; i < ips.size(); ++i) {
+        const IrradiancePoint *ip = ips[i];
+        int child = (ip->p.x > pMid.x ? 4 : 0) +
+            (ip->p.y > pMid.y ? 2 : 0) + (ip->p.z > pMid.z ? 1 : 0);
+        childIps[child].push_back(ips[i]);
+    }
+    for (int child = 0; child < 8; ++child) {
+        if (childIps[child].size() == 0) continue;
+        node->children[child] = arena.Alloc<SubsurfaceOctreeNode>();
+        BBox childBound = octreeChildBound(child, nodeBound, pMid);
+        SplitSubsurfaceOctree(node->children[child], childBound,
+                              childIps[child], depth - 1, arena,
+                              interiorNodes, buildTasks, buildArenas);
+    }
+}
+
+
+// Irradiance cache files start with this tag, followed by the scene hash,
+// _sizeof(IrradiancePoint)_, the number of points, and the points themselves
+static const char irradianceCacheTag[8] = { 'p', 'b', 'r', 't', 'S', 'S', 'S', '1' };
+
+template <typename T> static inline uint64_t HashValue(const T &v,
+                                                       uint64_t hash) {
+    return HashBytes(&v, sizeof(T), hash);
+}
+
+
+static uint64_t ComputeSubsurfaceSceneHash(const Scene *scene,
+        const Point &pCamera, float time, float minSampleDist,
+        const vector<SurfacePoint> &pts) {
+    // Combine the scene description hash with the sampling parameters
+    uint64_t hash = HashBytes(irradianceCacheTag, sizeof(irradianceCacheTag));
+    hash = HashValue(scene->descriptionHash, hash);
+    hash = HashValue(minSampleDist, hash);
+    hash = HashValue(pCamera, hash);
+    hash = HashValue(time, hash);
+    for (uint32_t i = 0; i < pts.size(); ++i) {
+        hash = HashValue(pts[i].p, hash);
+        hash = HashValue(pts[i].n, hash);
+        hash = HashValue(pts[i].area, hash);
+        hash = HashValue(pts[i].rayEpsilon, hash);
+    }
+    return hash;
+}
+
+
+static bool ReadIrradianceCache(const string &filename, uint64_t hash,
+                                vector<IrradiancePoint> *ips) {
+    FILE *f = fopen(filename.c_str(), "rb");
+    if (!f) return false;
+    char tag[8];
+    uint64_t fileHash;
+    uint32_t pointSize, nPoints;
+    bool ok = fread(tag, sizeof(tag), 1, f) == 1 &&
+              memcmp(tag, irradianceCacheTag, sizeof(tag)) == 0 &&
+              fread(&fileHash, sizeof(fileHash), 1, f) == 1 &&
+              fread(&pointSize, sizeof(pointSize), 1, f) == 1 &&
+              pointSize == sizeof(IrradiancePoint) &&
+              fread(&nPoints, sizeof(nPoints), 1, f) == 1;
+    if (ok && fileHash != hash) {
+        Info("Irradiance cache \"%s\" was written for a different scene",
+             filename.c_str());
+        fclose(f);
+        return false;
+    }
+    if (ok) {
+        ips->resize(nPoints);
+        ok = nPoints == 0 ||
+             fread(&(*ips)[0], sizeof(IrradiancePoint), nPoints, f) == nPoints;
+    }
+    fclose(f);
+    if (!ok) {
+        Warning("Unable to read irradiance cache \"%s\"; recomputing",
+                filename.c_str());
+        ips->clear();
+    }
+    return ok;
+}
+
+
+static void WriteIrradianceCache(const string &filename, uint64_t hash,
+                                 const vector<IrradiancePoint> &ips) {
+    FILE *f = fopen(filename.c_str(), "wb");
+    if (!f) {
+        Warning("Unable to open irradiance cache \"%s\" for writing",
+                filename.c_str());
+        return;
+    }
+    uint32_t pointSize = sizeof(IrradiancePoint), nPoints = ips.size();
+    bool ok = fwrite(irradianceCacheTag, sizeof(irradianceCacheTag), 1, f) == 1 &&
+              fwrite(&hash, sizeof(hash), 1, f) == 1 &&
+              fwrite(&pointSize, sizeof(pointSize), 1, f) == 1 &&
+              fwrite(&nPoints, sizeof(nPoints), 1, f) == 1 &&
+              (nPoints == 0 ||
+               fwrite(&ips[0], sizeof(IrradiancePoint), nPoints, f) == nPoints);
+    if (fclose(f) != 0) ok = false;
+    if (!ok)
+        Warning("Error writing irradiance cache \"%s\"", filename.c_str());
+}
+
+
 
 // DipoleSubsurfaceIntegrator Method Definitions
 DipoleSubsurfaceIntegrator::~DipoleSubsurfaceIntegrator() {
     delete[] lightSampleOffsets;
     delete[] bsdfSampleOffsets;
+    for (uint32_t i = 0; i < subtreeArenas.size(); ++i)
+        delete subtreeArenas[i];
 }
 
 
@@ -212,20 +384,58 @@ void DipoleSubsurfaceIntegrator::Preprocess(const Scene *scene,
                                            fpts[i+6], fpts[i+7]));
         }
     }
-    if (pts.size() == 0) {
-        Point pCamera = camera->CameraToWorld(camera->shutterOpen,
-                                              Point(0, 0, 0));
+    Point pCamera = camera->CameraToWorld(camera->shutterOpen,
+                                          Point(0, 0, 0));
+
+    // Try to reuse irradiance values cached by a previous render
+    uint64_t sceneHash = 0;
+    if (cacheFilename != "") {
+        sceneHash = ComputeSubsurfaceSceneHash(scene, pCamera,
+            camera->shutterOpen, minSampleDist, pts);
+        if (ReadIrradianceCache(cacheFilename, sceneHash, &irradiancePoints)) {
+            Info("Read %d irradiance points from cache \"%s\"",
+                 int(irradiancePoints.size()), cacheFilename.c_str());
+            BuildOctree();
+            return;
+        }
+    }
+    if (pts.size() == 0)
         FindPoissonPointDistribution(pCamera, camera->shutterOpen,
                                      minSampleDist, scene, &pts);
-    }
 
     // Compute irradiance values at sample points
-    RNG rng;
-    MemoryArena arena;
     PBRT_SUBSURFACE_STARTED_COMPUTING_IRRADIANCE_VALUES();
+    irradiancePoints.resize(pts.size());
     ProgressReporter progress(pts.size(), "Computing Irradiances");
-    for (uint32_t i = 0; i < pts.size(); ++i) {
-        SurfacePoint &sp = pts[i];
+    const uint32_t pointsPerTask = 256;
+    vector<Task *> irradianceTasks;
+    for (uint32_t start = 0; start < pts.size(); start += pointsPerTask) {
+        uint32_t end = min(start + pointsPerTask, uint32_t(pts.size()));
+        irradianceTasks.push_back(new SubsurfaceIrradianceTask(scene, camera,
+            renderer, pts, irradiancePoints, start, end,
+            irradianceTasks.size(), progress));
+    }
+    EnqueueTasks(irradianceTasks);
+    WaitForAllTasks();
+    for (uint32_t i = 0; i < irradianceTasks.size(); ++i)
+        delete irradianceTasks[i];
+    progress.Done();
+    PBRT_SUBSURFACE_FINISHED_COMPUTING_IRRADIANCE_VALUES();
+    if (cacheFilename != "")
+        WriteIrradianceCache(cacheFilename, sceneHash, irradiancePoints);
+
+    // Create octree of clustered irradiance samples
+    BuildOctree();
+}
+
+
+void SubsurfaceIrradianceTask::Run() {
+    // Use a fixed number of points per task so results don't depend on
+    // the number of cores
+    RNG rng(41 * taskNum);
+    MemoryArena arena;
+    for (uint32_t i = start; i < end; ++i) {
+        const SurfacePoint &sp = pts[i];
         Spectrum E(0.f);
         for (uint32_t j = 0; j < scene->lights.size(); ++j) {
             // Add irradiance from light at point
@@ -252,21 +462,36 @@ void DipoleSubsurfaceIntegrator::Preprocess(const Scene *scene,
             }
             E += Elight / nSamples;
         }
-        irradiancePoints.push_back(IrradiancePoint(sp, E));
-        PBRT_SUBSURFACE_COMPUTED_IRRADIANCE_AT_POINT(&sp, &E);
+        irradiancePoints[i] = IrradiancePoint(sp, E);
+        PBRT_SUBSURFACE_COMPUTED_IRRADIANCE_AT_POINT(const_cast<SurfacePoint *>(&sp), &E);
         arena.FreeAll();
         progress.Update();
     }
-    progress.Done();
-    PBRT_SUBSURFACE_FINISHED_COMPUTING_IRRADIANCE_VALUES();
+}
 
-    // Create octree of clustered irradiance samples
+
+void DipoleSubsurfaceIntegrator::BuildOctree() {
     octree = octreeArena.Alloc<SubsurfaceOctreeNode>();
     for (uint32_t i = 0; i < irradiancePoints.size(); ++i)
         octreeBounds = Union(octreeBounds, irradiancePoints[i].p);
+
+    // Split the top levels of the octree serially, then build the
+    // remaining subtrees in parallel, each with its own _MemoryArena_
+    vector<IrradiancePoint *> ips(irradiancePoints.size());
     for (uint32_t i = 0; i < irradiancePoints.size(); ++i)
-        octree->Insert(octreeBounds, &irradiancePoints[i], octreeArena);
-    octree->InitHierarchy();
+        ips[i] = &irradiancePoints[i];
+    vector<SubsurfaceOctreeNode *> interiorNodes;
+    vector<Task *> buildTasks;
+    SplitSubsurfaceOctree(octree, octreeBounds, ips, 2, octreeArena,
+                          interiorNodes, buildTasks, subtreeArenas);
+    EnqueueTasks(buildTasks);
+    WaitForAllTasks();
+    for (uint32_t i = 0; i < buildTasks.size(); ++i)
+        delete buildTasks[i];
+
+    // Initialize top-level interior nodes, children before parents
+    for (int i = int(interiorNodes.size()) - 1; i >= 0; --i)
+        interiorNodes[i]->InitFromChildren();
 }
 
 
@@ -352,8 +577,10 @@ DipoleSubsurfaceIntegrator *CreateDipoleSubsurfaceIntegrator(const ParamSet &par
     float maxError = params.FindOneFloat("maxerror", .05f);
     float minDist = params.FindOneFloat("minsampledistance", .25f);
     string pointsfile = params.FindOneString("pointsfile", "");
+    string cachefile = params.FindOneString("cachefile", "");
     if (PbrtOptions.quickRender) { maxError *= 4.f; minDist *= 4.f; }
-    return new DipoleSubsurfaceIntegrator(maxDepth, maxError, minDist, pointsfile);
+    return new DipoleSubsurfaceIntegrator(maxDepth, maxError, minDist, pointsfile,
+                                          cachefile);
 }
 
 
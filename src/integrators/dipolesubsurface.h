@@ -62,11 +62,12 @@ class DipoleSubsurfaceIntegrator : public SurfaceIntegrator {
 public:
     // DipoleSubsurfaceIntegrator Public Methods
     DipoleSubsurfaceIntegrator(int mdepth, float merror, float mindist,
-                               const string &fn) {
+                               const string &fn, const string &cfn) {
         maxSpecularDepth = mdepth;
         maxError = merror;
         minSampleDist = mindist;
         filename = fn;
+        cacheFilename = cfn;
         octree = NULL;
     }
     ~DipoleSubsurfaceIntegrator();
@@ -76,14 +77,18 @@ public:
     void RequestSamples(Sampler *sampler, Sample *sample, const Scene *scene);
     void Preprocess(const Scene *, const Camera *, const Renderer *);
 private:
+    // DipoleSubsurfaceIntegrator Private Methods
+    void BuildOctree();
+
     // DipoleSubsurfaceIntegrator Private Data
     int maxSpecularDepth;
     float maxError, minSampleDist;
-    string filename;
+    string filename, cacheFilename;
     vector<IrradiancePoint> irradiancePoints;
     BBox octreeBounds;
     SubsurfaceOctreeNode *octree;
     MemoryArena octreeArena;
+    vector<MemoryArena *> subtreeArenas;
 
     // Declare sample parameters for light source sampling
     LightSampleOffsets *lightSampleOffsets;
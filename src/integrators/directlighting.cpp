@@ -35,11 +35,15 @@
 #include "integrators/directlighting.h"
 #include "intersection.h"
 #include "paramset.h"
+#include "lightbvh.h"
 
 // DirectLightingIntegrator Method Definitions
-DirectLightingIntegrator::DirectLightingIntegrator(LightStrategy st, int md) {
+DirectLightingIntegrator::DirectLightingIntegrator(LightStrategy st, int md,
+                                                   bool lightbvh) {
     maxDepth = md;
     strategy = st;
+    useLightBVH = lightbvh;
+    lightBVH = NULL;
     lightSampleOffsets = NULL;
     bsdfSampleOffsets = NULL;
 }
@@ -48,6 +52,14 @@ DirectLightingIntegrator::DirectLightingIntegrator(LightStrategy st, int md) {
 DirectLightingIntegrator::~DirectLightingIntegrator() {
     delete[] lightSampleOffsets;
     delete[] bsdfSampleOffsets;
+    delete lightBVH;
+}
+
+
+void DirectLightingIntegrator::Preprocess(const Scene *scene,
+        const Camera *camera, const Renderer *renderer) {
+    if (useLightBVH && strategy == SAMPLE_ONE_UNIFORM && !lightBVH)
+        lightBVH = new LightBVH(scene);
 }
 
 
@@ -102,7 +114,8 @@ Spectrum DirectLightingIntegrator::Li(const Scene *scene,
             case SAMPLE_ONE_UNIFORM:
                 L += UniformSampleOneLight(scene, renderer, arena, p, n, wo,
                     isect.rayEpsilon, ray.time, bsdf, sample, rng,
-                    lightNumOffset, lightSampleOffsets, bsdfSampleOffsets);
+                    lightNumOffset, lightSampleOffsets, bsdfSampleOffsets,
+                    lightBVH);
                 break;
         }
     }
@@ -129,7 +142,16 @@ DirectLightingIntegrator *CreateDirectLightingIntegrator(const ParamSet &params)
             "Using \"all\".", st.c_str());
         strategy = SAMPLE_ALL_UNIFORM;
     }
-    return new DirectLightingIntegrator(strategy, maxDepth);
+    string ls = params.FindOneString("lightsampling", "uniform");
+    if (ls != "uniform" && ls != "bvh") {
+        Warning("Light sampling \"%s\" for direct lighting unknown. "
+            "Using \"uniform\".", ls.c_str());
+        ls = "uniform";
+    }
+    else if (ls == "bvh" && strategy != SAMPLE_ONE_UNIFORM)
+        Warning("\"bvh\" light sampling only applies to the \"one\" "
+            "strategy for direct lighting.");
+    return new DirectLightingIntegrator(strategy, maxDepth, ls == "bvh");
 }
 
 
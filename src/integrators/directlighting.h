@@ -46,16 +46,21 @@ enum LightStrategy { SAMPLE_ALL_UNIFORM, SAMPLE_ONE_UNIFORM };
 class DirectLightingIntegrator : public SurfaceIntegrator {
 public:
     // DirectLightingIntegrator Public Methods
-    DirectLightingIntegrator(LightStrategy ls = SAMPLE_ALL_UNIFORM, int md = 5);
+    DirectLightingIntegrator(LightStrategy ls = SAMPLE_ALL_UNIFORM, int md = 5,
+                             bool lightbvh = false);
     ~DirectLightingIntegrator();
     Spectrum Li(const Scene *scene, const Renderer *renderer,
         const RayDifferential &ray, const Intersection &isect,
         const Sample *sample, RNG &rng, MemoryArena &arena) const;
     void RequestSamples(Sampler *sampler, Sample *sample, const Scene *scene);
+    void Preprocess(const Scene *scene, const Camera *camera,
+                    const Renderer *renderer);
 private:
     // DirectLightingIntegrator Private Data
     LightStrategy strategy;
     int maxDepth;
+    bool useLightBVH;
+    LightBVH *lightBVH;
 
     // Declare sample parameters for light source sampling
     LightSampleOffsets *lightSampleOffsets;
@@ -40,10 +40,62 @@
 #include "intersection.h"
 #include "paramset.h"
 
+// GlossyPRTIntegrator Local Declarations
+struct TransferSample {
+    TransferSample(const Point &pp, const Normal &nn, const Spectrum *c,
+                   int nTerms)
+        : p(pp), n(nn), c_t(new Spectrum[nTerms]), next(NULL) {
+        for (int i = 0; i < nTerms; ++i)
+            c_t[i] = c[i];
+    }
+    ~TransferSample() { delete[] c_t; }
+    Point p;
+    Normal n;
+    Spectrum *c_t;
+    TransferSample *next;
+};
+
+
+struct TransferProcess {
+    // TransferProcess Public Methods
+    TransferProcess(const Point &pp, const Normal &nn, float md,
+                    Spectrum *c, int nt)
+        : p(pp), n(nn), maxDist(md), c_t(c), nTerms(nt), sumWt(0.f) {
+        for (int i = 0; i < nTerms; ++i)
+            c_t[i] = 0.f;
+    }
+    bool operator()(const TransferSample *sample) {
+        // Weight nearby samples on the same side of the surface
+        if (Dot(n, sample->n) < .9f) return true;
+        float wt = 1.f - Distance(p, sample->p) / maxDist;
+        if (wt <= 0.f) return true;
+        for (int i = 0; i < nTerms; ++i)
+            c_t[i] += wt * sample->c_t[i];
+        sumWt += wt;
+        return true;
+    }
+
+    // TransferProcess Data
+    Point p;
+    Normal n;
+    float maxDist;
+    Spectrum *c_t;
+    int nTerms;
+    float sumWt;
+};
+
+
+
 // GlossyPRTIntegrator Method Definitions
 GlossyPRTIntegrator::~GlossyPRTIntegrator() {
     delete[] c_in;
     delete[] B;
+    delete transferCache;
+    while (transferSamples) {
+        TransferSample *next = transferSamples->next;
+        delete transferSamples;
+        transferSamples = next;
+    }
 }
 
 
@@ -61,6 +113,43 @@ void GlossyPRTIntegrator::Preprocess(const Scene *scene,
     // Compute glossy BSDF matrix for PRT
     B = new Spectrum[SHTerms(lmax)*SHTerms(lmax)];
     SHComputeBSDFMatrix(Kd, Ks, roughness, rng, 1024, lmax, B);
+
+    // Create cache for transferred radiance if requested
+    if (cacheTransfer) {
+        if (cacheDistance <= 0.f)
+            cacheDistance = .01f * Distance(bbox.pMin, bbox.pMax);
+        bbox.Expand(cacheDistance);
+        transferCache = new Octree<TransferSample *>(bbox);
+    }
+}
+
+
+bool GlossyPRTIntegrator::LookupTransfer(const Point &p, const Normal &n,
+                                         Spectrum *c_t) const {
+    if (!transferCache) return false;
+    TransferProcess proc(p, n, cacheDistance, c_t, SHTerms(lmax));
+    transferCache->Lookup(p, proc);
+    if (proc.sumWt == 0.f) return false;
+    for (int i = 0; i < SHTerms(lmax); ++i)
+        c_t[i] /= proc.sumWt;
+    return true;
+}
+
+
+void GlossyPRTIntegrator::AddTransfer(const Point &p, const Normal &n,
+                                      const Spectrum *c_t) const {
+    // Allocate _TransferSample_ and record it for cleanup
+    TransferSample *sample = new TransferSample(p, n, c_t, SHTerms(lmax));
+    TransferSample *head;
+    do {
+        head = transferSamples;
+        sample->next = head;
+    } while (AtomicCompareAndSwapPointer(&transferSamples, sample, head) != head);
+
+    // Add sample to lock-free octree
+    BBox sampleExtent(p);
+    sampleExtent.Expand(cacheDistance);
+    transferCache->Add(sample, sampleExtent);
 }
 
 
@@ -81,12 +170,13 @@ Spectrum GlossyPRTIntegrator::Li(const Scene *scene, const Renderer *,
     const Point &p = bsdf->dgShading.p;
     // Compute reflected radiance with glossy PRT at point
 
-    // Compute SH radiance transfer matrix at point and SH coefficients
+    // Compute transferred SH radiance coefficients at point
     Spectrum *c_t = arena.Alloc<Spectrum>(SHTerms(lmax));
-    Spectrum *T = arena.Alloc<Spectrum>(SHTerms(lmax)*SHTerms(lmax));
-    SHComputeTransferMatrix(p, isect.rayEpsilon, scene, rng, nSamples,
-                            lmax, T);
-    SHMatrixVectorMultiply(T, c_in, c_t, lmax);
+    if (!LookupTransfer(p, isect.dg.nn, c_t)) {
+        SHComputeTransferredRadiance(p, isect.rayEpsilon, scene, rng,
+                                     nSamples, lmax, c_in, c_t);
+        if (transferCache) AddTransfer(p, isect.dg.nn, c_t);
+    }
 
     // Rotate incident SH lighting to local coordinate frame
     Vector r1 = bsdf->LocalToWorld(Vector(1,0,0));
@@ -142,7 +232,10 @@ GlossyPRTIntegrator *CreateGlossyPRTIntegratorSurfaceIntegrator(const ParamSet &
     Spectrum Kd = params.FindOneSpectrum("Kd", Spectrum(0.5f));
     Spectrum Ks = params.FindOneSpectrum("Ks", Spectrum(0.25f));
     float roughness = params.FindOneFloat("roughness", 0.1f);
-    return new GlossyPRTIntegrator(Kd, Ks, roughness, lmax, ns);
+    bool cacheTransfer = params.FindOneBool("cachetransfer", false);
+    float cacheDistance = params.FindOneFloat("cachedistance", 0.f);
+    return new GlossyPRTIntegrator(Kd, Ks, roughness, lmax, ns,
+                                   cacheTransfer, cacheDistance);
 }
 
 
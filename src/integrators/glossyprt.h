@@ -39,16 +39,20 @@
 // integrators/glossyprt.h*
 #include "pbrt.h"
 #include "integrator.h"
+#include "octree.h"
+struct TransferSample;
 
 // GlossyPRTIntegrator Declarations
 class GlossyPRTIntegrator : public SurfaceIntegrator {
 public:
     // GlossyPRTIntegrator Public Methods
     GlossyPRTIntegrator(const Spectrum &kd, const Spectrum &ks,
-                        float rough, int lm, int ns)
+                        float rough, int lm, int ns, bool ct, float cd)
         : Kd(kd), Ks(ks), roughness(rough), lmax(lm),
-          nSamples(RoundUpPow2(ns)) {
+          nSamples(RoundUpPow2(ns)), cacheTransfer(ct), cacheDistance(cd) {
         c_in = B = NULL;
+        transferCache = NULL;
+        transferSamples = NULL;
     }
     ~GlossyPRTIntegrator();
     void Preprocess(const Scene *scene, const Camera *camera, const Renderer *renderer);
@@ -57,12 +61,20 @@ public:
                 const RayDifferential &ray, const Intersection &isect,
                 const Sample *sample, RNG &rng, MemoryArena &arena) const;
 private:
+    // GlossyPRTIntegrator Private Methods
+    bool LookupTransfer(const Point &p, const Normal &n, Spectrum *c_t) const;
+    void AddTransfer(const Point &p, const Normal &n, const Spectrum *c_t) const;
+
     // GlossyPRTIntegrator Private Data
     const Spectrum Kd, Ks;
     const float roughness;
     const int lmax, nSamples;
     Spectrum *c_in;
     Spectrum *B;
+    const bool cacheTransfer;
+    float cacheDistance;
+    Octree<TransferSample *> *transferCache;
+    mutable TransferSample *transferSamples;
 };
 
 
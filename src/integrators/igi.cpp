@@ -41,6 +41,151 @@
 #include "paramset.h"
 #include "camera.h"
 
+// IGIIntegrator Local Declarations
+struct CompareVirtualLights {
+    CompareVirtualLights(const vector<VirtualLight> &v, int a)
+        : vls(v), axis(a) { }
+    bool operator()(uint32_t a, uint32_t b) const {
+        return vls[a].p[axis] < vls[b].p[axis];
+    }
+    const vector<VirtualLight> &vls;
+    int axis;
+};
+
+
+struct LightcutEntry {
+    bool operator<(const LightcutEntry &e) const {
+        return errorBound < e.errorBound;
+    }
+    uint32_t nodeNum;
+    float errorBound, fBound;
+    Spectrum L;
+};
+
+
+static void MergeNormalCones(const Vector &axis0, float angle0,
+        const Vector &axis1, float angle1, Vector *axis, float *angle) {
+    // Flip _axis1_ if needed; virtual lights emit from both sides
+    Vector a1 = (Dot(axis0, axis1) < 0.f) ? -axis1 : axis1;
+    float d = acosf(Clamp(Dot(axis0, a1), -1.f, 1.f));
+    if (angle0 >= d + angle1) {
+        *axis = axis0;
+        *angle = angle0;
+        return;
+    }
+    if (angle1 >= d + angle0) {
+        *axis = a1;
+        *angle = angle1;
+        return;
+    }
+    float newAngle = .5f * (angle0 + d + angle1);
+    if (newAngle >= .5f * M_PI) {
+        // Two-sided cone this wide bounds all directions
+        *axis = axis0;
+        *angle = .5f * M_PI;
+        return;
+    }
+
+    // Rotate _axis0_ toward _a1_ to center the merged cone
+    Vector perp = a1 - Dot(axis0, a1) * axis0;
+    if (perp.LengthSquared() == 0.f) *axis = axis0;
+    else {
+        float theta = newAngle - angle0;
+        *axis = Normalize(cosf(theta) * axis0 +
+                          sinf(theta) * Normalize(perp));
+    }
+    *angle = newAngle;
+}
+
+
+static float BoundLightClusterG(const VirtualLightTreeNode &node,
+        const Point &p, const Normal &n, float gLimit) {
+    // Find angular radius of cluster's bounding sphere as seen from _p_
+    Point center;
+    float radius;
+    node.bounds.BoundingSphere(&center, &radius);
+    float dist = Distance(p, center);
+    if (dist <= radius) return gLimit;
+    Vector wc = (center - p) / dist;
+    float alpha = asinf(radius / dist);
+
+    // Bound cosine terms at shading point and at virtual lights
+    float thetaS = acosf(min(AbsDot(wc, n), 1.f));
+    float cosS = cosf(max(0.f, thetaS - alpha));
+    float thetaV = acosf(min(AbsDot(wc, node.coneAxis), 1.f));
+    float cosV = cosf(max(0.f, thetaV - alpha - node.coneAngle));
+
+    // Bound squared distance from _p_ to cluster
+    float dmin2 = 0.f;
+    for (int i = 0; i < 3; ++i) {
+        float d = max(0.f, max(node.bounds.pMin[i] - p[i],
+                               p[i] - node.bounds.pMax[i]));
+        dmin2 += d * d;
+    }
+    if (dmin2 == 0.f) return gLimit;
+    return min(gLimit, cosS * cosV / dmin2);
+}
+
+
+static LightcutEntry EvaluateLightcutCluster(const Scene *scene,
+        const Renderer *renderer, const RayDifferential &ray,
+        const Intersection &isect, const BSDF *bsdf,
+        const vector<VirtualLightTreeNode> &tree,
+        const vector<VirtualLight> &vls, uint32_t nodeNum, float fBound,
+        float gLimit, uint32_t nLightPaths, const LightcutEntry *parent,
+        RNG &rng, MemoryArena &arena) {
+    const VirtualLightTreeNode &node = tree[nodeNum];
+    const VirtualLight &vl = vls[node.vlIndex];
+    const Point &p = bsdf->dgShading.p;
+    const Normal &n = bsdf->dgShading.nn;
+    Vector wo = -ray.d;
+    LightcutEntry entry;
+    entry.nodeNum = nodeNum;
+    entry.errorBound = 0.f;
+    entry.fBound = fBound;
+    entry.L = 0.f;
+    if (parent && tree[parent->nodeNum].vlIndex == node.vlIndex) {
+        // Reuse parent's estimate when it has the same representative
+        float yParent = tree[parent->nodeNum].intensity.y();
+        if (yParent > 0.f)
+            entry.L = parent->L * (node.intensity.y() / yParent);
+        entry.fBound = parent->fBound;
+        if (!node.isLeaf)
+            entry.errorBound = entry.fBound *
+                BoundLightClusterG(node, p, n, gLimit) *
+                node.intensity.y() / nLightPaths;
+        return entry;
+    }
+
+    // Estimate cluster's contribution using its representative light
+    float d2 = DistanceSquared(p, vl.p);
+    Vector wi = Normalize(vl.p - p);
+    float G = AbsDot(wi, n) * AbsDot(wi, vl.n) / d2;
+    G = min(G, gLimit);
+    Spectrum f = bsdf->f(wo, wi);
+    float yRep = vl.pathContrib.y();
+    if (G > 0.f && !f.IsBlack() && yRep > 0.f) {
+        // Representatives are chosen with probability proportional to
+        // intensity, so scale by the inverse of that probability
+        Spectrum Llight = f * G * vl.pathContrib *
+            (node.intensity.y() / (yRep * nLightPaths));
+        RayDifferential connectRay(p, wi, ray, isect.rayEpsilon,
+                                   sqrtf(d2) * (1.f - vl.rayEpsilon));
+        Llight *= renderer->Transmittance(scene, connectRay, NULL, rng, arena);
+        if (!scene->IntersectP(connectRay))
+            entry.L = Llight;
+        entry.fBound = max(fBound, f.y());
+    }
+
+    // Bound error of approximating interior cluster by its representative
+    if (!node.isLeaf)
+        entry.errorBound = entry.fBound * BoundLightClusterG(node, p, n, gLimit) *
+                           node.intensity.y() / nLightPaths;
+    return entry;
+}
+
+
+
 // IGIIntegrator Method Definitions
 IGIIntegrator::~IGIIntegrator() {
     delete[] lightSampleOffsets;
@@ -140,6 +285,113 @@ void IGIIntegrator::Preprocess(const Scene *scene, const Camera *camera,
         }
     }
     delete lightDistribution;
+
+    // Build light trees over virtual light sets for lightcuts
+    if (useLightcuts) {
+        for (uint32_t s = 0; s < nLightSets; ++s) {
+            if (virtualLights[s].size() == 0) continue;
+            vector<uint32_t> indices(virtualLights[s].size());
+            for (uint32_t i = 0; i < indices.size(); ++i)
+                indices[i] = i;
+            lightTrees[s].reserve(2 * indices.size() - 1);
+            BuildLightTree(lightTrees[s], virtualLights[s], &indices[0], 0,
+                           indices.size(), rng);
+        }
+    }
+}
+
+
+uint32_t IGIIntegrator::BuildLightTree(vector<VirtualLightTreeNode> &tree,
+        const vector<VirtualLight> &vls, uint32_t *indices, uint32_t start,
+        uint32_t end, RNG &rng) {
+    uint32_t nodeNum = tree.size();
+    tree.push_back(VirtualLightTreeNode());
+    if (end - start == 1) {
+        // Create leaf _VirtualLightTreeNode_
+        const VirtualLight &vl = vls[indices[start]];
+        VirtualLightTreeNode &node = tree[nodeNum];
+        node.bounds = BBox(vl.p);
+        node.coneAxis = Vector(vl.n);
+        node.coneAngle = 0.f;
+        node.intensity = vl.pathContrib;
+        node.vlIndex = indices[start];
+        node.secondChildOffset = 0;
+        node.isLeaf = true;
+        return nodeNum;
+    }
+
+    // Split virtual lights at median along largest extent of their bounds
+    BBox bounds;
+    for (uint32_t i = start; i < end; ++i)
+        bounds = Union(bounds, vls[indices[i]].p);
+    uint32_t mid = (start + end) / 2;
+    std::nth_element(&indices[start], &indices[mid], &indices[end-1]+1,
+                     CompareVirtualLights(vls, bounds.MaximumExtent()));
+    BuildLightTree(tree, vls, indices, start, mid, rng);
+    uint32_t secondChild = BuildLightTree(tree, vls, indices, mid, end, rng);
+
+    // Initialize interior node from its children
+    const VirtualLightTreeNode &c0 = tree[nodeNum+1], &c1 = tree[secondChild];
+    VirtualLightTreeNode node;
+    node.bounds = Union(c0.bounds, c1.bounds);
+    MergeNormalCones(c0.coneAxis, c0.coneAngle, c1.coneAxis, c1.coneAngle,
+                     &node.coneAxis, &node.coneAngle);
+    node.intensity = c0.intensity + c1.intensity;
+    float y0 = c0.intensity.y(), y1 = c1.intensity.y();
+    bool useSecond = (y0 + y1 > 0.f) && rng.RandomFloat() * (y0 + y1) >= y0;
+    node.vlIndex = useSecond ? c1.vlIndex : c0.vlIndex;
+    node.secondChildOffset = secondChild;
+    node.isLeaf = false;
+    tree[nodeNum] = node;
+    return nodeNum;
+}
+
+
+Spectrum IGIIntegrator::LightcutLi(const Scene *scene,
+        const Renderer *renderer, const RayDifferential &ray,
+        const Intersection &isect, BSDF *bsdf, uint32_t lSet,
+        const Spectrum &Ldirect, RNG &rng, MemoryArena &arena) const {
+    const vector<VirtualLightTreeNode> &tree = lightTrees[lSet];
+    const vector<VirtualLight> &vls = virtualLights[lSet];
+    if (tree.size() == 0) return 0.f;
+
+    // Bound the BSDF by its albedo over $\pi$ for cluster error bounds
+    Vector wo = -ray.d;
+    float fBound = bsdf->rho(wo, rng,
+        BxDFType(BSDF_ALL & ~BSDF_SPECULAR)).y() * INV_PI;
+
+    // Refine cut with largest error bound until all are within tolerance
+    LightcutEntry *cut = arena.Alloc<LightcutEntry>(maxCutSize + 1);
+    int cutSize = 0;
+    cut[cutSize++] = EvaluateLightcutCluster(scene, renderer, ray, isect,
+        bsdf, tree, vls, 0, fBound, gLimit, nLightPaths, NULL, rng, arena);
+    float yDirect = Ldirect.y(), yCut = cut[0].L.y();
+    while (cutSize < maxCutSize) {
+        // Leaves are exact, so a leaf at the top of the heap ends refinement
+        if (tree[cut[0].nodeNum].isLeaf ||
+            cut[0].errorBound <= cutRelError * (yDirect + yCut))
+            break;
+        LightcutEntry parent = cut[0];
+        yCut -= parent.L.y();
+        std::pop_heap(cut, cut + cutSize);
+        --cutSize;
+        uint32_t children[2] = { parent.nodeNum + 1,
+                                 tree[parent.nodeNum].secondChildOffset };
+        for (int c = 0; c < 2; ++c) {
+            cut[cutSize] = EvaluateLightcutCluster(scene, renderer, ray, isect,
+                bsdf, tree, vls, children[c], fBound, gLimit, nLightPaths,
+                &parent, rng, arena);
+            yCut += cut[cutSize++].L.y();
+            std::push_heap(cut, cut + cutSize);
+        }
+        yCut = max(yCut, 0.f);
+    }
+
+    // Sum the contributions of the clusters in the final cut
+    Spectrum L = 0.f;
+    for (int i = 0; i < cutSize; ++i)
+        L += cut[i].L;
+    return L;
 }
 
 
@@ -161,31 +413,35 @@ Spectrum IGIIntegrator::Li(const Scene *scene, const Renderer *renderer,
     // Compute indirect illumination with virtual lights
     uint32_t lSet = min(uint32_t(sample->oneD[vlSetOffset][0] * nLightSets),
                         nLightSets-1);
-    for (uint32_t i = 0; i < virtualLights[lSet].size(); ++i) {
-        const VirtualLight &vl = virtualLights[lSet][i];
-        // Compute virtual light's tentative contribution _Llight_
-        float d2 = DistanceSquared(p, vl.p);
-        Vector wi = Normalize(vl.p - p);
-        float G = AbsDot(wi, n) * AbsDot(wi, vl.n) / d2;
-        G = min(G, gLimit);
-        Spectrum f = bsdf->f(wo, wi);
-        if (G == 0.f || f.IsBlack()) continue;
-        Spectrum Llight = f * G * vl.pathContrib / nLightPaths;
-        RayDifferential connectRay(p, wi, ray, isect.rayEpsilon,
-                                   sqrtf(d2) * (1.f - vl.rayEpsilon));
-        Llight *= renderer->Transmittance(scene, connectRay, NULL, rng, arena);
+    if (useLightcuts)
+        L += LightcutLi(scene, renderer, ray, isect, bsdf, lSet, L, rng, arena);
+    else {
+        for (uint32_t i = 0; i < virtualLights[lSet].size(); ++i) {
+            const VirtualLight &vl = virtualLights[lSet][i];
+            // Compute virtual light's tentative contribution _Llight_
+            float d2 = DistanceSquared(p, vl.p);
+            Vector wi = Normalize(vl.p - p);
+            float G = AbsDot(wi, n) * AbsDot(wi, vl.n) / d2;
+            G = min(G, gLimit);
+            Spectrum f = bsdf->f(wo, wi);
+            if (G == 0.f || f.IsBlack()) continue;
+            Spectrum Llight = f * G * vl.pathContrib / nLightPaths;
+            RayDifferential connectRay(p, wi, ray, isect.rayEpsilon,
+                                       sqrtf(d2) * (1.f - vl.rayEpsilon));
+            Llight *= renderer->Transmittance(scene, connectRay, NULL, rng, arena);
 
-        // Possibly skip virtual light shadow ray with Russian roulette
-        if (Llight.y() < rrThreshold) {
-            float continueProbability = .1f;
-            if (rng.RandomFloat() > continueProbability)
-                continue;
-            Llight /= continueProbability;
-        }
+            // Possibly skip virtual light shadow ray with Russian roulette
+            if (Llight.y() < rrThreshold) {
+                float continueProbability = .1f;
+                if (rng.RandomFloat() > continueProbability)
+                    continue;
+                Llight /= continueProbability;
+            }
 
-        // Add contribution from _VirtualLight_ _vl_
-        if (!scene->IntersectP(connectRay))
-            L += Llight;
+            // Add contribution from _VirtualLight_ _vl_
+            if (!scene->IntersectP(connectRay))
+                L += Llight;
+        }
     }
     if (ray.depth < maxSpecularDepth) {
         // Do bias compensation for bounding geometry term
@@ -236,8 +492,12 @@ IGIIntegrator *CreateIGISurfaceIntegrator(const ParamSet &params) {
     int maxDepth = params.FindOneInt("maxdepth", 5);
     float glimit = params.FindOneFloat("glimit", 10.f);
     int gatherSamples = params.FindOneInt("gathersamples", 16);
+    bool lightcuts = params.FindOneBool("lightcuts", false);
+    float cutRelError = params.FindOneFloat("cutrelerror", .02f);
+    int maxCutSize = max(1, params.FindOneInt("maxcutsize", 512));
     return new IGIIntegrator(nLightPaths, nLightSets, rrThresh,
-                             maxDepth, glimit, gatherSamples);
+                             maxDepth, glimit, gatherSamples, lightcuts,
+                             cutRelError, maxCutSize);
 }
 
 
@@ -53,6 +53,20 @@ struct VirtualLight {
 };
 
 
+struct VirtualLightTreeNode {
+    // Bounds of the cluster's virtual lights and their (two-sided) normals
+    BBox bounds;
+    Vector coneAxis;
+    float coneAngle;
+    Spectrum intensity;
+    // Index of the cluster's representative _VirtualLight_
+    uint32_t vlIndex;
+    // Leaves have no children; interior nodes' first child follows them
+    uint32_t secondChildOffset;
+    bool isLeaf;
+};
+
+
 
 // IGIIntegrator Declarations
 class IGIIntegrator : public SurfaceIntegrator {
@@ -64,7 +78,8 @@ public:
         const Sample *sample, RNG &rng, MemoryArena &arena) const;
     void RequestSamples(Sampler *sampler, Sample *sample, const Scene *scene);
     void Preprocess(const Scene *, const Camera *, const Renderer *);
-    IGIIntegrator(uint32_t nl, uint32_t ns, float rrt, int maxd, float gl, int ng) {
+    IGIIntegrator(uint32_t nl, uint32_t ns, float rrt, int maxd, float gl, int ng,
+                  bool lc, float cre, int mcs) {
         nLightPaths = RoundUpPow2(nl);
         nLightSets = RoundUpPow2(ns);
         rrThreshold = rrt;
@@ -72,10 +87,23 @@ public:
         virtualLights.resize(nLightSets);
         gLimit = gl;
         nGatherSamples = ng;
+        useLightcuts = lc;
+        cutRelError = cre;
+        maxCutSize = mcs;
+        lightTrees.resize(nLightSets);
         lightSampleOffsets = NULL;
         bsdfSampleOffsets = NULL;
     }
 private:
+    // IGIIntegrator Private Methods
+    uint32_t BuildLightTree(vector<VirtualLightTreeNode> &tree,
+        const vector<VirtualLight> &vls, uint32_t *indices,
+        uint32_t start, uint32_t end, RNG &rng);
+    Spectrum LightcutLi(const Scene *scene, const Renderer *renderer,
+        const RayDifferential &ray, const Intersection &isect, BSDF *bsdf,
+        uint32_t lSet, const Spectrum &Ldirect, RNG &rng,
+        MemoryArena &arena) const;
+
     // IGIIntegrator Private Data
 
     // Declare sample parameters for light source sampling
@@ -89,6 +117,10 @@ private:
     int vlSetOffset;
     BSDFSampleOffsets gatherSampleOffset;
     vector<vector<VirtualLight> > virtualLights;
+    bool useLightcuts;
+    float cutRelError;
+    int maxCutSize;
+    vector<vector<VirtualLightTreeNode> > lightTrees;
 };
 
 
@@ -165,7 +165,6 @@ void IrradianceCacheIntegrator::Preprocess(const Scene *scene,
 
 IrradianceCacheIntegrator::~IrradianceCacheIntegrator() {
     delete octree;
-    RWMutex::Destroy(mutex);
     delete[] lightSampleOffsets;
     delete[] bsdfSampleOffsets;
 }
@@ -281,10 +280,9 @@ Spectrum IrradianceCacheIntegrator::indirectLo(const Point &p,
         sampleExtent.Expand(contribExtent);
         PBRT_IRRADIANCE_CACHE_ADDED_NEW_SAMPLE(const_cast<Point *>(&p), const_cast<Normal *>(&ng), contribExtent, &E, &wAvg, pixelSpacing);
 
-        // Allocate _IrradianceSample_, get write lock, add to octree
+        // Allocate _IrradianceSample_ and add to lock-free octree
         IrradianceSample *sample = new IrradianceSample(E, p, ng, wAvg,
                                                         contribExtent);
-        RWMutexLock lock(*mutex, WRITE);
         octree->Add(sample, sampleExtent);
         wi = wAvg;
     }
@@ -301,7 +299,6 @@ bool IrradianceCacheIntegrator::interpolateE(const Scene *scene,
     if (!octree) return false;
     PBRT_IRRADIANCE_CACHE_STARTED_INTERPOLATION(const_cast<Point *>(&p), const_cast<Normal *>(&n));
     IrradProcess proc(p, n, minWeight, cosMaxSampleAngleDifference);
-    RWMutexLock lock(*mutex, READ);
     octree->Lookup(p, proc);
     PBRT_IRRADIANCE_CACHE_FINISHED_INTERPOLATION(const_cast<Point *>(&p), const_cast<Normal *>(&n),
         proc.Successful() ? 1 : 0, proc.nFound);
@@ -58,7 +58,6 @@ public:
         nSamples = ns;
         maxSpecularDepth = maxspec;
         maxIndirectDepth = maxind;
-        mutex = RWMutex::Create();
         lightSampleOffsets = NULL;
         bsdfSampleOffsets = NULL;
     }
@@ -73,7 +72,6 @@ private:
     float minSamplePixelSpacing, maxSamplePixelSpacing;
     float minWeight, cosMaxSampleAngleDifference;
     int nSamples, maxSpecularDepth, maxIndirectDepth;
-    mutable RWMutex *mutex;
 
     // Declare sample parameters for light source sampling
     LightSampleOffsets *lightSampleOffsets;
@@ -35,8 +35,244 @@
 #include "scene.h"
 #include "intersection.h"
 #include "paramset.h"
+#include "parallel.h"
+#include "montecarlo.h"
+#include "lightbvh.h"
+
+// PathIntegrator Local Declarations
+#define PATH_STATS_DEPTH 16
+#ifdef PBRT_HAS_64_BIT_ATOMICS
+typedef AtomicInt64 PathStatsCount;
+typedef volatile double PathStatsSum;
+static inline void AddPathStat(PathStatsCount *v, int64_t delta) {
+    AtomicAdd(v, delta);
+}
+static inline void AddPathStat(PathStatsSum *v, double delta) {
+    AtomicAdd(v, delta);
+}
+#else
+// Without 64-bit atomics, merges are serialized by _pathStatsMutex_
+typedef int64_t PathStatsCount;
+typedef double PathStatsSum;
+static Mutex *pathStatsMutex = Mutex::Create();
+static inline void AddPathStat(PathStatsCount *v, int64_t delta) {
+    *v += delta;
+}
+static inline void AddPathStat(PathStatsSum *v, double delta) {
+    *v += delta;
+}
+#endif
+struct PathDepthStats {
+    PathDepthStats() {
+        paths = rays = lightSamples = bsdfSamples = scattered = 0;
+        rrTerminated = terminated = 0;
+        throughput = radiance = 0.;
+    }
+    PathStatsCount paths, rays, lightSamples, bsdfSamples, scattered;
+    PathStatsCount rrTerminated, terminated;
+    // Luminance sums
+    PathStatsSum throughput, radiance;
+};
+
+
+struct PathStatsRecord {
+    int paths, rays, lightSamples, bsdfSamples, scattered;
+    int rrTerminated, terminated;
+    float throughput, radiance;
+};
+
+
+static inline int PathStatsBucket(int depth) {
+    return min(depth, PATH_STATS_DEPTH - 1);
+}
+
+
+// Spatial-directional radiance histograms used for path guiding
+#define GUIDE_BINS 12
+#define GUIDE_MIN_SAMPLES 256
+class PathGuide {
+public:
+    // PathGuide Public Methods
+    PathGuide(const BBox &b, int res);
+    ~PathGuide();
+    int CellIndex(const Point &p) const;
+    bool Ready(int cell) const { return dists[cell] != NULL; }
+    void Splat(int cell, const Vector &w, float L);
+    Vector Sample(int cell, float u1, float u2, float *pdf) const;
+    float Pdf(int cell, const Vector &w) const;
+    int Refine();
+    int NumCells() const { return nCells; }
+private:
+    // PathGuide Private Methods
+    static void DirectionToUV(const Vector &w, float *u, float *v) {
+        *u = Clamp(.5f * (w.z + 1.f), 0.f, 1.f);
+        float phi = atan2f(w.y, w.x);
+        if (phi < 0.f) phi += 2.f * M_PI;
+        *v = Clamp(phi * INV_TWOPI, 0.f, 1.f);
+    }
+
+    // PathGuide Private Data
+    BBox bounds;
+    int nVoxels[3], nCells;
+    Vector invWidth;
+    volatile float *histograms;
+    AtomicInt32 *counts;
+    Distribution2D **dists;
+};
+
+
+PathGuide::PathGuide(const BBox &b, int res)
+    : bounds(b) {
+    // Size grid so that cells are roughly cubical
+    Vector delta = bounds.pMax - bounds.pMin;
+    float maxExtent = max(delta.x, max(delta.y, delta.z));
+    for (int i = 0; i < 3; ++i) {
+        nVoxels[i] = maxExtent > 0.f ?
+            Clamp(Round2Int(res * delta[i] / maxExtent), 1, res) : 1;
+        invWidth[i] = delta[i] > 0.f ? nVoxels[i] / delta[i] : 0.f;
+    }
+    nCells = nVoxels[0] * nVoxels[1] * nVoxels[2];
+    int nBins = nCells * GUIDE_BINS * GUIDE_BINS;
+    histograms = new float[nBins];
+    for (int i = 0; i < nBins; ++i)
+        histograms[i] = 0.f;
+    counts = new AtomicInt32[nCells];
+    dists = new Distribution2D *[nCells];
+    for (int i = 0; i < nCells; ++i) {
+        counts[i] = 0;
+        dists[i] = NULL;
+    }
+}
+
+
+PathGuide::~PathGuide() {
+    for (int i = 0; i < nCells; ++i)
+        delete dists[i];
+    delete[] dists;
+    delete[] counts;
+    delete[] histograms;
+}
+
+
+int PathGuide::CellIndex(const Point &p) const {
+    int v[3];
+    for (int i = 0; i < 3; ++i)
+        v[i] = Clamp(Float2Int((p[i] - bounds.pMin[i]) * invWidth[i]), 0,
+                     nVoxels[i] - 1);
+    return (v[2] * nVoxels[1] + v[1]) * nVoxels[0] + v[0];
+}
+
+
+void PathGuide::Splat(int cell, const Vector &w, float L) {
+    float u, v;
+    DirectionToUV(w, &u, &v);
+    int iu = Clamp(Float2Int(u * GUIDE_BINS), 0, GUIDE_BINS - 1);
+    int iv = Clamp(Float2Int(v * GUIDE_BINS), 0, GUIDE_BINS - 1);
+    if (L > 0.f)
+        AtomicAdd(&histograms[(cell * GUIDE_BINS + iv) * GUIDE_BINS + iu], L);
+    AtomicAdd(&counts[cell], 1);
+}
+
+
+Vector PathGuide::Sample(int cell, float u1, float u2, float *pdf) const {
+    // Sample the cell's histogram and map to the sphere, which has area $4\pi$
+    float uv[2], mapPdf;
+    dists[cell]->SampleContinuous(u1, u2, uv, &mapPdf);
+    float z = 2.f * uv[0] - 1.f;
+    float r = sqrtf(max(0.f, 1.f - z*z));
+    float phi = 2.f * M_PI * uv[1];
+    *pdf = mapPdf * INV_FOURPI;
+    return Vector(r * cosf(phi), r * sinf(phi), z);
+}
+
+
+float PathGuide::Pdf(int cell, const Vector &w) const {
+    float u, v;
+    DirectionToUV(w, &u, &v);
+    return dists[cell]->Pdf(u, v) * INV_FOURPI;
+}
+
+
+int PathGuide::Refine() {
+    // Rebuild sampling distributions for cells with enough training data
+    float data[GUIDE_BINS * GUIDE_BINS];
+    int nReady = 0;
+    for (int c = 0; c < nCells; ++c) {
+        if (counts[c] < GUIDE_MIN_SAMPLES) continue;
+        const volatile float *h = &histograms[c * GUIDE_BINS * GUIDE_BINS];
+        float sum = 0.f;
+        for (int i = 0; i < GUIDE_BINS * GUIDE_BINS; ++i)
+            sum += h[i];
+        if (sum <= 0.f) continue;
+        // Keep a small uniform component so no direction has zero density
+        float minDensity = .1f * sum / (GUIDE_BINS * GUIDE_BINS);
+        for (int i = 0; i < GUIDE_BINS * GUIDE_BINS; ++i)
+            data[i] = h[i] + minDensity;
+        delete dists[c];
+        dists[c] = new Distribution2D(data, GUIDE_BINS, GUIDE_BINS);
+        ++nReady;
+    }
+    return nReady;
+}
+
+
+struct GuideVertex {
+    int cell;
+    Vector wi;
+    float throughput, L;
+};
+
+
 
 // PathIntegrator Method Definitions
+PathIntegrator::PathIntegrator(int md, int rrd, bool arr, bool stats,
+                               const string &statsfile, bool guide,
+                               int guideres, float guidefrac, bool lightbvh)
+    : statsFilename(statsfile) {
+    maxDepth = md;
+    rrDepth = rrd;
+    adaptiveRR = arr;
+    reportStats = stats || statsFilename != "";
+    // Adaptive Russian roulette is driven by the per-depth statistics
+    depthStats = (reportStats || adaptiveRR) ?
+        new PathDepthStats[PATH_STATS_DEPTH] : NULL;
+    useGuiding = guide;
+    guideResolution = guideres;
+    guideFraction = Clamp(guidefrac, 0.f, 1.f);
+    this->guide = NULL;
+    useLightBVH = lightbvh;
+    lightBVH = NULL;
+}
+
+
+PathIntegrator::~PathIntegrator() {
+    if (reportStats) ReportStats();
+    delete[] depthStats;
+    delete guide;
+    delete lightBVH;
+}
+
+
+void PathIntegrator::Preprocess(const Scene *scene, const Camera *camera,
+                                const Renderer *renderer) {
+    if (useGuiding) {
+        BBox bounds = scene->WorldBound();
+        bounds.Expand(1e-3f * Distance(bounds.pMin, bounds.pMax));
+        guide = new PathGuide(bounds, guideResolution);
+    }
+    if (useLightBVH && !lightBVH)
+        lightBVH = new LightBVH(scene);
+}
+
+
+void PathIntegrator::FinishPass(const Scene *scene, const Camera *camera,
+                                const Renderer *renderer) {
+    if (!guide) return;
+    int nReady = guide->Refine();
+    Info("Path guiding: %d of %d cells trained", nReady, guide->NumCells());
+}
+
+
 void PathIntegrator::RequestSamples(Sampler *sampler, Sample *sample,
                                     const Scene *scene) {
     for (int i = 0; i < SAMPLE_DEPTH; ++i) {
@@ -48,6 +284,21 @@ void PathIntegrator::RequestSamples(Sampler *sampler, Sample *sample,
 }
 
 
+float PathIntegrator::ContinueProbability(int bucket, float y) const {
+    if (adaptiveRR) {
+        // Compare throughput to the mean throughput seen at this depth
+        const PathDepthStats &ds = depthStats[bucket];
+        int64_t n = ds.scattered;
+        if (n >= 256) {
+            float meanY = float(ds.throughput / n);
+            if (meanY > 0.f)
+                return Clamp(y / meanY, .05f, 1.f);
+        }
+    }
+    return min(.5f, y);
+}
+
+
 Spectrum PathIntegrator::Li(const Scene *scene, const Renderer *renderer,
         const RayDifferential &r, const Intersection &isect,
         const Sample *sample, RNG &rng, MemoryArena &arena) const {
@@ -58,10 +309,35 @@ Spectrum PathIntegrator::Li(const Scene *scene, const Renderer *renderer,
     Intersection localIsect;
     const Intersection *isectp = &isect;
     BSDF *firstBSDF = NULL;
-    for (int bounces = 0; ; ++bounces) {
+
+    // Set up local per-depth statistics for this path
+    PathStatsRecord localStats[PATH_STATS_DEPTH];
+    PathStatsRecord *stats = NULL;
+    if (depthStats) {
+        memset(localStats, 0, sizeof(localStats));
+        stats = localStats;
+    }
+    int bounces;
+    bool rrTerminated = false;
+
+    // Allocate vertex records for training the guiding histograms
+    GuideVertex *guideVertices = guide ?
+        arena.Alloc<GuideVertex>(maxDepth + 1) : NULL;
+    int nGuideVertices = 0;
+    float guideL = 0.f;
+    for (bounces = 0; ; ++bounces) {
+        PathStatsRecord *ps = stats ?
+            &stats[PathStatsBucket(r.depth + bounces)] : NULL;
+        if (ps) ++ps->paths;
+        Spectrum Ld(0.f);
+
         // Possibly add emitted light at path vertex
         if (bounces == 0 || specularBounce)
-            L += pathThroughput * isectp->Le(-ray.d);
+            Ld += pathThroughput * isectp->Le(-ray.d);
+        else if (guide) {
+            Spectrum Le = pathThroughput * isectp->Le(-ray.d);
+            guideL += Le.y();
+        }
 
         // Sample illumination from lights to find path contribution
         BSDF *bsdf = isectp->GetBSDF(ray, arena);
@@ -79,15 +355,22 @@ Spectrum PathIntegrator::Li(const Scene *scene, const Renderer *renderer,
         	isect.secondNormal = n;
         }
         if (bounces < SAMPLE_DEPTH)
-            L += pathThroughput *
+            Ld += pathThroughput *
                  UniformSampleOneLight(scene, renderer, arena, p, n, wo,
                      isectp->rayEpsilon, ray.time, bsdf, sample, rng,
                      lightNumOffset[bounces], &lightSampleOffsets[bounces],
-                     &bsdfSampleOffsets[bounces]);
+                     &bsdfSampleOffsets[bounces], lightBVH);
         else
-            L += pathThroughput *
+            Ld += pathThroughput *
                  UniformSampleOneLight(scene, renderer, arena, p, n, wo,
-                     isectp->rayEpsilon, ray.time, bsdf, sample, rng);
+                     isectp->rayEpsilon, ray.time, bsdf, sample, rng,
+                     -1, NULL, NULL, lightBVH);
+        L += Ld;
+        guideL += Ld.y();
+        if (ps) {
+            if (scene->lights.size() > 0) ++ps->lightSamples;
+            ps->radiance += Ld.y();
+        }
 
         // Sample BSDF to get new path direction
 
@@ -101,29 +384,88 @@ Spectrum PathIntegrator::Li(const Scene *scene, const Renderer *renderer,
         Vector wi;
         float pdf;
         BxDFType flags;
-        Spectrum f = bsdf->Sample_f(wo, &wi, outgoingBSDFSample, &pdf,
-                                    BSDF_ALL, &flags);
+        Spectrum f;
+        // Guide only purely diffuse surfaces; BSDF sampling of glossy and
+        // specular lobes is already better than the guiding histograms
+        int guideCell = guide ? guide->CellIndex(p) : -1;
+        if (guideCell >= 0 && guide->Ready(guideCell) &&
+            bsdf->NumComponents(BxDFType(BSDF_ALL & ~BSDF_DIFFUSE)) == 0) {
+            // Sample BSDF or guiding distribution with one-sample MIS
+            float uc = outgoingBSDFSample.uComponent;
+            if (uc < guideFraction) {
+                float guidePdf;
+                wi = guide->Sample(guideCell, outgoingBSDFSample.uDir[0],
+                                   outgoingBSDFSample.uDir[1], &guidePdf);
+                f = bsdf->f(wo, wi);
+                pdf = guideFraction * guidePdf +
+                      (1.f - guideFraction) * bsdf->Pdf(wo, wi);
+                flags = BxDFType(BSDF_ALL & ~BSDF_SPECULAR);
+            }
+            else {
+                outgoingBSDFSample.uComponent =
+                    min((uc - guideFraction) / (1.f - guideFraction),
+                        OneMinusEpsilon);
+                f = bsdf->Sample_f(wo, &wi, outgoingBSDFSample, &pdf,
+                                   BSDF_ALL, &flags);
+                if (pdf > 0.f)
+                    pdf = (1.f - guideFraction) * pdf +
+                          guideFraction * guide->Pdf(guideCell, wi);
+            }
+        }
+        else
+            f = bsdf->Sample_f(wo, &wi, outgoingBSDFSample, &pdf,
+                               BSDF_ALL, &flags);
+        if (ps) ++ps->bsdfSamples;
         if (f.IsBlack() || pdf == 0.)
             break;
         specularBounce = (flags & BSDF_SPECULAR) != 0;
         pathThroughput *= f * AbsDot(wi, n) / pdf;
         ray = RayDifferential(p, wi, ray, isectp->rayEpsilon);
+        if (ps) {
+            ++ps->scattered;
+            ps->throughput += pathThroughput.y();
+        }
 
-        // Possibly terminate the path                        
-        if (bounces > 3) {
-            float continueProbability = min(.5f, pathThroughput.y());
-            if (rng.RandomFloat() > continueProbability)
+        // Possibly terminate the path
+        if (bounces > rrDepth) {
+            float continueProbability =
+                ContinueProbability(PathStatsBucket(r.depth + bounces),
+                                    pathThroughput.y());
+            if (rng.RandomFloat() > continueProbability) {
+                rrTerminated = true;
                 break;
+            }
             pathThroughput /= continueProbability;
-        }        
+        }
         if (bounces == maxDepth)
             break;
 
+        // Record path vertex for guiding
+        if (guideCell >= 0) {
+            GuideVertex &gv = guideVertices[nGuideVertices++];
+            gv.cell = guideCell;
+            gv.wi = wi;
+            gv.throughput = pathThroughput.y();
+            gv.L = guideL;
+        }
+
         // Find next vertex of path
+        if (ps) ++ps->rays;
         if (!scene->Intersect(ray, &localIsect)) {
-            if (specularBounce)
+            if (specularBounce) {
+                Spectrum Le(0.f);
                 for (uint32_t i = 0; i < scene->lights.size(); ++i)
-                   L += pathThroughput * scene->lights[i]->Le(ray);
+                   Le += pathThroughput * scene->lights[i]->Le(ray);
+                L += Le;
+                guideL += Le.y();
+                if (ps) ps->radiance += Le.y();
+            }
+            else if (guide) {
+                Spectrum Le(0.f);
+                for (uint32_t i = 0; i < scene->lights.size(); ++i)
+                   Le += pathThroughput * scene->lights[i]->Le(ray);
+                guideL += Le.y();
+            }
             break;
         }
         pathThroughput *= renderer->Transmittance(scene, ray, NULL, rng, arena);
@@ -133,6 +475,44 @@ Spectrum PathIntegrator::Li(const Scene *scene, const Renderer *renderer,
             break;
     }
 
+    // Train guiding histograms with radiance arriving at each vertex,
+    // including emission that was only counted through light sampling
+    for (int i = 0; i < nGuideVertices; ++i) {
+        const GuideVertex &gv = guideVertices[i];
+        if (gv.throughput > 0.f)
+            guide->Splat(gv.cell, gv.wi,
+                         max(0.f, guideL - gv.L) / gv.throughput);
+    }
+
+    // Merge this path's statistics into the shared per-depth counters
+    if (stats) {
+        PathStatsRecord &end = stats[PathStatsBucket(r.depth + bounces)];
+        ++end.terminated;
+        if (rrTerminated) ++end.rrTerminated;
+        int last = PathStatsBucket(r.depth + bounces);
+#ifndef PBRT_HAS_64_BIT_ATOMICS
+        MutexLock lock(*pathStatsMutex);
+#endif
+        for (int i = PathStatsBucket(r.depth); i <= last; ++i) {
+            const PathStatsRecord &ps = stats[i];
+            PathDepthStats &ds = depthStats[i];
+            AddPathStat(&ds.paths, ps.paths);
+            AddPathStat(&ds.rays, ps.rays);
+            AddPathStat(&ds.lightSamples, ps.lightSamples);
+            AddPathStat(&ds.bsdfSamples, ps.bsdfSamples);
+            if (ps.scattered) {
+                AddPathStat(&ds.scattered, ps.scattered);
+                AddPathStat(&ds.throughput, ps.throughput);
+            }
+            if (ps.radiance != 0.f)
+                AddPathStat(&ds.radiance, ps.radiance);
+            if (ps.terminated) {
+                AddPathStat(&ds.terminated, ps.terminated);
+                AddPathStat(&ds.rrTerminated, ps.rrTerminated);
+            }
+        }
+    }
+
     if (specularBounce && r.depth + 1 < maxDepth) {
         Vector wi;
         // Trace rays for specular reflection and refraction
@@ -146,9 +526,63 @@ Spectrum PathIntegrator::Li(const Scene *scene, const Renderer *renderer,
 }
 
 
-PathIntegrator *CreatePathSurfaceIntegrator(const ParamSet &params) {
-    int maxDepth = params.FindOneInt("maxdepth", 5);
-    return new PathIntegrator(maxDepth);
+void PathIntegrator::ReportStats() const {
+    FILE *f = stdout;
+    if (statsFilename != "") {
+        f = fopen(statsFilename.c_str(), "w");
+        if (!f) {
+            Error("Unable to open path statistics file \"%s\"",
+                  statsFilename.c_str());
+            return;
+        }
+    }
+    double totalRadiance = 0.;
+    for (int i = 0; i < PATH_STATS_DEPTH; ++i)
+        totalRadiance += depthStats[i].radiance;
+    fprintf(f, "Path statistics per depth:\n");
+    fprintf(f, "%5s %12s %12s %12s %12s %12s %12s %10s %10s\n", "depth",
+            "paths", "rays", "shadow", "bsdf", "terminated", "roulette",
+            "throughput", "radiance");
+    for (int i = 0; i < PATH_STATS_DEPTH; ++i) {
+        const PathDepthStats &ds = depthStats[i];
+        if (ds.paths == 0) continue;
+        int64_t scattered = ds.scattered;
+        float meanY = scattered ?
+            float(ds.throughput / scattered) : 0.f;
+        float frac = totalRadiance > 0. ?
+            float(100. * ds.radiance / totalRadiance) : 0.f;
+        fprintf(f, "%4d%s %12lld %12lld %12lld %12lld %12lld %12lld "
+                "%10.4f %9.2f%%\n", i, i == PATH_STATS_DEPTH - 1 ? "+" : " ",
+                (long long)ds.paths, (long long)ds.rays,
+                (long long)ds.lightSamples, (long long)ds.bsdfSamples,
+                (long long)ds.terminated, (long long)ds.rrTerminated,
+                meanY, frac);
+    }
+    if (f != stdout) fclose(f);
 }
 
 
+PathIntegrator *CreatePathSurfaceIntegrator(const ParamSet &params) {
+    int maxDepth = params.FindOneInt("maxdepth", 5);
+    int rrDepth = params.FindOneInt("rrdepth", 3);
+    bool adaptiveRR = params.FindOneBool("adaptiverr", false);
+    bool stats = params.FindOneBool("pathstats", false);
+    string statsFile = params.FindOneFilename("pathstatsfile", "");
+    bool guiding = params.FindOneBool("guiding", false);
+    int guideRes = params.FindOneInt("guideresolution", 16);
+    if (guideRes < 1) {
+        Error("\"guideresolution\" must be at least 1 (got %d). Using 1.",
+              guideRes);
+        guideRes = 1;
+    }
+    float guideFrac = params.FindOneFloat("guidefraction", .5f);
+    string ls = params.FindOneString("lightsampling", "uniform");
+    if (ls != "uniform" && ls != "bvh") {
+        Warning("Light sampling \"%s\" for path integrator unknown. "
+            "Using \"uniform\".", ls.c_str());
+        ls = "uniform";
+    }
+    return new PathIntegrator(maxDepth, rrDepth, adaptiveRR, stats,
+                              statsFile, guiding, guideRes, guideFrac,
+                              ls == "bvh");
+}
@@ -41,6 +41,8 @@
 #include "integrator.h"
 
 // PathIntegrator Declarations
+struct PathDepthStats;
+class PathGuide;
 class PathIntegrator : public SurfaceIntegrator {
 public:
     // PathIntegrator Public Methods
@@ -48,10 +50,30 @@ public:
         const RayDifferential &ray, const Intersection &isect,
         const Sample *sample, RNG &rng, MemoryArena &arena) const;
     void RequestSamples(Sampler *sampler, Sample *sample, const Scene *scene);
-    PathIntegrator(int md) { maxDepth = md; }
+    PathIntegrator(int md, int rrd, bool arr, bool stats,
+                   const string &statsfile, bool guide, int guideres,
+                   float guidefrac, bool lightbvh);
+    ~PathIntegrator();
+    void Preprocess(const Scene *scene, const Camera *camera,
+                    const Renderer *renderer);
+    void FinishPass(const Scene *scene, const Camera *camera,
+                    const Renderer *renderer);
 private:
+    // PathIntegrator Private Methods
+    float ContinueProbability(int bucket, float y) const;
+    void ReportStats() const;
+
     // PathIntegrator Private Data
-    int maxDepth;
+    int maxDepth, rrDepth;
+    bool adaptiveRR, reportStats;
+    string statsFilename;
+    PathDepthStats *depthStats;
+    bool useGuiding;
+    int guideResolution;
+    float guideFraction;
+    PathGuide *guide;
+    bool useLightBVH;
+    LightBVH *lightBVH;
 #define SAMPLE_DEPTH 3
     LightSampleOffsets lightSampleOffsets[SAMPLE_DEPTH];
     int lightNumOffset[SAMPLE_DEPTH];
@@ -40,6 +40,7 @@
 #include "intersection.h"
 #include "paramset.h"
 #include "camera.h"
+#include "timer.h"
 
 
 // PhotonIntegrator Local Declarations
@@ -53,45 +54,65 @@ struct Photon {
 };
 
 
+struct RadiancePhoton {
+    RadiancePhoton(const Point &pp, const Normal &nn)
+        : p(pp), n(nn), Lo(0.f) { }
+    RadiancePhoton() { }
+    Point p;
+    Normal n;
+    Spectrum Lo;
+};
+
+
 class PhotonShootingTask : public Task {
 public:
-    PhotonShootingTask(int tn, float ti, Mutex &m, PhotonIntegrator *in,
-        ProgressReporter &prog, bool &at, int &ndp,
-        vector<Photon> &direct, vector<Photon> &indir, vector<Photon> &caustic,
-        vector<RadiancePhoton> &rps, vector<Spectrum> &rpR, vector<Spectrum> &rpT,
-        uint32_t &ns, Distribution1D *distrib, const Scene *sc,
-        const Renderer *sr)
-    : taskNum(tn), time(ti), mutex(m), integrator(in), progress(prog),
-      abortTasks(at), nDirectPaths(ndp),
-      directPhotons(direct), indirectPhotons(indir), causticPhotons(caustic),
-      radiancePhotons(rps), rpReflectances(rpR), rpTransmittances(rpT),
+    PhotonShootingTask(int tn, float ti, PhotonIntegrator *in,
+        ProgressReporter &prog, AtomicInt32 &at, AtomicInt32 &ndp,
+        AtomicInt32 &nip, AtomicInt32 &ncp, AtomicInt32 &nis,
+        AtomicInt32 &ncs, AtomicInt32 &ns, Distribution1D *distrib,
+        const Scene *sc, const Renderer *sr)
+    : taskNum(tn), time(ti), integrator(in), progress(prog),
+      abortTasks(at), nDirectPaths(ndp), nIndirectPaths(nip),
+      nCausticPaths(ncp), nIndirectStored(nis), nCausticStored(ncs),
       nshot(ns), lightDistribution(distrib), scene(sc), renderer (sr) { }
     void Run();
 
     int taskNum;
     float time;
-    Mutex &mutex;
     PhotonIntegrator *integrator;
     ProgressReporter &progress;
-    bool &abortTasks;
-    int &nDirectPaths;
-    vector<Photon> &directPhotons, &indirectPhotons, &causticPhotons;
-    vector<RadiancePhoton> &radiancePhotons;
-    vector<Spectrum> &rpReflectances, &rpTransmittances;
-    uint32_t &nshot;
+    AtomicInt32 &abortTasks;
+    AtomicInt32 &nDirectPaths, &nIndirectPaths, &nCausticPaths;
+    AtomicInt32 &nIndirectStored, &nCausticStored;
+    AtomicInt32 &nshot;
     const Distribution1D *lightDistribution;
     const Scene *scene;
     const Renderer *renderer;
+
+    // Photons deposited by this task, merged once all tasks finish
+    vector<Photon> directPhotons, indirectPhotons, causticPhotons;
+    vector<RadiancePhoton> radiancePhotons;
+    vector<Spectrum> rpReflectances, rpTransmittances;
 };
 
 
-struct RadiancePhoton {
-    RadiancePhoton(const Point &pp, const Normal &nn)
-        : p(pp), n(nn), Lo(0.f) { }
-    RadiancePhoton() { }
-    Point p;
-    Normal n;
-    Spectrum Lo;
+class PhotonMergeTask : public Task {
+public:
+    PhotonMergeTask(PhotonShootingTask *st, bool ma,
+        vector<Photon> &direct, vector<Photon> &indir, vector<Photon> &caustic,
+        vector<RadiancePhoton> &rps, vector<Spectrum> &rpR, vector<Spectrum> &rpT,
+        AtomicInt32 *offs)
+    : shootingTask(st), mergeAll(ma), directPhotons(direct),
+      indirectPhotons(indir), causticPhotons(caustic), radiancePhotons(rps),
+      rpReflectances(rpR), rpTransmittances(rpT), offsets(offs) { }
+    void Run();
+
+    PhotonShootingTask *shootingTask;
+    bool mergeAll;
+    vector<Photon> &directPhotons, &indirectPhotons, &causticPhotons;
+    vector<RadiancePhoton> &radiancePhotons;
+    vector<Spectrum> &rpReflectances, &rpTransmittances;
+    AtomicInt32 *offsets;
 };
 
 
@@ -101,9 +122,9 @@ public:
         vector<RadiancePhoton> &rps, const vector<Spectrum> &rhor,
         const vector<Spectrum> &rhot,
         uint32_t nlookup, float md2,
-        int ndirect, KdTree<Photon> *direct,
-        int nindirect, KdTree<Photon> *indirect,
-        int ncaus, KdTree<Photon> *caustic)
+        int ndirect, BucketKdTree<Photon> *direct,
+        int nindirect, BucketKdTree<Photon> *indirect,
+        int ncaus, BucketKdTree<Photon> *caustic)
         : progress(prog), taskNum(tn), numTasks(nt), radiancePhotons(rps),
           rpReflectances(rhor), rpTransmittances(rhot), nLookup(nlookup),
           maxDistSquared(md2),
@@ -119,7 +140,7 @@ private:
     uint32_t nLookup;
     float maxDistSquared;
     int nDirectPaths, nIndirectPaths, nCausticPaths;
-    KdTree<Photon> *directMap, *indirectMap, *causticMap;
+    BucketKdTree<Photon> *directMap, *indirectMap, *causticMap;
 };
 
 
@@ -171,11 +192,47 @@ struct RadiancePhotonProcess {
 };
 
 
+// Radiance photons bucketed by grid cell and normal octant; answers the
+// nearest-with-facing-normal query by searching rings of cells outward
+class RadiancePhotonGrid {
+public:
+    RadiancePhotonGrid(const vector<RadiancePhoton> &rps);
+    ~RadiancePhotonGrid() {
+        FreeAligned(bucketStart);
+        FreeAligned(keys);
+        FreeAligned(photons);
+    }
+    bool Lookup(const Point &p, const Normal &n,
+                const RadiancePhoton **photon) const;
+private:
+    // RadiancePhotonGrid Private Methods
+    friend class RadiancePhotonGridTask;
+    uint64_t cellKey(int ix, int iy, int iz) const {
+        return ((uint64_t)ix << 38) | ((uint64_t)iy << 19) | (uint64_t)iz;
+    }
+    uint32_t bucket(uint64_t cell) const {
+        return (uint32_t)((cell * 0x9E3779B97F4A7C15ull) >> (64 - logTableSize));
+    }
+    static uint32_t octant(const Normal &n) {
+        return (n.x < 0.f ? 1 : 0) | (n.y < 0.f ? 2 : 0) | (n.z < 0.f ? 4 : 0);
+    }
+
+    // RadiancePhotonGrid Private Data
+    BBox bounds;
+    float cellSize, invCellSize;
+    int nCells[3];
+    uint32_t nPhotons, logTableSize;
+    uint32_t *bucketStart;
+    uint64_t *keys;
+    RadiancePhoton *photons;
+};
+
+
 inline float kernel(const Photon *photon, const Point &p, float maxDist2);
-static Spectrum LPhoton(KdTree<Photon> *map, int nPaths, int nLookup,
+static Spectrum LPhoton(BucketKdTree<Photon> *map, int nPaths, int nLookup,
     ClosePhoton *lookupBuf, BSDF *bsdf, RNG &rng, const Intersection &isect,
     const Vector &w, float maxDistSquared);
-static Spectrum EPhoton(KdTree<Photon> *map, int count, int nLookup,
+static Spectrum EPhoton(BucketKdTree<Photon> *map, int count, int nLookup,
     ClosePhoton *lookupBuf, float maxDist2, const Point &p, const Normal &n);
 
 // PhotonIntegrator Local Definitions
@@ -186,21 +243,17 @@ inline bool unsuccessful(uint32_t needed, uint32_t found, uint32_t shot) {
 
 inline void PhotonProcess::operator()(const Point &p,
         const Photon &photon, float distSquared, float &maxDistSquared) {
-    if (nFound < nLookup) {
-        // Add photon to unordered array of photons
-        photons[nFound++] = ClosePhoton(&photon, distSquared);
-        if (nFound == nLookup) {
-            std::make_heap(&photons[0], &photons[nLookup]);
-            maxDistSquared = photons[0].distanceSquared;
-        }
-    }
-    else {
-        // Remove most distant photon from heap and add new photon
-        std::pop_heap(&photons[0], &photons[nLookup]);
-        photons[nLookup-1] = ClosePhoton(&photon, distSquared);
-        std::push_heap(&photons[0], &photons[nLookup]);
-        maxDistSquared = photons[0].distanceSquared;
+    // Insert photon into array of photons sorted by distance
+    uint32_t i = (nFound < nLookup) ? nFound++ : nLookup-1;
+    while (i > 0 && photons[i-1].distanceSquared > distSquared) {
+        photons[i] = photons[i-1];
+        --i;
     }
+    photons[i] = ClosePhoton(&photon, distSquared);
+
+    // Shrink lookup radius to the farthest photon once the array is full
+    if (nFound == nLookup)
+        maxDistSquared = photons[nLookup-1].distanceSquared;
 }
 
 
@@ -211,7 +264,7 @@ inline float kernel(const Photon *photon, const Point &p,
 }
 
 
-Spectrum LPhoton(KdTree<Photon> *map, int nPaths, int nLookup,
+Spectrum LPhoton(BucketKdTree<Photon> *map, int nPaths, int nLookup,
       ClosePhoton *lookupBuf, BSDF *bsdf, RNG &rng,
       const Intersection &isect, const Vector &wo, float maxDist2) {
     Spectrum L(0.);
@@ -260,7 +313,7 @@ Spectrum LPhoton(KdTree<Photon> *map, int nPaths, int nLookup,
 }
 
 
-Spectrum EPhoton(KdTree<Photon> *map, int count, int nLookup,
+Spectrum EPhoton(BucketKdTree<Photon> *map, int count, int nLookup,
         ClosePhoton *lookupBuf, float maxDist2, const Point &p,
         const Normal &n) {
     if (!map) return 0.f;
@@ -282,6 +335,191 @@ Spectrum EPhoton(KdTree<Photon> *map, int count, int nLookup,
 
 
 
+// RadiancePhotonGrid Method Definitions
+class RadiancePhotonGridTask : public Task {
+public:
+    enum Phase { COUNT, SCATTER, SORT };
+    RadiancePhotonGridTask(RadiancePhotonGrid *g, Phase ph, uint32_t s,
+        uint32_t e, const vector<RadiancePhoton> &rps, AtomicInt32 *c,
+        uint32_t *o)
+        : grid(g), phase(ph), start(s), end(e), radiancePhotons(rps),
+          counters(c), order(o) { }
+    void Run();
+private:
+    RadiancePhotonGrid *grid;
+    Phase phase;
+    uint32_t start, end;
+    const vector<RadiancePhoton> &radiancePhotons;
+    AtomicInt32 *counters;
+    uint32_t *order;
+};
+
+
+struct CompareGridKey {
+    CompareGridKey(const uint64_t *k) : keys(k) { }
+    bool operator()(uint32_t a, uint32_t b) const {
+        return keys[a] == keys[b] ? a < b : keys[a] < keys[b];
+    }
+    const uint64_t *keys;
+};
+
+
+void RadiancePhotonGridTask::Run() {
+    switch (phase) {
+    case COUNT:
+        // Compute cell and octant key of each photon and count per bucket
+        for (uint32_t i = start; i < end; ++i) {
+            const RadiancePhoton &rp = radiancePhotons[i];
+            Vector o = (rp.p - grid->bounds.pMin) * grid->invCellSize;
+            int ix = Clamp(Float2Int(o.x), 0, grid->nCells[0]-1);
+            int iy = Clamp(Float2Int(o.y), 0, grid->nCells[1]-1);
+            int iz = Clamp(Float2Int(o.z), 0, grid->nCells[2]-1);
+            uint64_t cell = grid->cellKey(ix, iy, iz);
+            grid->keys[i] = (cell << 3) | RadiancePhotonGrid::octant(rp.n);
+            AtomicAdd(&counters[grid->bucket(cell)], 1);
+        }
+        break;
+    case SCATTER:
+        // Place photon indices at atomically reserved slots of their bucket
+        for (uint32_t i = start; i < end; ++i) {
+            uint32_t b = grid->bucket(grid->keys[i] >> 3);
+            order[AtomicAdd(&counters[b], 1) - 1] = i;
+        }
+        break;
+    case SORT:
+        // Sort each bucket by cell and octant for deterministic scans
+        for (uint32_t b = start; b < end; ++b)
+            std::sort(&order[grid->bucketStart[b]],
+                      &order[grid->bucketStart[b+1]],
+                      CompareGridKey(grid->keys));
+        break;
+    }
+}
+
+
+RadiancePhotonGrid::RadiancePhotonGrid(const vector<RadiancePhoton> &rps) {
+    nPhotons = rps.size();
+    for (uint32_t i = 0; i < nPhotons; ++i)
+        bounds = Union(bounds, rps[i].p);
+    bounds.Expand(1e-3f * (1.f + Distance(bounds.pMin, bounds.pMax)));
+
+    // Choose cell size for a few photons per occupied cell; photons lie on
+    // surfaces, so occupied cells grow with the square of the resolution
+    Vector diag = bounds.pMax - bounds.pMin;
+    float maxExtent = max(diag.x, max(diag.y, diag.z));
+    int res = Clamp(Float2Int(sqrtf(nPhotons / 4.f)), 1, 1 << 18);
+    cellSize = maxExtent / res;
+    invCellSize = 1.f / cellSize;
+    for (int axis = 0; axis < 3; ++axis)
+        nCells[axis] = Clamp(Ceil2Int(diag[axis] * invCellSize), 1, 1 << 18);
+    logTableSize = Log2Int(RoundUpPow2(max(nPhotons, 2u)));
+    uint32_t tableSize = 1u << logTableSize;
+
+    // Bucket photons in parallel: count, prefix sum, scatter, sort
+    keys = AllocAligned<uint64_t>(max(nPhotons, 1u));
+    bucketStart = AllocAligned<uint32_t>(tableSize + 1);
+    AtomicInt32 *counters = new AtomicInt32[tableSize];
+    memset((void *)counters, 0, tableSize * sizeof(AtomicInt32));
+    uint32_t *order = new uint32_t[max(nPhotons, 1u)];
+    RadiancePhotonGridTask::Phase phases[3] = { RadiancePhotonGridTask::COUNT,
+        RadiancePhotonGridTask::SCATTER, RadiancePhotonGridTask::SORT };
+    uint32_t nTasks = 8 * NumSystemCores();
+    for (int ph = 0; ph < 3; ++ph) {
+        uint32_t n = (ph == 2) ? tableSize : nPhotons;
+        vector<Task *> gridTasks;
+        for (uint32_t t = 0; t < nTasks; ++t)
+            gridTasks.push_back(new RadiancePhotonGridTask(this, phases[ph],
+                uint64_t(n) * t / nTasks, uint64_t(n) * (t+1) / nTasks,
+                rps, counters, order));
+        EnqueueTasks(gridTasks);
+        WaitForAllTasks();
+        for (uint32_t t = 0; t < gridTasks.size(); ++t)
+            delete gridTasks[t];
+        if (ph == 0) {
+            // Compute bucket offsets and reset counters as scatter cursors
+            bucketStart[0] = 0;
+            for (uint32_t b = 0; b < tableSize; ++b) {
+                bucketStart[b+1] = bucketStart[b] + counters[b];
+                counters[b] = bucketStart[b];
+            }
+        }
+    }
+
+    // Store photons and keys in bucket order
+    uint64_t *unsortedKeys = keys;
+    keys = AllocAligned<uint64_t>(max(nPhotons, 1u));
+    photons = AllocAligned<RadiancePhoton>(max(nPhotons, 1u));
+    for (uint32_t i = 0; i < nPhotons; ++i) {
+        keys[i] = unsortedKeys[order[i]];
+        photons[i] = rps[order[i]];
+    }
+    FreeAligned(unsortedKeys);
+    delete[] order;
+    delete[] counters;
+}
+
+
+bool RadiancePhotonGrid::Lookup(const Point &p, const Normal &n,
+        const RadiancePhoton **photon) const {
+    // Photons in the octant opposite _n_ can never face the query
+    uint32_t skipOctant = 7 ^ octant(n);
+    Vector o = (p - bounds.pMin) * invCellSize;
+    int cx = Floor2Int(o.x), cy = Floor2Int(o.y), cz = Floor2Int(o.z);
+    const RadiancePhoton *best = NULL;
+    float bestDist2 = INFINITY;
+    const int maxRing = 3;
+    for (int r = 0; r <= maxRing; ++r) {
+        // Visit the cells at Chebyshev distance _r_ from the query cell
+        for (int iz = cz - r; iz <= cz + r; ++iz) {
+            if (iz < 0 || iz >= nCells[2]) continue;
+            for (int iy = cy - r; iy <= cy + r; ++iy) {
+                if (iy < 0 || iy >= nCells[1]) continue;
+                bool onShell = (abs(iz - cz) == r || abs(iy - cy) == r);
+                int xStep = onShell ? 1 : max(2 * r, 1);
+                for (int ix = cx - r; ix <= cx + r; ix += xStep) {
+                    if (ix < 0 || ix >= nCells[0]) continue;
+                    uint64_t cell = cellKey(ix, iy, iz);
+                    uint32_t b = bucket(cell);
+                    for (uint32_t i = bucketStart[b]; i < bucketStart[b+1]; ++i) {
+                        if ((keys[i] >> 3) != cell ||
+                            (keys[i] & 7) == skipOctant)
+                            continue;
+                        const RadiancePhoton &rp = photons[i];
+                        float dist2 = DistanceSquared(rp.p, p);
+                        if (dist2 < bestDist2 && Dot(rp.n, n) > 0.f) {
+                            best = &rp;
+                            bestDist2 = dist2;
+                        }
+                    }
+                }
+            }
+        }
+        // Unvisited cells are at least _r_ cells away from _p_
+        float ringDist = r * cellSize;
+        if (best && bestDist2 <= ringDist * ringDist) {
+            *photon = best;
+            return true;
+        }
+    }
+    return false;
+}
+
+
+const RadiancePhoton *PhotonIntegrator::LookupRadiancePhoton(const Point &p,
+        const Normal &n) const {
+    const RadiancePhoton *rp = NULL;
+    if (radianceGrid->Lookup(p, n, &rp))
+        return rp;
+
+    // Fall back to the kd-tree for points far from any radiance photon
+    RadiancePhotonProcess proc(n);
+    float md2 = INFINITY;
+    radianceMap->Lookup(p, proc, md2);
+    return proc.photon;
+}
+
+
+
 // PhotonIntegrator Method Definitions
 PhotonIntegrator::PhotonIntegrator(int ncaus, int nind,
         int nl, int mdepth, int mphodepth, float mdist, bool fg,
@@ -298,6 +536,7 @@ PhotonIntegrator::PhotonIntegrator(int ncaus, int nind,
     nCausticPaths = nIndirectPaths = 0;
     causticMap = indirectMap = NULL;
     radianceMap = NULL;
+    radianceGrid = NULL;
     lightSampleOffsets = NULL;
     bsdfSampleOffsets = NULL;
 }
@@ -309,6 +548,7 @@ PhotonIntegrator::~PhotonIntegrator() {
     delete causticMap;
     delete indirectMap;
     delete radianceMap;
+    delete radianceGrid;
 }
 
 
@@ -340,44 +580,84 @@ void PhotonIntegrator::Preprocess(const Scene *scene,
         const Camera *camera, const Renderer *renderer) {
     if (scene->lights.size() == 0) return;
     // Declare shared variables for photon shooting
-    Mutex *mutex = Mutex::Create();
-    int nDirectPaths = 0;
+    AtomicInt32 nDirectPaths = 0, nIndirectPaths = 0, nCausticPaths = 0;
+    AtomicInt32 nIndirectStored = 0, nCausticStored = 0;
+    AtomicInt32 abortTasks = 0;
+    AtomicInt32 nshot = 0;
     vector<Photon> causticPhotons, directPhotons, indirectPhotons;
     vector<RadiancePhoton> radiancePhotons;
-    bool abortTasks = false;
-    causticPhotons.reserve(nCausticPhotonsWanted);
-    indirectPhotons.reserve(nIndirectPhotonsWanted);
-    uint32_t nshot = 0;
     vector<Spectrum> rpReflectances, rpTransmittances;
 
     // Compute light power CDF for photon shooting
     Distribution1D *lightDistribution = ComputeLightSamplingCDF(scene);
 
     // Run parallel tasks for photon shooting
+    Timer timer;
+    timer.Start();
     ProgressReporter progress(nCausticPhotonsWanted+nIndirectPhotonsWanted, "Shooting photons");
-    vector<Task *> photonShootingTasks;
+    vector<PhotonShootingTask *> photonShootingTasks;
     int nTasks = NumSystemCores();
     for (int i = 0; i < nTasks; ++i)
         photonShootingTasks.push_back(new PhotonShootingTask(
-            i, camera ? camera->shutterOpen : 0.f, *mutex, this, progress, abortTasks, nDirectPaths,
-            directPhotons, indirectPhotons, causticPhotons, radiancePhotons,
-            rpReflectances, rpTransmittances,
-            nshot, lightDistribution, scene, renderer));
-    EnqueueTasks(photonShootingTasks);
+            i, camera ? camera->shutterOpen : 0.f, this, progress, abortTasks,
+            nDirectPaths, nIndirectPaths, nCausticPaths, nIndirectStored,
+            nCausticStored, nshot, lightDistribution, scene, renderer));
+    EnqueueTasks(vector<Task *>(photonShootingTasks.begin(),
+                                photonShootingTasks.end()));
     WaitForAllTasks();
-    for (uint32_t i = 0; i < photonShootingTasks.size(); ++i)
-        delete photonShootingTasks[i];
-    Mutex::Destroy(mutex);
     progress.Done();
+    this->nIndirectPaths = nIndirectPaths;
+    this->nCausticPaths = nCausticPaths;
+
+    // Merge per-task photons into shared arrays at atomically reserved offsets
+    bool mergeAll = (abortTasks == 0);
+    uint32_t nDirect = 0, nIndirect = 0, nCaustic = 0, nRadiance = 0;
+    for (int i = 0; i < nTasks; ++i) {
+        nDirect += photonShootingTasks[i]->directPhotons.size();
+        if (!mergeAll) continue;
+        nIndirect += photonShootingTasks[i]->indirectPhotons.size();
+        nCaustic += photonShootingTasks[i]->causticPhotons.size();
+        nRadiance += photonShootingTasks[i]->radiancePhotons.size();
+    }
+    directPhotons.resize(nDirect);
+    indirectPhotons.resize(nIndirect);
+    causticPhotons.resize(nCaustic);
+    radiancePhotons.resize(nRadiance);
+    rpReflectances.resize(nRadiance);
+    rpTransmittances.resize(nRadiance);
+    AtomicInt32 mergeOffsets[4] = { 0, 0, 0, 0 };
+    vector<Task *> mergeTasks;
+    for (int i = 0; i < nTasks; ++i)
+        mergeTasks.push_back(new PhotonMergeTask(photonShootingTasks[i],
+            mergeAll, directPhotons, indirectPhotons, causticPhotons,
+            radiancePhotons, rpReflectances, rpTransmittances, mergeOffsets));
+    EnqueueTasks(mergeTasks);
+    WaitForAllTasks();
+    for (int i = 0; i < nTasks; ++i) {
+        delete mergeTasks[i];
+        delete photonShootingTasks[i];
+    }
+    timer.Stop();
+    float shootTime = timer.Time();
+    uint32_t nStored = nDirect + nIndirect + nCaustic;
+    Info("Stored %u photons from %d paths in %.2fs (%.0f photons/sec)",
+         nStored, (int)nshot, shootTime,
+         shootTime > 0.f ? nStored / shootTime : 0.f);
 
     // Build kd-trees for indirect and caustic photons
-    KdTree<Photon> *directMap = NULL;
+    timer.Reset();
+    timer.Start();
+    BucketKdTree<Photon> *directMap = NULL;
     if (directPhotons.size() > 0)
-        directMap = new KdTree<Photon>(directPhotons);
+        directMap = new BucketKdTree<Photon>(directPhotons);
     if (causticPhotons.size() > 0)
-        causticMap = new KdTree<Photon>(causticPhotons);
+        causticMap = new BucketKdTree<Photon>(causticPhotons);
     if (indirectPhotons.size() > 0)
-        indirectMap = new KdTree<Photon>(indirectPhotons);
+        indirectMap = new BucketKdTree<Photon>(indirectPhotons);
+    timer.Stop();
+    float buildTime = timer.Time();
+    Info("Built photon maps in %.2fs (%.0f photons/sec)", buildTime,
+         buildTime > 0.f ? nStored / buildTime : 0.f);
 
     // Precompute radiance at a subset of the photons
     if (finalGather && radiancePhotons.size()) {
@@ -397,6 +677,7 @@ void PhotonIntegrator::Preprocess(const Scene *scene,
             delete radianceTasks[i];
         progRadiance.Done();
         radianceMap = new KdTree<RadiancePhoton>(radiancePhotons);
+        radianceGrid = new RadiancePhotonGrid(radiancePhotons);
     }
     delete directMap;
 }
@@ -406,16 +687,15 @@ void PhotonShootingTask::Run() {
     // Declare local variables for _PhotonShootingTask_
     MemoryArena arena;
     RNG rng(31 * taskNum);
-    vector<Photon> localDirectPhotons, localIndirectPhotons, localCausticPhotons;
-    vector<RadiancePhoton> localRadiancePhotons;
     uint32_t totalPaths = 0;
     bool causticDone = (integrator->nCausticPhotonsWanted == 0);
     bool indirectDone = (integrator->nIndirectPhotonsWanted == 0);
     PermutedHalton halton(6, rng);
-    vector<Spectrum> localRpReflectances, localRpTransmittances;
     while (true) {
         // Follow photon paths for a block of samples
         const uint32_t blockSize = 4096;
+        uint32_t blockIndirectStart = indirectPhotons.size();
+        uint32_t blockCausticStart = causticPhotons.size();
         for (uint32_t i = 0; i < blockSize; ++i) {
             float u[6];
             halton.Sample(++totalPaths, u);
@@ -457,7 +737,7 @@ void PhotonShootingTask::Run() {
                             if (!causticDone) {
                                 PBRT_PHOTON_MAP_DEPOSITED_CAUSTIC_PHOTON(&photonIsect.dg, &alpha, &wo);
                                 depositedPhoton = true;
-                                localCausticPhotons.push_back(photon);
+                                causticPhotons.push_back(photon);
                             }
                         }
                         else {
@@ -468,12 +748,12 @@ void PhotonShootingTask::Run() {
                             if (nIntersections == 1 && !indirectDone && integrator->finalGather) {
                                 PBRT_PHOTON_MAP_DEPOSITED_DIRECT_PHOTON(&photonIsect.dg, &alpha, &wo);
                                 depositedPhoton = true;
-                                localDirectPhotons.push_back(photon);
+                                directPhotons.push_back(photon);
                             }
                             else if (nIntersections > 1 && !indirectDone) {
                                 PBRT_PHOTON_MAP_DEPOSITED_INDIRECT_PHOTON(&photonIsect.dg, &alpha, &wo);
                                 depositedPhoton = true;
-                                localIndirectPhotons.push_back(photon);
+                                indirectPhotons.push_back(photon);
                             }
                         }
 
@@ -482,11 +762,11 @@ void PhotonShootingTask::Run() {
                                 rng.RandomFloat() < .125f) {
                             Normal n = photonIsect.dg.nn;
                             n = Faceforward(n, -photonRay.d);
-                            localRadiancePhotons.push_back(RadiancePhoton(photonIsect.dg.p, n));
+                            radiancePhotons.push_back(RadiancePhoton(photonIsect.dg.p, n));
                             Spectrum rho_r = photonBSDF->rho(rng, BSDF_ALL_REFLECTION);
-                            localRpReflectances.push_back(rho_r);
+                            rpReflectances.push_back(rho_r);
                             Spectrum rho_t = photonBSDF->rho(rng, BSDF_ALL_TRANSMISSION);
-                            localRpTransmittances.push_back(rho_t);
+                            rpTransmittances.push_back(rho_t);
                         }
                     }
                     if (nIntersections >= integrator->maxPhotonDepth) break;
@@ -517,63 +797,41 @@ void PhotonShootingTask::Run() {
             arena.FreeAll();
         }
 
-        // Merge local photon data with data in _PhotonIntegrator_
-        { MutexLock lock(mutex);
+        // Publish photon counts for the block with atomic updates
 
         // Give up if we're not storing enough photons
         if (abortTasks)
             return;
         if (nshot > 500000 &&
             (unsuccessful(integrator->nCausticPhotonsWanted,
-                                      causticPhotons.size(), blockSize) ||
+                                      nCausticStored, blockSize) ||
              unsuccessful(integrator->nIndirectPhotonsWanted,
-                                      indirectPhotons.size(), blockSize))) {
-            Error("Unable to store enough photons.  Giving up.\n");
-            causticPhotons.erase(causticPhotons.begin(), causticPhotons.end());
-            indirectPhotons.erase(indirectPhotons.begin(), indirectPhotons.end());
-            radiancePhotons.erase(radiancePhotons.begin(), radiancePhotons.end());
-            abortTasks = true;
+                                      nIndirectStored, blockSize))) {
+            if (AtomicCompareAndSwap(&abortTasks, 1, 0) == 0)
+                Error("Unable to store enough photons.  Giving up.\n");
             return;
         }
-        progress.Update(localIndirectPhotons.size() + localCausticPhotons.size());
-        nshot += blockSize;
+        uint32_t nBlockIndirect = indirectPhotons.size() - blockIndirectStart;
+        uint32_t nBlockCaustic = causticPhotons.size() - blockCausticStart;
+        progress.Update(nBlockIndirect + nBlockCaustic);
+        AtomicAdd(&nshot, blockSize);
 
-        // Merge indirect photons into shared array
+        // Count indirect and direct photons toward shared totals
         if (!indirectDone) {
-            integrator->nIndirectPaths += blockSize;
-            for (uint32_t i = 0; i < localIndirectPhotons.size(); ++i)
-                indirectPhotons.push_back(localIndirectPhotons[i]);
-            localIndirectPhotons.erase(localIndirectPhotons.begin(),
-                                       localIndirectPhotons.end());
-            if (indirectPhotons.size() >= integrator->nIndirectPhotonsWanted)
+            AtomicAdd(&nIndirectPaths, blockSize);
+            if ((uint32_t)AtomicAdd(&nIndirectStored, nBlockIndirect) >=
+                integrator->nIndirectPhotonsWanted)
                 indirectDone = true;
-            nDirectPaths += blockSize;
-            for (uint32_t i = 0; i < localDirectPhotons.size(); ++i)
-                directPhotons.push_back(localDirectPhotons[i]);
-            localDirectPhotons.erase(localDirectPhotons.begin(),
-                                     localDirectPhotons.end());
+            AtomicAdd(&nDirectPaths, blockSize);
         }
 
-        // Merge direct, caustic, and radiance photons into shared array
+        // Count caustic photons toward shared total
         if (!causticDone) {
-            integrator->nCausticPaths += blockSize;
-            for (uint32_t i = 0; i < localCausticPhotons.size(); ++i)
-                causticPhotons.push_back(localCausticPhotons[i]);
-            localCausticPhotons.erase(localCausticPhotons.begin(), localCausticPhotons.end());
-            if (causticPhotons.size() >= integrator->nCausticPhotonsWanted)
+            AtomicAdd(&nCausticPaths, blockSize);
+            if ((uint32_t)AtomicAdd(&nCausticStored, nBlockCaustic) >=
+                integrator->nCausticPhotonsWanted)
                 causticDone = true;
         }
-        
-        for (uint32_t i = 0; i < localRadiancePhotons.size(); ++i)
-            radiancePhotons.push_back(localRadiancePhotons[i]);
-        localRadiancePhotons.erase(localRadiancePhotons.begin(), localRadiancePhotons.end());
-        for (uint32_t i = 0; i < localRpReflectances.size(); ++i)
-            rpReflectances.push_back(localRpReflectances[i]);
-        localRpReflectances.erase(localRpReflectances.begin(), localRpReflectances.end());
-        for (uint32_t i = 0; i < localRpTransmittances.size(); ++i)
-            rpTransmittances.push_back(localRpTransmittances[i]);
-        localRpTransmittances.erase(localRpTransmittances.begin(), localRpTransmittances.end());
-        }
 
         // Exit task if enough photons have been found
         if (indirectDone && causticDone)
@@ -582,6 +840,40 @@ void PhotonShootingTask::Run() {
 }
 
 
+template <typename T>
+static void MergePhotons(vector<T> &local, vector<T> &shared,
+                         AtomicInt32 *offset) {
+    // Reserve a range of _shared_ and copy the task's photons into it
+    int32_t n = local.size();
+    if (n == 0) return;
+    int32_t start = AtomicAdd(offset, n) - n;
+    std::copy(local.begin(), local.end(), shared.begin() + start);
+    vector<T>().swap(local);
+}
+
+
+void PhotonMergeTask::Run() {
+    MergePhotons(shootingTask->directPhotons, directPhotons, &offsets[0]);
+    if (!mergeAll) return;
+    MergePhotons(shootingTask->indirectPhotons, indirectPhotons, &offsets[1]);
+    MergePhotons(shootingTask->causticPhotons, causticPhotons, &offsets[2]);
+
+    // Radiance photons and their reflectances share one reserved range
+    int32_t n = shootingTask->radiancePhotons.size();
+    if (n == 0) return;
+    int32_t start = AtomicAdd(&offsets[3], n) - n;
+    std::copy(shootingTask->radiancePhotons.begin(),
+              shootingTask->radiancePhotons.end(),
+              radiancePhotons.begin() + start);
+    std::copy(shootingTask->rpReflectances.begin(),
+              shootingTask->rpReflectances.end(),
+              rpReflectances.begin() + start);
+    std::copy(shootingTask->rpTransmittances.begin(),
+              shootingTask->rpTransmittances.end(),
+              rpTransmittances.begin() + start);
+}
+
+
 void ComputeRadianceTask::Run() {
     // Compute range of radiance photons to process in task
     uint32_t taskSize = radiancePhotons.size() / numTasks;
@@ -685,11 +977,10 @@ Spectrum PhotonIntegrator::Li(const Scene *scene, const Renderer *renderer,
                     Spectrum Lindir = 0.f;
                     Normal nGather = gatherIsect.dg.nn;
                     nGather = Faceforward(nGather, -bounceRay.d);
-                    RadiancePhotonProcess proc(nGather);
-                    float md2 = INFINITY;
-                    radianceMap->Lookup(gatherIsect.dg.p, proc, md2);
-                    if (proc.photon != NULL)
-                        Lindir = proc.photon->Lo;
+                    const RadiancePhoton *rp =
+                        LookupRadiancePhoton(gatherIsect.dg.p, nGather);
+                    if (rp != NULL)
+                        Lindir = rp->Lo;
                     Lindir *= renderer->Transmittance(scene, bounceRay, NULL, rng, arena);
 
                     // Compute MIS weight for BSDF-sampled gather ray
@@ -732,11 +1023,10 @@ Spectrum PhotonIntegrator::Li(const Scene *scene, const Renderer *renderer,
                     Spectrum Lindir = 0.f;
                     Normal nGather = gatherIsect.dg.nn;
                     nGather = Faceforward(nGather, -bounceRay.d);
-                    RadiancePhotonProcess proc(nGather);
-                    float md2 = INFINITY;
-                    radianceMap->Lookup(gatherIsect.dg.p, proc, md2);
-                    if (proc.photon != NULL)
-                        Lindir = proc.photon->Lo;
+                    const RadiancePhoton *rp =
+                        LookupRadiancePhoton(gatherIsect.dg.p, nGather);
+                    if (rp != NULL)
+                        Lindir = rp->Lo;
                     Lindir *= renderer->Transmittance(scene, bounceRay, NULL, rng, arena);
 
                     // Compute PDF for photon-sampling of direction _wi_
@@ -759,11 +1049,9 @@ Spectrum PhotonIntegrator::Li(const Scene *scene, const Renderer *renderer,
     #else
         // for debugging / examples: use the photon map directly
         Normal nn = Faceforward(n, -ray.d);
-        RadiancePhotonProcess proc(nn);
-        float md2 = INFINITY;
-        radianceMap->Lookup(p, proc, md2);
-        if (proc.photon)
-            L += proc.photon->Lo;
+        const RadiancePhoton *rp = LookupRadiancePhoton(p, nn);
+        if (rp)
+            L += rp->Lo;
     #endif
     }
     else
@@ -46,6 +46,7 @@ struct RadiancePhoton;
 struct ClosePhoton;
 struct PhotonProcess;
 struct RadiancePhotonProcess;
+class RadiancePhotonGrid;
 
 
 // PhotonIntegrator Declarations
@@ -64,6 +65,8 @@ public:
 private:
     // PhotonIntegrator Private Methods
     friend class PhotonShootingTask;
+    const RadiancePhoton *LookupRadiancePhoton(const Point &p,
+                                               const Normal &n) const;
 
     // PhotonIntegrator Private Data
     uint32_t nCausticPhotonsWanted, nIndirectPhotonsWanted, nLookup;
@@ -78,9 +81,10 @@ private:
     BSDFSampleOffsets *bsdfSampleOffsets;
     BSDFSampleOffsets bsdfGatherSampleOffsets, indirGatherSampleOffsets;
     int nCausticPaths, nIndirectPaths;
-    KdTree<Photon> *causticMap;
-    KdTree<Photon> *indirectMap;
+    BucketKdTree<Photon> *causticMap;
+    BucketKdTree<Photon> *indirectMap;
     KdTree<RadiancePhoton> *radianceMap;
+    RadiancePhotonGrid *radianceGrid;
 };
 
 
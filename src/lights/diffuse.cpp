@@ -56,6 +56,18 @@ Spectrum DiffuseAreaLight::Power(const Scene *) const {
 }
 
 
+bool DiffuseAreaLight::GetBounds(LightBounds *lb) const {
+    // Emission is one-sided, in the hemisphere around each surface normal
+    lb->bounds = shapeSet->WorldBound();
+    if (!shapeSet->GetNormalCone(&lb->axis, &lb->cosThetaO)) {
+        lb->axis = Vector(0.f, 0.f, 1.f);
+        lb->cosThetaO = -1.f;
+    }
+    lb->cosThetaE = 0.f;
+    return true;
+}
+
+
 AreaLight *CreateDiffuseAreaLight(const Transform &light2world, const ParamSet &paramSet,
         const Reference<Shape> &shape) {
     Spectrum L = paramSet.FindOneSpectrum("L", Spectrum(1.0));
@@ -69,6 +69,15 @@ Spectrum GonioPhotometricLight::Power(const Scene *) const {
 }
 
 
+bool GonioPhotometricLight::GetBounds(LightBounds *lb) const {
+    lb->bounds = BBox(lightPos);
+    lb->axis = Vector(0.f, 0.f, 1.f);
+    lb->cosThetaO = -1.f;
+    lb->cosThetaE = 0.f;
+    return true;
+}
+
+
 GonioPhotometricLight *CreateGoniometricLight(const Transform &light2world,
         const ParamSet &paramSet) {
     Spectrum I = paramSet.FindOneSpectrum("I", Spectrum(1.0));
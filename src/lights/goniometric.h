@@ -63,6 +63,7 @@ public:
                Spectrum(mipmap->Lookup(s, t, SPECTRUM_ILLUMINANT));
     }
     Spectrum Power(const Scene *) const;
+    bool GetBounds(LightBounds *lb) const;
     Spectrum Sample_L(const Scene *scene, const LightSample &ls, float u1, float u2,
         float time, Ray *ray, Normal *Ns, float *pdf) const;
     float Pdf(const Point &, const Vector &) const;
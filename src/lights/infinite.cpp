@@ -125,14 +125,48 @@ Spectrum InfiniteAreaLight::Le(const RayDifferential &r) const {
 void InfiniteAreaLight::SHProject(const Point &p, float pEpsilon,
         int lmax, const Scene *scene, bool computeLightVis,
         float time, RNG &rng, Spectrum *coeffs) const {
-    // Project _InfiniteAreaLight_ to SH using Monte Carlo if visibility needed
+    for (int i = 0; i < SHTerms(lmax); ++i)
+        coeffs[i] = 0.f;
     if (computeLightVis) {
-        Light::SHProject(p, pEpsilon, lmax, scene, computeLightVis,
-                         time, rng, coeffs);
+        // Project _InfiniteAreaLight_ to SH using Monte Carlo for visibility
+
+        // Use the same sample sequence as _Light::SHProject()_; the 1D
+        // scramble is drawn only to keep _rng_ in step with it
+        uint32_t ns = RoundUpPow2(nSamples);
+        (void)rng.RandomUInt();
+        uint32_t scramble2D[2] = { rng.RandomUInt(), rng.RandomUInt() };
+        float *Ylm = ALLOCA(float, SHTerms(lmax));
+        const int batchSize = 64;
+        float u[2*batchSize], uv[2*batchSize], mapPdf[batchSize];
+        for (uint32_t start = 0; start < ns; start += batchSize) {
+            // Sample a batch of directions from the radiance map
+            int n = min(batchSize, int(ns - start));
+            for (int i = 0; i < n; ++i)
+                Sample02(start + i, scramble2D, &u[2*i]);
+            distribution->SampleContinuous(u, n, uv, mapPdf);
+            for (int i = 0; i < n; ++i) {
+                if (mapPdf[i] == 0.f) continue;
+                float theta = uv[2*i+1] * M_PI, phi = uv[2*i] * 2.f * M_PI;
+                float costheta = cosf(theta), sintheta = sinf(theta);
+                if (sintheta == 0.f) continue;
+                float sinphi = sinf(phi), cosphi = cosf(phi);
+                Vector wi = LightToWorld(Vector(sintheta * cosphi,
+                                                sintheta * sinphi, costheta));
+                float pdf = mapPdf[i] / (2.f * M_PI * M_PI * sintheta);
+                Spectrum Li = Spectrum(radianceMap->Lookup(uv[2*i], uv[2*i+1]),
+                                       SPECTRUM_ILLUMINANT);
+                VisibilityTester vis;
+                vis.SetRay(p, pEpsilon, wi, time);
+                if (Li.IsBlack() || !vis.Unoccluded(scene)) continue;
+
+                // Add light sample contribution to MC estimate of SH coefficients
+                SHEvaluate(wi, lmax, Ylm);
+                for (int j = 0; j < SHTerms(lmax); ++j)
+                    coeffs[j] += Li * Ylm[j] / (pdf * ns);
+            }
+        }
         return;
     }
-    for (int i = 0; i < SHTerms(lmax); ++i)
-        coeffs[i] = 0.f;
     int ntheta = radianceMap->Height(), nphi = radianceMap->Width();
     if (min(ntheta, nphi) > 50) {
         // Project _InfiniteAreaLight_ to SH from lat-long representation
@@ -224,9 +258,10 @@ Spectrum InfiniteAreaLight::Sample_L(const Point &p, float pEpsilon,
 float InfiniteAreaLight::Pdf(const Point &, const Vector &w) const {
     PBRT_INFINITE_LIGHT_STARTED_PDF();
     Vector wi = WorldToLight(w);
-    float theta = SphericalTheta(wi), phi = SphericalPhi(wi);
-    float sintheta = sinf(theta);
+    float costheta = Clamp(wi.z, -1.f, 1.f);
+    float sintheta = sqrtf(max(0.f, 1.f - costheta * costheta));
     if (sintheta == 0.f) return 0.f;
+    float theta = acosf(costheta), phi = SphericalPhi(wi);
     float p = distribution->Pdf(phi * INV_TWOPI, theta * INV_PI) /
            (2.f * M_PI * M_PI * sintheta);
     PBRT_INFINITE_LIGHT_FINISHED_PDF();
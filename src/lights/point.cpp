@@ -62,6 +62,16 @@ Spectrum PointLight::Power(const Scene *) const {
 }
 
 
+bool PointLight::GetBounds(LightBounds *lb) const {
+    // Emits in all directions from a single point
+    lb->bounds = BBox(lightPos);
+    lb->axis = Vector(0.f, 0.f, 1.f);
+    lb->cosThetaO = -1.f;
+    lb->cosThetaE = 0.f;
+    return true;
+}
+
+
 PointLight *CreatePointLight(const Transform &light2world,
         const ParamSet &paramSet) {
     Spectrum I = paramSet.FindOneSpectrum("I", Spectrum(1.0));
@@ -49,6 +49,7 @@ public:
     Spectrum Sample_L(const Point &p, float pEpsilon, const LightSample &ls,
         float time, Vector *wi, float *pdf, VisibilityTester *vis) const;
     Spectrum Power(const Scene *) const;
+    bool GetBounds(LightBounds *lb) const;
     bool IsDeltaLight() const { return true; }
     Spectrum Sample_L(const Scene *scene, const LightSample &ls, float u1,
                       float u2, float time, Ray *ray, Normal *Ns, float *pdf) const;
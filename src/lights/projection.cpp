@@ -109,6 +109,15 @@ Spectrum ProjectionLight::Power(const Scene *) const {
 }
 
 
+bool ProjectionLight::GetBounds(LightBounds *lb) const {
+    lb->bounds = BBox(lightPos);
+    lb->axis = Normalize(LightToWorld(Vector(0.f, 0.f, 1.f)));
+    lb->cosThetaO = cosTotalWidth;
+    lb->cosThetaE = 1.f;
+    return true;
+}
+
+
 ProjectionLight *CreateProjectionLight(const Transform &light2world,
         const ParamSet &paramSet) {
     Spectrum I = paramSet.FindOneSpectrum("I", Spectrum(1.0));
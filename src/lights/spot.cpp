@@ -75,6 +75,16 @@ Spectrum SpotLight::Power(const Scene *) const {
 }
 
 
+bool SpotLight::GetBounds(LightBounds *lb) const {
+    // Emission is confined to the cone of the spotlight
+    lb->bounds = BBox(lightPos);
+    lb->axis = Normalize(LightToWorld(Vector(0.f, 0.f, 1.f)));
+    lb->cosThetaO = cosTotalWidth;
+    lb->cosThetaE = 1.f;
+    return true;
+}
+
+
 SpotLight *CreateSpotLight(const Transform &l2w, const ParamSet &paramSet) {
     Spectrum I = paramSet.FindOneSpectrum("I", Spectrum(1.0));
     Spectrum sc = paramSet.FindOneSpectrum("scale", Spectrum(1.0));
@@ -51,6 +51,7 @@ public:
     bool IsDeltaLight() const { return true; }
     float Falloff(const Vector &w) const;
     Spectrum Power(const Scene *) const;
+    bool GetBounds(LightBounds *lb) const;
     Spectrum Sample_L(const Scene *scene, const LightSample &ls,
         float u1, float u2, float time, Ray *ray, Normal *Ns, float *pdf) const;
     float Pdf(const Point &, const Vector &) const;
@@ -33,31 +33,46 @@ int main(int argc, char** argv)
     else random_params = "all";
 
     vector<SampleData> allSamples;
+    vector<int> pixelOffsets;
     int w, h, spp;
     std::ifstream dump(filename, std::ifstream::in | std::ifstream::binary);
 
     dump.read((char*)&w, sizeof(int));
 	dump.read((char*)&h, sizeof(int));
 	dump.read((char*)&spp, sizeof(int));
-	allSamples.resize(w*h*spp);
-	dump.read((char*)&(allSamples[0]), allSamples.size() * sizeof(SampleData));
+	// An spp of 0 means the sample counts vary and follow per pixel
+	vector<int> counts(w*h, spp);
+	if (spp == 0)
+		dump.read((char*)&(counts[0]), counts.size() * sizeof(int));
+	pixelOffsets.resize(w*h + 1);
+	int total = 0;
+	for (int p = 0; p < w*h; p++) {
+		pixelOffsets[p] = total;
+		total += counts[p];
+	}
+	pixelOffsets[w*h] = total;
+	allSamples.resize(total);
+	if (total > 0)
+		dump.read((char*)&(allSamples[0]), allSamples.size() * sizeof(SampleData));
 	dump.close();
 
-    RandomParameterFilter rpf(w, h, spp, jouni, allSamples);
+    RandomParameterFilter rpf(w, h, jouni, allSamples, pixelOffsets);
     rpf.setQuality(quality);
     rpf.setRandomParams(random_params); //TODO make argument for this
     rpf.Apply();
 
     TwoDArray<Color> fltImg = TwoDArray<Color>(w, h);
     // Dumping img (and multiply with rho/albedo
-    for (uint i=0; i < allSamples.size(); i+=spp) {
+    for (int p = 0; p < w*h; p++) {
+    	int n = pixelOffsets[p+1] - pixelOffsets[p];
+    	if (n == 0) continue;
     	Color c;
-    	for (int j=0; j<spp; j++)
+    	for (int j = pixelOffsets[p]; j < pixelOffsets[p+1]; j++)
     		for(int k=0; k<3;k++){
-    			c[k] += allSamples[i+j].outputColors[k];
+    			c[k] += allSamples[j].outputColors[k];
     		}
-    	c /= spp;
-    	fltImg(allSamples[i].x, allSamples[i].y) = c;
+    	c /= n;
+    	fltImg(p % w, p / w) = c;
     }
     string filenameBase = filename.substr(0, filename.rfind("."));
     WriteImage(filenameBase + "_flt.exr", (float*)fltImg.GetRawPtr(), NULL, w, h,
@@ -172,9 +172,13 @@ int main(int argc, char** argv)
     int w, h, spp;
     readDump(argv, allSamples, w, h, spp);
     smoothNormals(allSamples, w, h, spp);
-    RPF::dumpAsBinary("jl_dump", w, h, spp, allSamples);
+    // Lehtinen dumps store the same number of samples for every pixel
+    vector<int> pixelOffsets(w*h + 1);
+    for (int p = 0; p <= w*h; p++)
+    	pixelOffsets[p] = p*spp;
+    RPF::dumpAsBinary("jl_dump", w, h, pixelOffsets, allSamples);
 
-    RandomParameterFilter rpf(w, h, spp, 0.02f, allSamples);
+    RandomParameterFilter rpf(w, h, 0.02f, allSamples, pixelOffsets);
     rpf.setQuality(quality);
     rpf.setRandomParams("frd"); //TODO make argument for this
     rpf.Apply();
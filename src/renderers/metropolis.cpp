@@ -44,6 +44,7 @@
 #include "paramset.h"
 #include "parallel.h"
 #include "probes.h"
+#include "timer.h"
 #include "intersection.h"
 #include "montecarlo.h"
 #include "samplers/lowdiscrepancy.h"
@@ -223,6 +224,31 @@ private:
 };
 
 
+class MLTBootstrapTask : public Task {
+public:
+    MLTBootstrapTask(const MetropolisRenderer *ren, const Scene *sc,
+            const Camera *c, const Distribution1D *ld, uint32_t tn,
+            uint32_t s, uint32_t e, int xx0, int xx1, int yy0, int yy1,
+            float tt0, float tt1, vector<float> &bI)
+        : renderer(ren), scene(sc), camera(c), lightDistribution(ld),
+          taskNum(tn), start(s), end(e), x0(xx0), x1(xx1), y0(yy0), y1(yy1),
+          t0(tt0), t1(tt1), bootstrapI(bI), sumI(0.f) { }
+    void Run();
+    void GenerateSamples(uint32_t last, MLTSample *sample);
+private:
+    friend class MetropolisRenderer;
+    const MetropolisRenderer *renderer;
+    const Scene *scene;
+    const Camera *camera;
+    const Distribution1D *lightDistribution;
+    uint32_t taskNum, start, end;
+    int x0, x1, y0, y1;
+    float t0, t1;
+    vector<float> &bootstrapI;
+    float sumI;
+};
+
+
 
 // Metropolis Method Definitions
 static uint32_t GeneratePath(const RayDifferential &r,
@@ -567,46 +593,46 @@ void MetropolisRenderer::Render(const Scene *scene) {
         }
         // Take initial set of samples to compute $b$
         PBRT_MLT_STARTED_BOOTSTRAPPING(nBootstrap);
-        RNG rng(0);
-        MemoryArena arena;
-        vector<float> bootstrapI;
-        vector<PathVertex> cameraPath(maxDepth, PathVertex());
-        vector<PathVertex> lightPath(maxDepth, PathVertex());
-        float sumI = 0.f;
-        bootstrapI.reserve(nBootstrap);
-        MLTSample sample(maxDepth);
-        for (uint32_t i = 0; i < nBootstrap; ++i) {
-            // Generate random sample and path radiance for MLT bootstrapping
-            float x = Lerp(rng.RandomFloat(), x0, x1);
-            float y = Lerp(rng.RandomFloat(), y0, y1);
-            LargeStep(rng, &sample, maxDepth, x, y, t0, t1, bidirectional);
-            Spectrum L = PathL(sample, scene, arena, camera, lightDistribution,
-                               &cameraPath[0], &lightPath[0], rng);
-
-            // Compute contribution for random sample for MLT bootstrapping
-            float I = ::I(L);
-            sumI += I;
-            bootstrapI.push_back(I);
-            arena.FreeAll();
+        Timer bootstrapTimer;
+        bootstrapTimer.Start();
+        vector<float> bootstrapI(nBootstrap);
+        const uint32_t bootstrapTaskSize = 4096;
+        vector<MLTBootstrapTask *> bootstrapTasks;
+        for (uint32_t start = 0; start < nBootstrap; start += bootstrapTaskSize) {
+            uint32_t end = min(start + bootstrapTaskSize, nBootstrap);
+            bootstrapTasks.push_back(new MLTBootstrapTask(this, scene, camera,
+                lightDistribution, bootstrapTasks.size(), start, end,
+                x0, x1, y0, y1, t0, t1, bootstrapI));
         }
+        EnqueueTasks(vector<Task *>(bootstrapTasks.begin(),
+                                    bootstrapTasks.end()));
+        WaitForAllTasks();
+        float sumI = 0.f;
+        for (uint32_t i = 0; i < bootstrapTasks.size(); ++i)
+            sumI += bootstrapTasks[i]->sumI;
         float b = sumI / nBootstrap;
         PBRT_MLT_FINISHED_BOOTSTRAPPING(b);
-        Info("MLT computed b = %f", b);
+        bootstrapTimer.Stop();
+        Info("MLT computed b = %f from %d paths in %.2fs", b, int(nBootstrap),
+             bootstrapTimer.Time());
 
         // Select initial sample from bootstrap samples
+        RNG rng(0);
         float contribOffset = rng.RandomFloat() * sumI;
-        rng.Seed(0);
-        sumI = 0.f;
-        MLTSample initialSample(maxDepth);
+        uint32_t initialIndex = nBootstrap - 1;
+        float cumI = 0.f;
         for (uint32_t i = 0; i < nBootstrap; ++i) {
-            float x = Lerp(rng.RandomFloat(), x0, x1);
-            float y = Lerp(rng.RandomFloat(), y0, y1);
-            LargeStep(rng, &initialSample, maxDepth, x, y, t0, t1,
-                      bidirectional);
-            sumI += bootstrapI[i];
-            if (sumI > contribOffset)
+            cumI += bootstrapI[i];
+            if (cumI > contribOffset) {
+                initialIndex = i;
                 break;
+            }
         }
+        MLTSample initialSample(maxDepth);
+        bootstrapTasks[initialIndex / bootstrapTaskSize]->GenerateSamples(
+            initialIndex, &initialSample);
+        for (uint32_t i = 0; i < bootstrapTasks.size(); ++i)
+            delete bootstrapTasks[i];
 
         // Launch tasks to generate Metropolis samples
         uint32_t nTasks = largeStepsPerPixel;
@@ -643,6 +669,37 @@ inline float I(const Spectrum &L) {
 }
 
 
+void MLTBootstrapTask::Run() {
+    MLTSample sample(renderer->maxDepth);
+    GenerateSamples(end - 1, &sample);
+}
+
+
+void MLTBootstrapTask::GenerateSamples(uint32_t last, MLTSample *sample) {
+    // Replaying the task's samples through _last_ leaves that one in _sample_
+    RNG rng(taskNum);
+    MemoryArena arena;
+    vector<PathVertex> cameraPath(renderer->maxDepth, PathVertex());
+    vector<PathVertex> lightPath(renderer->maxDepth, PathVertex());
+    sumI = 0.f;
+    for (uint32_t i = start; i <= last; ++i) {
+        // Generate random sample and path radiance for MLT bootstrapping
+        float x = Lerp(rng.RandomFloat(), x0, x1);
+        float y = Lerp(rng.RandomFloat(), y0, y1);
+        LargeStep(rng, sample, renderer->maxDepth, x, y, t0, t1,
+                  renderer->bidirectional);
+        Spectrum L = renderer->PathL(*sample, scene, arena, camera,
+            lightDistribution, &cameraPath[0], &lightPath[0], rng);
+
+        // Compute contribution for random sample for MLT bootstrapping
+        float I = ::I(L);
+        sumI += I;
+        bootstrapI[i] = I;
+        arena.FreeAll();
+    }
+}
+
+
 MLTTask::MLTTask(ProgressReporter &prog, uint32_t pfreq, uint32_t tn,
         float ddx, float ddy, int xx0, int xx1, int yy0, int yy1, float tt0, float tt1,
         float bb, const MLTSample &is, const Scene *sc, const Camera *c,
@@ -668,6 +725,13 @@ MLTTask::MLTTask(ProgressReporter &prog, uint32_t pfreq, uint32_t tn,
 }
 
 
+static inline void MLTSplat(Film *film, FilmTile *tile,
+        const CameraSample &sample, const Spectrum &L) {
+    if (tile) tile->Splat(sample, L);
+    else      film->Splat(sample, L);
+}
+
+
 void MLTTask::Run() {
     PBRT_MLT_STARTED_MLT_TASK(this);
     // Declare basic _MLTTask_ variables and prepare for sampling
@@ -677,7 +741,7 @@ void MLTTask::Run() {
     uint32_t largeStepRate = nPixelSamples / renderer->largeStepsPerPixel;
     Assert(largeStepRate > 1);
     uint64_t nTaskSamples = uint64_t(nPixels) * uint64_t(largeStepRate);
-    uint32_t consecutiveRejects = 0;
+    uint32_t consecutiveRejects = 0, nAccepted = 0;
     uint32_t progressCounter = progressUpdateFrequency;
 
     // Declare variables for storing and computing MLT samples
@@ -703,7 +767,12 @@ void MLTTask::Run() {
     largeStepPixelNum.reserve(nPixels);
     for (uint32_t i = 0; i < nPixels; ++i) largeStepPixelNum.push_back(i);
     Shuffle(&largeStepPixelNum[0], nPixels, 1, rng);
+
+    // Splat into a task-private film tile, merged at progress updates
+    FilmTile *splatTile = camera->film->GetFilmTile(x0, x1, y0, y1);
     PBRT_MLT_FINISHED_TASK_INIT();
+    Timer timer;
+    timer.Start();
     for (uint64_t s = 0; s < nTaskSamples; ++s) {
         // Compute proposed mutation to current sample
         PBRT_MLT_STARTED_MUTATION();
@@ -735,15 +804,15 @@ void MLTTask::Run() {
         if (I[current] > 0.f) {
             if (!isinf(1.f / I[current])) {
             Spectrum contrib =  (b / nPixelSamples) * L[current] / I[current];
-            camera->film->Splat(samples[current].cameraSample,
-                                (1.f - a) * contrib);
+            MLTSplat(camera->film, splatTile, samples[current].cameraSample,
+                     (1.f - a) * contrib);
         }
         }
         if (I[proposed] > 0.f) {
             if (!isinf(1.f / I[proposed])) {
             Spectrum contrib =  (b / nPixelSamples) * L[proposed] / I[proposed];
-            camera->film->Splat(samples[proposed].cameraSample,
-                                a * contrib);
+            MLTSplat(camera->film, splatTile, samples[proposed].cameraSample,
+                     a * contrib);
         }
         }
         PBRT_MLT_FINISHED_SAMPLE_SPLAT();
@@ -755,6 +824,7 @@ void MLTTask::Run() {
             current ^= 1;
             proposed ^= 1;
             consecutiveRejects = 0;
+            ++nAccepted;
         }
         else
         {
@@ -762,11 +832,19 @@ void MLTTask::Run() {
             ++consecutiveRejects;
         }
         if (--progressCounter == 0) {
+            if (splatTile) camera->film->MergeFilmTile(splatTile);
             progress.Update();
             progressCounter = progressUpdateFrequency;
         }
     }
     Assert(pixelNumOffset == nPixels);
+    if (splatTile) {
+        camera->film->MergeFilmTile(splatTile);
+        delete splatTile;
+    }
+    timer.Stop();
+    Info("MLT chain %d: %.0f mutations/sec, %.1f%% accepted", int(taskNum),
+         nTaskSamples / timer.Time(), 100.f * nAccepted / nTaskSamples);
     // Update display for recently computed Metropolis samples
     PBRT_MLT_STARTED_DISPLAY_UPDATE();
     int ntf = AtomicAdd(&renderer->nTasksFinished, 1);
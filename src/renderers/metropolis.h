@@ -86,6 +86,7 @@ private:
     DirectLightingIntegrator *directLighting;
     AtomicInt32 nTasksFinished;
     friend class MLTTask;
+    friend class MLTBootstrapTask;
 };
 
 
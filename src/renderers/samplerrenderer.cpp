@@ -76,22 +76,34 @@ void SamplerRendererTask::Run() {
     int maxSamples = sampler->MaximumSampleCount();
     Sample *samples = origSample->Duplicate(maxSamples);
     RayDifferential *rays = new RayDifferential[maxSamples];
+    CameraSample *cameraSamples = new CameraSample[maxSamples];
+    float *rayWeights = new float[maxSamples];
     Spectrum *Ls = new Spectrum[maxSamples];
     Spectrum *Ts = new Spectrum[maxSamples];
     Intersection *isects = new Intersection[maxSamples];
 
+    // Accumulate image samples into a task-private film tile when supported
+    FilmTile *filmTile = camera->film->GetFilmTile(sampler->xPixelStart,
+        sampler->xPixelEnd, sampler->yPixelStart, sampler->yPixelEnd);
+
     // Get samples from _Sampler_ and update image
     int sampleCount;
     while ((sampleCount = sampler->GetMoreSamples(samples, rng)) > 0) {
-        // Generate camera rays and compute radiance along rays
+        // Generate camera rays for all samples at once
+        for (int i = 0; i < sampleCount; ++i) {
+            PBRT_STARTED_GENERATING_CAMERA_RAY(&samples[i]);
+            cameraSamples[i] = samples[i];
+        }
+        camera->GenerateRayDifferentials(cameraSamples, sampleCount, rays,
+                                         rayWeights);
+
+        // Compute radiance along camera rays
         for (int i = 0; i < sampleCount; ++i) {
             // Reset intersection information
             isects[i] = Intersection();
 
-            // Find camera ray for _sample[i]_
-            PBRT_STARTED_GENERATING_CAMERA_RAY(&samples[i]);
-            float rayWeight = camera->GenerateRayDifferential(samples[i], &rays[i]);
-            rays[i].ScaleDifferentials(1.f / sqrtf(sampler->samplesPerPixel));           
+            float rayWeight = rayWeights[i];
+            rays[i].ScaleDifferentials(1.f / sqrtf(sampler->samplesPerPixel));
             PBRT_FINISHED_GENERATING_CAMERA_RAY(&samples[i], &rays[i], rayWeight);
 
             // Evaluate radiance along camera ray
@@ -144,7 +156,10 @@ void SamplerRendererTask::Run() {
             {
                 PBRT_STARTED_ADDING_IMAGE_SAMPLE(&samples[i], &rays[i], &Ls[i], &Ts[i]);
                 isects[i].shadingN = Faceforward(isects[i].shadingN, rays[i].d);
-                camera->film->AddSample(samples[i], Ls[i], isects[i]);
+                if (filmTile)
+                    filmTile->AddSample(samples[i], Ls[i], isects[i]);
+                else
+                    camera->film->AddSample(samples[i], Ls[i], isects[i]);
                 PBRT_FINISHED_ADDING_IMAGE_SAMPLE();
             }
         }
@@ -154,11 +169,17 @@ void SamplerRendererTask::Run() {
     }
 
     // Clean up after _SamplerRendererTask_ is done with its image region
+    if (filmTile) {
+        camera->film->MergeFilmTile(filmTile);
+        delete filmTile;
+    }
     camera->film->UpdateDisplay(sampler->xPixelStart,
         sampler->yPixelStart, sampler->xPixelEnd+1, sampler->yPixelEnd+1);
     delete sampler;
     delete[] samples;
     delete[] rays;
+    delete[] cameraSamples;
+    delete[] rayWeights;
     delete[] Ls;
     delete[] Ts;
     delete[] isects;
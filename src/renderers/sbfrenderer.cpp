@@ -41,15 +41,19 @@
 #include "samplers/sbfsampler.h"
 #include "film/sbfimage.h"
 #include "imageio.h"
+#include "timer.h"
 
 // SBFRendererTask Definitions
 void SBFRendererTask::Run() {
     PBRT_STARTED_RENDERTASK(taskNum);
+    Timer timer;
+    timer.Start();
 
     // Get sub-_Sampler_ for _SamplerRendererTask_
     Sampler *sampler = mainSampler->GetSubSampler(taskNum, taskCount);
     if (!sampler)
     {
+        if (runTime) *runTime = timer.Time();
         reporter.Update();
         PBRT_FINISHED_RENDERTASK(taskNum);
         return;
@@ -62,6 +66,8 @@ void SBFRendererTask::Run() {
     int maxSamples = sampler->MaximumSampleCount();
     Sample *samples = origSample->Duplicate(maxSamples);
     RayDifferential *rays = new RayDifferential[maxSamples];
+    CameraSample *cameraSamples = new CameraSample[maxSamples];
+    float *rayWeights = new float[maxSamples];
     Spectrum *Ls = new Spectrum[maxSamples];
     Spectrum *Ts = new Spectrum[maxSamples];
     Intersection *isects = new Intersection[maxSamples];
@@ -69,14 +75,20 @@ void SBFRendererTask::Run() {
     // Get samples from _Sampler_ and update image
     int sampleCount;
     while ((sampleCount = sampler->GetMoreSamples(samples, rng)) > 0) {
-        // Generate camera rays and compute radiance along rays
+        // Generate camera rays for all samples at once
+        for (int i = 0; i < sampleCount; ++i) {
+            PBRT_STARTED_GENERATING_CAMERA_RAY(&samples[i]);
+            cameraSamples[i] = samples[i];
+        }
+        camera->GenerateRayDifferentials(cameraSamples, sampleCount, rays,
+                                         rayWeights);
+
+        // Compute radiance along camera rays
         for (int i = 0; i < sampleCount; ++i) {
             // Reset intersection information
             isects[i] = Intersection();
 
-            // Find camera ray for _sample[i]_
-            PBRT_STARTED_GENERATING_CAMERA_RAY(&samples[i]);
-            float rayWeight = camera->GenerateRayDifferential(samples[i], &rays[i]);
+            float rayWeight = rayWeights[i];
             rays[i].ScaleDifferentials(1.f / sqrtf((float)sampler->samplesPerPixel));
             PBRT_FINISHED_GENERATING_CAMERA_RAY(&samples[i], &rays[i], rayWeight);
 
@@ -134,22 +146,44 @@ void SBFRendererTask::Run() {
     delete sampler;
     delete[] samples;
     delete[] rays;
+    delete[] cameraSamples;
+    delete[] rayWeights;
     delete[] Ls;
     delete[] Ts;
     delete[] isects;
+    if (runTime) *runTime = timer.Time();
     reporter.Update();
     PBRT_FINISHED_RENDERTASK(taskNum);
 }
 
 
+static void ReportPassUtilization(const char *pass, double wallTime,
+                                  const vector<double> &taskTimes) {
+    // Compare time spent in tasks to the time all cores were available
+    double busy = 0., longest = 0.;
+    for (uint32_t i = 0; i < taskTimes.size(); ++i) {
+        busy += taskTimes[i];
+        longest = max(longest, taskTimes[i]);
+    }
+    double available = wallTime * NumSystemCores();
+    Info("%s: %.2fs, %.1f%% core utilization, longest task %.3fs, "
+         "mean task %.3fs", pass, wallTime,
+         available > 0. ? 100. * min(1., busy / available) : 100.,
+         longest, taskTimes.size() ? busy / taskTimes.size() : 0.);
+}
+
+
 
 // SamplerRenderer Method Definitions
 SBFRenderer::SBFRenderer(Sampler *s, Camera *c,
-                       SurfaceIntegrator *si, VolumeIntegrator *vi) {
+                       SurfaceIntegrator *si, VolumeIntegrator *vi,
+                       float tb, float tm) {
     sampler = s;
     camera = c;
     surfaceIntegrator = si;
     volumeIntegrator = vi;
+    timeBudget = tb;
+    targetMse = tm;
 }
 
 
@@ -161,7 +195,38 @@ SBFRenderer::~SBFRenderer() {
 }
 
 
+double SBFRenderer::RenderPass(const Scene *scene, Sample *sample,
+                               const char *name, vector<RNG> &rngs,
+                               float maxDepth) {
+    // Create and launch _SBFRendererTask_s for one sampling pass
+    int nTasks = rngs.size();
+    ProgressReporter reporter(nTasks, name);
+    vector<Task *> renderTasks;
+    vector<double> taskTimes(nTasks, 0.);
+    Timer passTimer;
+    passTimer.Start();
+    for (int i = 0; i < nTasks; ++i)
+        renderTasks.push_back(new SBFRendererTask(scene, this, camera,
+                                                  reporter, sampler, sample,
+                                                  nTasks-1-i, nTasks,
+                                                  rngs[i], maxDepth,
+                                                  &taskTimes[i]));
+    EnqueueTasks(renderTasks);
+    WaitForAllTasks();
+    for (uint32_t i = 0; i < renderTasks.size(); ++i)
+        delete renderTasks[i];
+    reporter.Done();
+    double passTime = passTimer.Time();
+    ReportPassUtilization(name, passTime, taskTimes);
+    surfaceIntegrator->FinishPass(scene, camera, this);
+    volumeIntegrator->FinishPass(scene, camera, this);
+    return passTime;
+}
+
+
 void SBFRenderer::Render(const Scene *scene) {
+    Timer renderTimer;
+    renderTimer.Start();
     PBRT_FINISHED_PARSING();
     // Allow integrators to do preprocessing for the scene
     PBRT_STARTED_PREPROCESSING();
@@ -173,6 +238,9 @@ void SBFRenderer::Render(const Scene *scene) {
     Sample *sample = new Sample(sampler, surfaceIntegrator,
                                 volumeIntegrator, scene);
 
+    // Size any per-sample capture of the film by the per-pixel maximum
+    camera->film->SetSPP(sampler->MaximumSampleCount());
+
     // Create and launch _SamplerRendererTask_s for rendering image
 
     // Compute number of _SamplerRendererTask_s to create for rendering
@@ -202,44 +270,79 @@ void SBFRenderer::Render(const Scene *scene) {
                 maxDepth = max(maxDepth, ray.maxt);
         }
 
-    ProgressReporter reporter(nTasks, "Initial Sampling");    
-    vector<Task *> renderTasks;
     vector<RNG> rngs;
     for (int i = 0; i < nTasks; ++i) {
         rngs.push_back(RNG(nTasks-1-i));
     }
 
-    for (int i = 0; i < nTasks; ++i) {
-        renderTasks.push_back(new SBFRendererTask(scene, this, camera,
-                                                  reporter, sampler, sample, 
-                                                  nTasks-1-i, nTasks,
-                                                  rngs[i], maxDepth));
-    }
-    EnqueueTasks(renderTasks);
-    WaitForAllTasks();
-    for (uint32_t i = 0; i < renderTasks.size(); ++i)
-        delete renderTasks[i];  
-    reporter.Done();        
+    int nFilmPixels = (xe - xs) * (ye - ys);
+    double initTime = RenderPass(scene, sample, "Initial Sampling", rngs,
+                                 maxDepth);
     
-    if(sbfSampler->GetAdaptiveSPP() > 0.f && sbfSampler->GetIteration() > 0) {
+    if (timeBudget > 0.f || targetMse > 0.f) {
+        // Issue adaptive iterations until the time budget or MSE target is met
+        double samplesPerSec = initTime > 0. ?
+            double(nFilmPixels) * sbfSampler->GetInitSamples() / initTime : 0.;
+        float iterSpp = sbfSampler->GetAdaptiveSPP() > 0.f ?
+            sbfSampler->GetAdaptiveSPP() : sbfSampler->GetInitSamples();
+        float totalSpp = sbfSampler->GetInitSamples();
+        // Budget handed out so far; pixels without any error left take
+        // no samples, so this bounds the number of iterations instead
+        float budgetSpp = totalSpp;
+        double updateTime = 0.;
+        for (int iter = 0; ; iter++) {
+            // Size this iteration from the measured sampling rate
+            float spp = iterSpp;
+            if (timeBudget > 0.f) {
+                // Leave room for the final reconstruction, which filters
+                // with more parameters than the intermediate ones
+                double remaining = timeBudget - renderTimer.Time() -
+                                   3. * updateTime;
+                float affordable = float(remaining * samplesPerSec /
+                                         nFilmPixels);
+                if (affordable < 1.f) break;
+                if (affordable < 2.f * iterSpp) spp = affordable;
+            }
+            if (budgetSpp >= sampler->MaximumSampleCount()) break;
+
+            vector<vector<int> > pixOff;
+            vector<vector<int> > pixSmp;
+            Timer updateTimer;
+            updateTimer.Start();
+            // Small iterations leave converged regions without samples,
+            // which keeps the next update from refiltering them
+            sbfFilm->GetAdaptPixels(spp, pixOff, pixSmp, false);
+            updateTime = updateTimer.Time();
+            float mse = sbfFilm->GetMeanEstimatedMSE();
+            Info("Adaptive iteration %d: mean estimated MSE %g, "
+                 "%.1f spp so far", iter, mse, totalSpp);
+            if (targetMse > 0.f && mse <= targetMse) break;
+            if (timeBudget > 0.f &&
+                renderTimer.Time() + 3. * updateTime >= timeBudget) break;
+
+            sbfSampler->SetPixelOffset(&pixOff);
+            sbfSampler->SetPixelSampleCount(&pixSmp);
+            int64_t nSamples = 0;
+            for (uint32_t y = 0; y < pixSmp.size(); ++y)
+                for (uint32_t x = 0; x < pixSmp[y].size(); ++x)
+                    nSamples += min(pixSmp[y][x],
+                                    sampler->MaximumSampleCount());
+            double passTime = RenderPass(scene, sample, "Adaptive Sampling",
+                                         rngs, maxDepth);
+            if (passTime > 0.)
+                samplesPerSec = nSamples / passTime;
+            totalSpp += float(nSamples) / nFilmPixels;
+            budgetSpp += spp;
+        }
+    }
+    else if(sbfSampler->GetAdaptiveSPP() > 0.f && sbfSampler->GetIteration() > 0) {
         for(int iter = 0; iter < sbfSampler->GetIteration(); iter++) {
             vector<vector<int> > pixOff;
             vector<vector<int> > pixSmp;
             sbfFilm->GetAdaptPixels(sbfSampler->GetAdaptiveSPP(), pixOff, pixSmp);
             sbfSampler->SetPixelOffset(&pixOff);
             sbfSampler->SetPixelSampleCount(&pixSmp);
-
-            ProgressReporter asReporter(nTasks, "Adaptive Sampling");
-            renderTasks.clear();
-            for (int i = 0; i < nTasks; ++i)
-                renderTasks.push_back(new SBFRendererTask(scene, this, camera,
-                            asReporter, sampler, sample, nTasks-1-i, nTasks,
-                            rngs[i], maxDepth));
-            EnqueueTasks(renderTasks);
-            WaitForAllTasks();
-            for (uint32_t i = 0; i < renderTasks.size(); ++i)
-                delete renderTasks[i];  
-            asReporter.Done();
+            RenderPass(scene, sample, "Adaptive Sampling", rngs, maxDepth);
         }
     }
     
@@ -44,7 +44,7 @@ class SBFRenderer : public Renderer {
 public:
     // SBFRenderer Public Methods
     SBFRenderer(Sampler *s, Camera *c, SurfaceIntegrator *si,
-                    VolumeIntegrator *vi);
+                    VolumeIntegrator *vi, float tb = 0.f, float tm = 0.f);
     ~SBFRenderer();
     void Render(const Scene *scene);
     Spectrum Li(const Scene *scene, const RayDifferential &ray,
@@ -53,11 +53,16 @@ public:
     Spectrum Transmittance(const Scene *scene, const RayDifferential &ray,
         const Sample *sample, RNG &rng, MemoryArena &arena) const;
 private:
+    // SBFRenderer Private Methods
+    double RenderPass(const Scene *scene, Sample *sample, const char *name,
+                      vector<RNG> &rngs, float maxDepth);
+
     // SBFRenderer Private Data
     Sampler *sampler;
     Camera *camera;
     SurfaceIntegrator *surfaceIntegrator;
     VolumeIntegrator *volumeIntegrator;
+    float timeBudget, targetMse;
 };
 
 
@@ -68,12 +73,13 @@ public:
     // SamplerRendererTask Public Methods
     SBFRendererTask(const Scene *sc, Renderer *ren, Camera *c,
                         ProgressReporter &pr, Sampler *ms, Sample *sam, 
-                        int tn, int tc, RNG &r, float md)
+                        int tn, int tc, RNG &r, float md,
+                        double *rt = NULL)
       : reporter(pr), rng(r)
     {
         scene = sc; renderer = ren; camera = c; mainSampler = ms;
         origSample = sam; taskNum = tn; taskCount = tc;        
-        maxDepth = md;
+        maxDepth = md; runTime = rt;
     }
     void Run();
 private:
@@ -87,6 +93,7 @@ private:
     int taskNum, taskCount;
     RNG &rng;
     float maxDepth;
+    double *runTime;
 };
 
 
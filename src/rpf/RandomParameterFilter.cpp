@@ -62,18 +62,19 @@ const float MAX_SAMPLES_FACTOR_HIGH[] = { 0.5f, 0.5f, 0.5f, 0.5f }; // by sen
 int MAX_SAMPLES[4];
 
 RandomParameterFilter::RandomParameterFilter(const int width, const int height,
-		const int spp, const float _jouni, vector<SampleData> &_allSamples) :
-	allSamples(_allSamples), jouni(_jouni) {
+		const float _jouni, vector<SampleData> &_allSamples,
+		const vector<int> &_pixelOffsets) :
+	allSamples(_allSamples), pixelOffsets(_pixelOffsets), jouni(_jouni) {
 	this->w = width;
 	this->h = height;
-	this->spp = spp;
+	this->avgSpp = float(allSamples.size()) / float(w * h);
 	if (DEBUG) {
 		this->debugLog = fopen("rpf.log", "w");
-		fprintf(debugLog, "Number of samples: %lu, size: %dx%d, spp: %d \n",
-				allSamples.size(), w, h, spp);
+		fprintf(debugLog, "Number of samples: %lu, size: %dx%d, spp: %.2f \n",
+				allSamples.size(), w, h, avgSpp);
 	}
-	printf("Number of samples: %lu, size: %dx%d, spp: %d \n",
-			allSamples.size(), w, h, spp);
+	printf("Number of samples: %lu, size: %dx%d, spp: %.2f \n",
+			allSamples.size(), w, h, avgSpp);
 }
 
 void RandomParameterFilter::Apply() {
@@ -91,8 +92,13 @@ void RandomParameterFilter::Apply() {
 #pragma omp parallel for num_threads(PbrtOptions.nCores)
 		for (int pixel_nr = 0; pixel_nr < w * h; pixel_nr++) {
 #endif
-			const int pixel_idx = pixel_nr * spp;
-			vector<SampleData> neighbourhood = determineNeighbourhood(BOX_SIZE[iterStep], MAX_SAMPLES[iterStep], pixel_idx);
+			if (pixel_nr % (20*w) == 0) {
+				reporter.Update(20*w);
+			}
+			// Pixels without samples are left black
+			if (pixelSampleCount(pixel_nr) == 0)
+				continue;
+			vector<SampleData> neighbourhood = determineNeighbourhood(BOX_SIZE[iterStep], MAX_SAMPLES[iterStep], pixel_nr);
 
 			if (DEBUG) {
 				fprintf(debugLog, "\nNormalized feature vectors in neighbourhood: \n");
@@ -116,11 +122,7 @@ void RandomParameterFilter::Apply() {
 				for(uint i=0; i<beta.size(); i++) { fprintf(debugLog, "%-.3f, ", beta[i]); }
 				fflush(debugLog);
 			}
-			filterColorSamples(alpha, beta, W_r_c, neighbourhood, pixel_idx);
-
-			if (pixel_nr % (20*w) == 0) {
-				reporter.Update(20*w);
-			}
+			filterColorSamples(alpha, beta, W_r_c, neighbourhood, pixel_nr);
 		}
 
 		//write output to input
@@ -141,15 +143,17 @@ void RandomParameterFilter::Apply() {
 
 void RandomParameterFilter::dumpIntermediateResults(int iterStep) {
 	TwoDArray<Color> fltImg = TwoDArray<Color>(w, h);
-	for (uint i=0; i < allSamples.size(); i+=spp) {
+	for (int p = 0; p < w * h; p++) {
+		const int n = pixelSampleCount(p);
+		if (n == 0) continue;
 		Color c;
-		for (int j=0; j<spp; j++)
+		for (int j = pixelOffsets[p]; j < pixelOffsets[p + 1]; j++)
 			for(int k=0; k<3;k++){
 				//TODO: if jkl_dump is used, this should also be multiplied with rho
-				c[k] += allSamples[i+j].outputColors[k]; //*allSamples[i+j].rho[k];
+				c[k] += allSamples[j].outputColors[k]; //*allSamples[j].rho[k];
 			}
-		c /= spp;
-		fltImg(allSamples[i].x, allSamples[i].y) = c;
+		c /= n;
+		fltImg(p % w, p / w) = c;
 	}
 	// passing null as alpha makes it 1.f for pixel
 	WriteImage("pass" + to_string(iterStep+1) + ".exr", (float*)fltImg.GetRawPtr(), NULL, w, h,
@@ -161,13 +165,18 @@ void RandomParameterFilter::dumpIntermediateResults(int iterStep) {
  */
 void RandomParameterFilter::preprocessSamples() {
 	printf("Preprocessing... \n");
-	vector<int> pixelWithInvalidSamplesCount(spp);
+	int maxSpp = 0;
+	for (int p = 0; p < w * h; p++)
+		maxSpp = max(maxSpp, pixelSampleCount(p));
+	vector<int> pixelWithInvalidSamplesCount(maxSpp);
 	RNG rng(42);
-	for (uint pixelOffset = 0; pixelOffset < allSamples.size(); pixelOffset+= spp) {
+	for (int p = 0; p < w * h; p++) {
+		const int pixelOffset = pixelOffsets[p], n = pixelSampleCount(p);
+		if (n == 0) continue;
 		SampleData pixelValidSamplesMean;
 		pixelValidSamplesMean.reset();
 		vector<uint> validSamplesIdx, invalidSamplesIdx;
-		for (int sampleOffset = 0; sampleOffset < spp; sampleOffset++) {
+		for (int sampleOffset = 0; sampleOffset < n; sampleOffset++) {
 			uint idx = pixelOffset + sampleOffset;
 			SampleData &s = allSamples[idx];
 			if (PREAPPLY_GAMMA) {
@@ -217,7 +226,7 @@ void RandomParameterFilter::preprocessSamples() {
 		}
 	}
 	bool fixedInvalidSamples = false;
-	for (int i=0; i < spp; i++) {
+	for (int i=0; i < maxSpp; i++) {
 		if (pixelWithInvalidSamplesCount[i]) {
 			printf("%d pixels with %d invalid samples \n", pixelWithInvalidSamplesCount[i], i + 1);
 			fixedInvalidSamples = true;
@@ -230,12 +239,13 @@ void RandomParameterFilter::preprocessSamples() {
 }
 
 vector<SampleData> RandomParameterFilter::determineNeighbourhood(
-		const int boxsize, const int maxSamples, const int pixelIdx) {
+		const int boxsize, const int maxSamples, const int pixelNr) {
+	const int pixelIdx = pixelOffsets[pixelNr], n = pixelSampleCount(pixelNr);
 	vector<SampleData> neighbourhood;
-	neighbourhood.reserve(maxSamples);
+	neighbourhood.reserve(max(maxSamples, n));
  
 	// add all samples of current pixel
-	for (int i = 0; i < spp; i++) {
+	for (int i = 0; i < n; i++) {
 		neighbourhood.push_back(allSamples[pixelIdx + i]);
 	}
 
@@ -243,20 +253,26 @@ vector<SampleData> RandomParameterFilter::determineNeighbourhood(
 	const float stdv = boxsize / 4.f;
 
 	SampleData pixelMean, pixelStd;
-	getPixelMeanAndStd(pixelIdx, pixelMean, pixelStd);
+	getPixelMeanAndStd(pixelNr, pixelMean, pixelStd);
 	RNG rng(pixelIdx);
-	for (int i = 0; i < maxSamples - spp; i++) {
+	for (int i = 0; i < maxSamples - n; i++) {
 		int x = 0, y = 0, idx; // x, y are only set to prevent warning
-		//retry, as long as its not in picture or original pixel
-		do {
+		//retry, as long as its not in picture or original pixel, give up
+		//on boxes that hardly hold any samples
+		bool found = false;
+		for (int tries = 0; tries < 64 && !found; tries++) {
 			float offsetX, offsetY;
 			getGaussian(stdv, offsetX, offsetY, rng);
 			if (CROP_BOX && (fabs(offsetX) >= boxsize/2.f || fabs(offsetY) >= boxsize/2.f))		// get only pixels inside of 'box'
 				continue;
 			x = pixelMean.x + int(floor(offsetX+0.5f));
 			y = pixelMean.y + int(floor(offsetY+0.5f));
-		} while((x == pixelMean.x && y == pixelMean.y) || 			// can not be same pixel
-				x < 0 || y < 0 || x >= w || y >= h);				// or outside of image
+			found = !(x == pixelMean.x && y == pixelMean.y) && 		// can not be same pixel
+					x >= 0 && y >= 0 && x < w && y < h &&				// or outside of image
+					pixelSampleCount(x + y*w) > 0;						// or without samples
+		}
+		if (!found)
+			continue;
 		SampleData &sample = getRandomSampleAt(x, y, idx, rng);
 		bool flag = true;
 		for (int f = FEATURES_OFFSET; f < FEATURES_SIZE && flag; f++) {
@@ -367,13 +383,14 @@ void RandomParameterFilter::computeWeights(vector<float> &alpha, vector<float> &
 }
 
 void RandomParameterFilter::filterColorSamples(vector<float> &alpha, vector<float> &beta, float W_r_c,
-		vector<SampleData> &neighbourhood, int pixelIdx) {
-	const float var = 8*jouni/spp;
+		vector<SampleData> &neighbourhood, int pixelNr) {
+	const int pixelIdx = pixelOffsets[pixelNr], n = pixelSampleCount(pixelNr);
+	const float var = 8*jouni/n;
 
 	const float scale_f = -sqr(1 - W_r_c) / (2*var);
 	const float scale_c = scale_f;
 	if (DEBUG) fprintf(debugLog, "\nInput colors vs Output colors (before HDR Clamp):\n");
-	for (int i=0; i<spp; i++) {
+	for (int i=0; i<n; i++) {
 		float color[3];
 		for (int j=0; j<3;j++) {color[j] = 0.f; }
 		float sum_relative_weights = 0.f;
@@ -406,7 +423,7 @@ void RandomParameterFilter::filterColorSamples(vector<float> &alpha, vector<floa
 	if (HDR_CLAMP) {
 		float colorMean[3], colorM2[3], colorStd[3], colorMeanAfter[3];
 		for (int i=0; i<3; i++) { colorMean[i] = colorM2[i] = colorMeanAfter[i] = 0.f; }
-		for (int i=0; i<spp; i++) {
+		for (int i=0; i<n; i++) {
 			SampleData &s = allSamples[pixelIdx + i];
 			for(int j=0; j<3; j++) {
 				float delta = s.outputColors[j] - colorMean[j];
@@ -415,10 +432,10 @@ void RandomParameterFilter::filterColorSamples(vector<float> &alpha, vector<floa
 			}
 		}
 		for (int i=0; i<3; i++) {
-			colorStd[i] = sqrt(colorM2[i]/(spp - 1));
+			colorStd[i] = n > 1 ? sqrt(colorM2[i]/(n - 1)) : 0.f;
 		}
 	#define STD_FACTOR 1
-		for (int i=0; i<spp; i++) {
+		for (int i=0; i<n; i++) {
 			SampleData &s = allSamples[pixelIdx + i];
 			if( fabs(s.outputColors[0] - colorMean[0]) > STD_FACTOR*colorStd[0] ||
 				fabs(s.outputColors[1] - colorMean[1]) > STD_FACTOR*colorStd[1] ||
@@ -434,13 +451,13 @@ void RandomParameterFilter::filterColorSamples(vector<float> &alpha, vector<floa
 
 		if (REINSERT_ENERGY_HDR_CLAMP) {
 			for (int j=0; j<3; j++) {
-				colorMeanAfter[j] /= spp;
+				colorMeanAfter[j] /= n;
 			}
 
 			// reinsert energy from HDR clamp
 			float lostEnergyPerSample[3];
 			for (int i=0; i<3; i++) { lostEnergyPerSample[i] = colorMean[i] - colorMeanAfter[i]; }
-			for (int i=0; i<spp; i++) {
+			for (int i=0; i<n; i++) {
 				SampleData &s = allSamples[pixelIdx + i];
 				for (int j=0; j<3; j++) {
 					s.outputColors[j] += lostEnergyPerSample[j];
@@ -451,7 +468,7 @@ void RandomParameterFilter::filterColorSamples(vector<float> &alpha, vector<floa
 
 	if (DEBUG) {
 		fprintf(debugLog, "After HDR-clamp and reinsertion of energy: \n");
-		for (int i = 0; i < spp; i++) { //can I assign the whole array at once?
+		for (int i = 0; i < n; i++) { //can I assign the whole array at once?
 			SampleData &s = allSamples[pixelIdx + i];
 			for (int k=0; k<3; k++) fprintf(debugLog, "%-.4f, %-.4f\n", s.inputColors[k], s.outputColors[k]);
 		}
@@ -463,8 +480,9 @@ void RandomParameterFilter::filterColorSamples(vector<float> &alpha, vector<floa
  * Everything else is set to 0 (rgb, random params etc.)
  * Only x, y are taken from the first sample of the pixel and assigned to pixelMean
  */
-void RandomParameterFilter::getPixelMeanAndStd(int pixelIdx,
+void RandomParameterFilter::getPixelMeanAndStd(int pixelNr,
 		SampleData &pixelMean, SampleData &pixelStd) const {
+	const int pixelIdx = pixelOffsets[pixelNr], spp = pixelSampleCount(pixelNr);
 	SampleData pixelMeanSquare;
 	pixelMean.reset(); pixelMeanSquare.reset();
 	//set x and y separately
@@ -486,7 +504,7 @@ void RandomParameterFilter::getPixelMeanAndStd(int pixelIdx,
 		}
 	}
 	for(int f=0;f<FEATURES_SIZE;f++) {
-		pixelStd[f] = sqrt(M2[f]/(spp - 1));	// breaks for spp = 1
+		pixelStd[f] = spp > 1 ? sqrt(M2[f]/(spp - 1)) : 0.f;
 	}
 }
 
@@ -504,7 +522,8 @@ void RandomParameterFilter::getGaussian(const float stddev, float &x, float &y,
 }
 
 SampleData& RandomParameterFilter::getRandomSampleAt(const int x, int y, int &idx, RNG &rng) const {
-	idx = (x + y*w)*spp + (int)(spp*rng.RandomFloat());
+	const int p = x + y*w;
+	idx = pixelOffsets[p] + (int)(pixelSampleCount(p)*rng.RandomFloat());
 	return allSamples[idx];
 }
 
@@ -519,7 +538,7 @@ void RandomParameterFilter::setQuality(string quality_string){
 		printf("Filter quality set to medium\n");
 	}
 	for (int i = 0; i < 4; i++) {
-		MAX_SAMPLES[i] = sqr(BOX_SIZE[i]) * spp;
+		MAX_SAMPLES[i] = sqr(BOX_SIZE[i]) * avgSpp;
 		if (quality == Quality::MEDIUM)
 			MAX_SAMPLES[i] *= MAX_SAMPLES_FACTOR_MEDIUM[i];
 		else
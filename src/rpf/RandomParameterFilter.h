@@ -51,29 +51,33 @@ public:
 	        MEDIUM
 	    };
 
+    // Pixel p owns samples [pixelOffsets[p], pixelOffsets[p+1]) of allSamples
     RandomParameterFilter(const int width, const int height,
-    		const int spp, const float jouni,
-    		vector<SampleData> &allSamples);
+    		const float jouni, vector<SampleData> &allSamples,
+    		const vector<int> &pixelOffsets);
 
     void Apply();
 
     void setQuality(const string quality);
     void setRandomParams(string randomParamsString);
 private:
-    int h, w, spp, randomParamsOffset, randomParamsSize;
+    int h, w, randomParamsOffset, randomParamsSize;
+    float avgSpp;
 	FILE *debugLog;
 	vector<SampleData> &allSamples;
+	const vector<int> &pixelOffsets;
 	const float jouni;
 
 	void preprocessSamples();
 	void dumpIntermediateResults(int iterStep);
-    vector<SampleData> determineNeighbourhood(const int boxsize, const int maxSamples, const int pixelIdx);
+    vector<SampleData> determineNeighbourhood(const int boxsize, const int maxSamples, const int pixelNr);
     void computeWeights(vector<float> &alpha, vector<float> &beta, float &W_r_c, vector<SampleData> &neighbourhood,int iterStep);
-    void filterColorSamples(vector<float> &alpha, vector<float> &beta, float W_r_c, vector<SampleData> &neighbourhood, int currentPixelIdx);
+    void filterColorSamples(vector<float> &alpha, vector<float> &beta, float W_r_c, vector<SampleData> &neighbourhood, int pixelNr);
     //some helpers
     inline float sqr(float a) const {return a*a;};
     inline float rcp(const float a) const { return (a) ? 1.f/ a : 0.f; };
-    void getPixelMeanAndStd(int pixelIdx, SampleData &sampleMean, SampleData &sampleStd) const;
+    int pixelSampleCount(int pixelNr) const { return pixelOffsets[pixelNr + 1] - pixelOffsets[pixelNr]; }
+    void getPixelMeanAndStd(int pixelNr, SampleData &sampleMean, SampleData &sampleStd) const;
     void getGaussian(const float stddev, float &x, float &y, RNG &rng) const;
     SampleData& getRandomSampleAt(const int x, const int y, int &idx, RNG &rng) const; //TODO: long for veeery big images?
 };
@@ -40,15 +40,38 @@
 #include <fstream>
 #include "filter_utils/fmath.hpp"
 
+// Random parameters that _RandomParameterFilter::setRandomParams()_ reads
+// besides the first reflection direction, which is derived from the origins
+static uint32_t RandomParamFeatures(const string &randomParams) {
+    bool frd = randomParams.find("frd") != string::npos;
+    bool lens = randomParams.find("lens") != string::npos;
+    bool time = randomParams.find("time") != string::npos;
+    if (randomParams == "frd") return 0;
+    if (randomParams == "lens") return SAMPLE_LENS_POS;
+    if (randomParams == "time") return SAMPLE_TIME;
+    if (frd && lens) return SAMPLE_LENS_POS;
+    if (lens && time) return SAMPLE_LENS_POS | SAMPLE_TIME;
+    if (randomParams != "all")
+        Warning("Unknown RPF random parameters \"%s\", using \"all\"",
+                randomParams.c_str());
+    return SAMPLE_LENS_POS | SAMPLE_TIME;
+}
+
 RPF::RPF(int xs, int ys, int w, int h,
-          float _jouni, string _qual, string _randomParams) :
+          float _jouni, string _qual, string _randomParams,
+          int captureSamples, float captureMemory) :
           jouni(_jouni), quality(_qual), randomParams(_randomParams) {
     xPixelStart = xs;
     yPixelStart = ys;
     xPixelCount = w;
     yPixelCount = h;
-    spp = 8;
-    allSamples = vector<SampleData> (spp*xPixelCount*yPixelCount);
+    uint32_t features = SAMPLE_COLOR | SAMPLE_IMAGE_POS | SAMPLE_NORMAL |
+        SAMPLE_RHO | SAMPLE_SECOND_NORMAL | SAMPLE_SECOND_ORIGIN |
+        SAMPLE_THIRD_ORIGIN | RandomParamFeatures(randomParams);
+    fixedCapture = captureSamples > 0;
+    samples = new SampleBuffer(xPixelStart, yPixelStart, xPixelCount, yPixelCount,
+                               features, fixedCapture ? captureSamples : 8,
+                               captureMemory);
     colImg = TwoDArray<Color>(xPixelCount, yPixelCount);
 
     //for debugging
@@ -61,49 +84,70 @@ RPF::RPF(int xs, int ys, int w, int h,
     timeImg = TwoDArray<float>(xPixelCount, yPixelCount);
 
     fltImg = TwoDArray<Color>(xPixelCount, yPixelCount);
-
-    sampleCount = -1;
 }
 
 void RPF::AddSample(const CameraSample &sample, const Spectrum &L,
                     const Intersection &isect) {    
-    int x = sample.x-xPixelStart;
-    int y = sample.y-yPixelStart;
-    // Check if the sample is in the image
-    if (x < 0 || y < 0 || x >= xPixelCount || y >= yPixelCount)  {
-        return;    
-    }
-    // Convert to 3d color space from Spectrum
-    float xyz[3];
-    L.ToRGB(xyz);
-    float rhoXYZ[3];
-    isect.rho.ToRGB(rhoXYZ);
-
-    int idx = AtomicAdd(&sampleCount, 1);
-    SampleData& sd = allSamples[idx];
-    sd.x = x;
-    sd.y = y;
-    float frdLength = 0.f;
-    for(int i = 0; i < 3; i++) {
-    	//bit dangerous to also apply this to output color, but useful for debugging
-    	sd.outputColors[i] = sd.inputColors[i] = sd.rgb[i] = xyz[i];
-    	sd.rho[i] = rhoXYZ[i];
-    	sd.normal[i] = isect.shadingN[i];
-    	sd.secondNormal[i] = isect.secondNormal[i];
-    	sd.secondOrigin[i] = isect.secondOrigin[i];
-    	sd.thirdOrigin[i] = isect.thirdOrigin[i];
-    	sd.firstReflectionDir[i] = sd.thirdOrigin[i] - sd.secondOrigin[i];
-    	frdLength += sd.firstReflectionDir[i]*sd.firstReflectionDir[i];
+    samples->AddSample(sample, L, isect);
+}
+
+void RPF::GatherSamples() {
+    // Lay out the stored samples pixel by pixel in scanline order
+    int nPixels = xPixelCount * yPixelCount;
+    pixelOffsets.resize(nPixels + 1);
+    int total = 0;
+    for (int y = 0; y < yPixelCount; y++)
+        for (int x = 0; x < xPixelCount; x++) {
+            pixelOffsets[y * xPixelCount + x] = total;
+            total += samples->StoredSamples(x, y);
+        }
+    pixelOffsets[nPixels] = total;
+    allSamples.resize(total);
+
+    const int colorOffset = samples->FeatureOffset(SAMPLE_COLOR);
+    const int imageOffset = samples->FeatureOffset(SAMPLE_IMAGE_POS);
+    const int lensOffset = samples->FeatureOffset(SAMPLE_LENS_POS);
+    const int timeOffset = samples->FeatureOffset(SAMPLE_TIME);
+    const int normalOffset = samples->FeatureOffset(SAMPLE_NORMAL);
+    const int rhoOffset = samples->FeatureOffset(SAMPLE_RHO);
+    const int secNormalOffset = samples->FeatureOffset(SAMPLE_SECOND_NORMAL);
+    const int secOrigOffset = samples->FeatureOffset(SAMPLE_SECOND_ORIGIN);
+    const int thirdOrigOffset = samples->FeatureOffset(SAMPLE_THIRD_ORIGIN);
+#pragma omp parallel for num_threads(PbrtOptions.nCores)
+    for (int p = 0; p < nPixels; p++) {
+        int x = p % xPixelCount, y = p / xPixelCount;
+        for (int i = 0; i < pixelOffsets[p + 1] - pixelOffsets[p]; i++) {
+            const float *r = samples->GetSample(x, y, i);
+            SampleData &sd = allSamples[pixelOffsets[p] + i];
+            sd.reset();
+            sd.x = x;
+            sd.y = y;
+            float frdLength = 0.f;
+            for(int k = 0; k < 3; k++) {
+                //bit dangerous to also apply this to output color, but useful for debugging
+                sd.outputColors[k] = sd.inputColors[k] = sd.rgb[k] = r[colorOffset + k];
+                sd.rho[k] = r[rhoOffset + k];
+                sd.normal[k] = r[normalOffset + k];
+                sd.secondNormal[k] = r[secNormalOffset + k];
+                sd.secondOrigin[k] = r[secOrigOffset + k];
+                sd.thirdOrigin[k] = r[thirdOrigOffset + k];
+                sd.firstReflectionDir[k] = sd.thirdOrigin[k] - sd.secondOrigin[k];
+                frdLength += sd.firstReflectionDir[k]*sd.firstReflectionDir[k];
+            }
+            // normalize firstReflectionDir
+            frdLength = sqrt(frdLength);
+            for (int k = 0; k < 3; k++)
+                sd.firstReflectionDir[k] /= frdLength;
+            sd.imgPos[0] = r[imageOffset];
+            sd.imgPos[1] = r[imageOffset + 1];
+            if (lensOffset >= 0) {
+                sd.lensPos[0] = r[lensOffset];
+                sd.lensPos[1] = r[lensOffset + 1];
+            }
+            if (timeOffset >= 0)
+                sd.time = r[timeOffset];
+        }
     }
-    // normalize firstReflectionDir
-    frdLength = sqrt(frdLength);
-    for (int i = 0; i < 3; i++)
-    	sd.firstReflectionDir[i] /= frdLength;
-    sd.imgPos[0] = sample.imageX;
-    sd.imgPos[1] = sample.imageY;
-    sd.lensPos[0] = sample.lensU;
-    sd.lensPos[1] = sample.lensV;
-	sd.time = sample.time;
 }
 
 void RPF::GetAdaptPixels(int spp, vector<vector<int> > &pixels) {
@@ -112,18 +156,16 @@ void RPF::GetAdaptPixels(int spp, vector<vector<int> > &pixels) {
 
 void RPF::WriteImage(const string &filename, int xres, int yres, bool dump) {
 
-	ProgressReporter reporter(2, "Sorting samples...");
-	std::sort(allSamples.begin(), allSamples.end());
-	reporter.Done();
+    GatherSamples();
 
     string filenameBase = filename.substr(0, filename.rfind("."));
     string filenameExt  = filename.substr(filename.rfind("."));
 
     if (dump) {
-		dumpAsBinary(filenameBase, xPixelCount, yPixelCount, spp, allSamples);
+		dumpAsBinary(filenameBase, xPixelCount, yPixelCount, pixelOffsets, allSamples);
     }
 
-	RandomParameterFilter rpf(xPixelCount, yPixelCount, spp, jouni, allSamples);
+	RandomParameterFilter rpf(xPixelCount, yPixelCount, jouni, allSamples, pixelOffsets);
 	rpf.setQuality(quality);
     rpf.setRandomParams(randomParams);
 	rpf.Apply();
@@ -159,8 +201,8 @@ void RPF::WriteImage(const string &filename, int xres, int yres, bool dump) {
 }
 
 void RPF::WriteImage(const string &filename, const TwoDArray<Color> &image, int xres, int yres) const {
-    ::WriteImage(filename, (float*)image.GetRawPtr(), NULL, xPixelCount, yPixelCount,
-                 xres, yres, 0, 0);
+    EnqueueImageWrite(filename, (const float*)image.GetRawPtr(), NULL, xPixelCount, yPixelCount,
+                      xres, yres, 0, 0);
 }
 
 TwoDArray<Color> RPF::FloatImageToColor(const TwoDArray<float> &image) const {
@@ -174,9 +216,11 @@ TwoDArray<Color> RPF::FloatImageToColor(const TwoDArray<float> &image) const {
 }
 
 void RPF::AssembleImages(bool dump) {
+    // Each pixel's samples are contiguous, so pixels accumulate in parallel
 #pragma omp parallel for num_threads(PbrtOptions.nCores)
-    for(uint i = 0; i < allSamples.size(); i++) {
-		SampleData sd = allSamples[i];
+    for(int p = 0; p < xPixelCount * yPixelCount; p++)
+    for(int i = pixelOffsets[p]; i < pixelOffsets[p + 1]; i++) {
+		const SampleData &sd = allSamples[i];
 
 		int x = sd.x;
 		int y = sd.y;
@@ -205,40 +249,54 @@ void RPF::AssembleImages(bool dump) {
 
     for (int y=0; y < yPixelCount; y++) {
     	for (int x = 0; x < xPixelCount; x++) {
-    		colImg(x, y) /= spp;
-			normalImg(x, y) /= spp;
-			rhoImg(x, y) /= spp;
+    		int p = y * xPixelCount + x;
+    		int n = pixelOffsets[p + 1] - pixelOffsets[p];
+    		if (n == 0) continue;
+    		colImg(x, y) /= n;
+			normalImg(x, y) /= n;
+			rhoImg(x, y) /= n;
 			//new
-			secNormalImg(x, y) /= spp;
-			secOrigImg(x, y) /= spp;
-			thirdOrigImg(x, y) /= spp;
-			lensImg(x, y) /= spp;
-			timeImg(x, y) /= spp;
+			secNormalImg(x, y) /= n;
+			secOrigImg(x, y) /= n;
+			thirdOrigImg(x, y) /= n;
+			lensImg(x, y) /= n;
+			timeImg(x, y) /= n;
+
+			Color c;
+			for (int j = pixelOffsets[p]; j < pixelOffsets[p + 1]; j++)
+				for(int k=0; k<3;k++){
+					c[k] += allSamples[j].outputColors[k];
+				}
+			c /= n;
+			fltImg(x, y) = c;
     	}
     }
 
-    for (uint i=0; i < allSamples.size(); i+=spp) {
-    	Color c;
-    	for (int j=0; j<spp; j++)
-    		for(int k=0; k<3;k++){
-    			c[k] += allSamples[i+j].outputColors[k];
-    		}
-    	c /= spp;
-    	fltImg(allSamples[i].x, allSamples[i].y) = c;
-    }
-
 }
 
+/**
+ * Writes width, height and samples per pixel followed by the samples in
+ * scanline order. When pixels hold different sample counts, the samples
+ * per pixel field is 0 and the per-pixel counts precede the samples.
+ */
 void RPF::dumpAsBinary(const string &filenameBase, const int w, const int h,
-		const int spp, const vector<SampleData> &allSamples) {
+		const vector<int> &pixelOffsets, const vector<SampleData> &allSamples) {
+	int spp = pixelOffsets[1] - pixelOffsets[0];
+	vector<int> counts(w * h);
+	for (int p = 0; p < w * h; p++) {
+		counts[p] = pixelOffsets[p + 1] - pixelOffsets[p];
+		if (counts[p] != spp) spp = 0;
+	}
 	std::ofstream dump(filenameBase + ".bin",
 			std::ifstream::out | std::ifstream::binary);
 	// DUMP NUMBER allSamples.size()
 	dump.write((char*) (&w), sizeof(int));
 	dump.write((char*) (&h), sizeof(int));
 	dump.write((char*) (&spp), sizeof(int));
-	dump.write((char*) (&(allSamples[0])),
-			allSamples.size() * sizeof(SampleData));
+	if (spp == 0)
+		dump.write((char*) (&(counts[0])), counts.size() * sizeof(int));
+	if (!allSamples.empty())
+		dump.write((char*) (&(allSamples[0])),
+				allSamples.size() * sizeof(SampleData));
 	dump.close();
 }
-
@@ -41,6 +41,7 @@
 #include "pbrt.h"
 #include "memory.h"
 #include "rng.h"
+#include "samplebuffer.h"
 #include "filter_utils/VectorNf.h"
 #include "filter_utils/TwoDArray.h"
 #include "SampleData.h"
@@ -49,7 +50,11 @@
 class RPF {
 public:       
 
-    RPF(int xs, int ys, int w, int h, float jouni, string qual, string randomParams);
+    RPF(int xs, int ys, int w, int h, float jouni, string qual, string randomParams,
+        int captureSamples, float captureMemory);
+    ~RPF() {
+        delete samples;
+    }
 
     void AddSample(const CameraSample &sample, const Spectrum &L, 
             const Intersection &isect);
@@ -57,21 +62,26 @@ public:
     void WriteImage(const string &filename, int xres, int yres, bool dump);
     void AssembleImages(bool dump);
 
+    // Sizes the per-pixel reservoirs unless "capturesamples" fixed them
     void SetSPP(int spp) {
-    	this->spp = spp;
-    	printf("Set spp to %d", spp);
-    	allSamples.resize(xPixelCount * yPixelCount * spp);
+        if (!fixedCapture)
+            samples->SetMaxSamplesPerPixel(spp);
     }
 	static void dumpAsBinary(const string &filenameBase, const int w, const int h,
-				const int spp, const vector<SampleData> &allSamples);
+				const vector<int> &pixelOffsets, const vector<SampleData> &allSamples);
 
 private:
+    void GatherSamples();
     void WriteImage(const string &filename, const TwoDArray<Color> &image, int xres, int yres) const;
     TwoDArray<Color> FloatImageToColor(const TwoDArray<float> &image) const;
-    int spp;
-    long volatile sampleCount;
+    // Captured samples, reservoir sampled down to a bounded count per pixel
+    SampleBuffer *samples;
+    bool fixedCapture;
 
+    // Samples gathered for filtering, pixel _p_ owns the range
+    // [pixelOffsets[p], pixelOffsets[p+1])
     vector<SampleData> allSamples;
+    vector<int> pixelOffsets;
     int xPixelStart, yPixelStart;
     int xPixelCount, yPixelCount;
     const float jouni;
@@ -48,8 +48,7 @@ RandomSampler::RandomSampler(int xstart, int xend,
     timeSamples = lensSamples + 2 * nSamples;
 
     RNG rng(xstart + ystart * (xend-xstart));
-    for (int i = 0; i < 5 * nSamples; ++i)
-        imageSamples[i] = rng.RandomFloat();
+    rng.RandomFloats(imageSamples, 5 * nSamples);
 
     // Shift image samples to pixel coordinates
     for (int o = 0; o < 2 * nSamples; o += 2) {
@@ -82,8 +81,7 @@ int RandomSampler::GetMoreSamples(Sample *sample, RNG &rng) {
         if (yPos == yPixelEnd)
             return 0;
 
-        for (int i = 0; i < 5 * nSamples; ++i)
-            imageSamples[i] = rng.RandomFloat();
+        rng.RandomFloats(imageSamples, 5 * nSamples);
 
         // Shift image samples to pixel coordinates
         for (int o = 0; o < 2 * nSamples; o += 2) {
@@ -102,11 +100,9 @@ int RandomSampler::GetMoreSamples(Sample *sample, RNG &rng) {
     sample->y = yPos;
     // Generate stratified samples for integrators
     for (uint32_t i = 0; i < sample->n1D.size(); ++i)
-        for (uint32_t j = 0; j < sample->n1D[i]; ++j)
-            sample->oneD[i][j] = rng.RandomFloat();
+        rng.RandomFloats(sample->oneD[i], sample->n1D[i]);
     for (uint32_t i = 0; i < sample->n2D.size(); ++i)
-        for (uint32_t j = 0; j < 2*sample->n2D[i]; ++j)
-            sample->twoD[i][j] = rng.RandomFloat();
+        rng.RandomFloats(sample->twoD[i], 2*sample->n2D[i]);
     ++samplePos;
     return 1;
 }
@@ -36,80 +36,47 @@
 #include "camera.h"
 
 #include <iostream>
-
-// A modified LD samples generator that accepts an "offset"
-inline void LDShuffleScrambled1D(int offset, int nSamples, int nPixel,
-                                 float *samples, RNG &rng) {
-    uint32_t scramble = rng.RandomUInt();
-    for (int i = 0; i < nSamples * nPixel; ++i)
-        samples[i] = VanDerCorput(offset+i, scramble);
-    for (int i = 0; i < nPixel; ++i)
-        Shuffle(samples + i * nSamples, nSamples, 1, rng);
-    Shuffle(samples, nPixel, nSamples, rng);
-}
-
-
-inline void LDShuffleScrambled2D(int offset, int nSamples, int nPixel,
-                                 float *samples, RNG &rng) {
-    uint32_t scramble[2] = { (uint32_t)rng.RandomUInt(), (uint32_t)rng.RandomUInt() };
-    for (int i = 0; i < nSamples * nPixel; ++i)
-        Sample02(offset+i, scramble, &samples[2*i]);
-    for (int i = 0; i < nPixel; ++i)
-        Shuffle(samples + 2 * i * nSamples, nSamples, 2, rng);
-    Shuffle(samples, nPixel, 2 * nSamples, rng);
-}
-
-void LDPixelSample(int offset, int xPos, int yPos, float shutterOpen,
-        float shutterClose, int nPixelSamples, Sample *samples,
-        float *buf, RNG &rng) {
-    // Prepare temporary array pointers for low-discrepancy camera samples
-    float *imageSamples = buf; buf += 2 * nPixelSamples;
-    float *lensSamples = buf;  buf += 2 * nPixelSamples;
-    float *timeSamples = buf;  buf += nPixelSamples;
-
-    // Prepare temporary array pointers for low-discrepancy integrator samples
+#include <algorithm>
+
+// Each pixel and sample dimension has its own Owen-scrambled Sobol'
+// sequence, indexed directly by the pixel's sample number. Starting at
+// the number of samples a pixel already took, adaptive iterations keep
+// extending the same stratified sequence.
+static void SobolPixelSample(int offset, int xPos, int yPos, float shutterOpen,
+        float shutterClose, int nPixelSamples, Sample *samples) {
     uint32_t count1D = samples[0].n1D.size();
     uint32_t count2D = samples[0].n2D.size();
     const uint32_t *n1D = count1D > 0 ? &samples[0].n1D[0] : NULL;
     const uint32_t *n2D = count2D > 0 ? &samples[0].n2D[0] : NULL;
-    float **oneDSamples = ALLOCA(float *, count1D);
-    float **twoDSamples = ALLOCA(float *, count2D);
-    for (uint32_t i = 0; i < count1D; ++i) {
-        oneDSamples[i] = buf;
-        buf += n1D[i] * nPixelSamples;
-    }
-    for (uint32_t i = 0; i < count2D; ++i) {
-        twoDSamples[i] = buf;
-        buf += 2 * n2D[i] * nPixelSamples;
-    }
 
-    // Generate low-discrepancy pixel samples
-    LDShuffleScrambled2D(offset, 1, nPixelSamples, imageSamples, rng);
-    LDShuffleScrambled2D(offset, 1, nPixelSamples, lensSamples, rng);
-    LDShuffleScrambled1D(offset, 1, nPixelSamples, timeSamples, rng);
-    for (uint32_t i = 0; i < count1D; ++i)
-        LDShuffleScrambled1D(offset, n1D[i], nPixelSamples, oneDSamples[i], rng);
-    for (uint32_t i = 0; i < count2D; ++i)
-        LDShuffleScrambled2D(offset, n2D[i], nPixelSamples, twoDSamples[i], rng);
+    // Image, lens and time come first, then the integrator dimensions
+    uint32_t nDims = 3 + count1D + count2D;
+    uint32_t *seeds = ALLOCA(uint32_t, nDims);
+    for (uint32_t d = 0; d < nDims; ++d)
+        seeds[d] = SobolSeed(xPos, yPos, d);
+    const uint32_t *seeds1D = seeds + 3;
+    const uint32_t *seeds2D = seeds + 3 + count1D;
 
-    // Initialize _samples_ with computed sample values
     for (int i = 0; i < nPixelSamples; ++i) {
-        samples[i].imageX = xPos + imageSamples[2*i];
-        samples[i].imageY = yPos + imageSamples[2*i+1];
-        samples[i].time = Lerp(timeSamples[i], shutterOpen, shutterClose);
-        samples[i].lensU = lensSamples[2*i];
-        samples[i].lensV = lensSamples[2*i+1];
-        // Copy integrator samples into _samples[i]_
-        for (uint32_t j = 0; j < count1D; ++j) {
-            int startSamp = n1D[j] * i;
+        uint32_t index = uint32_t(offset + i);
+        float u[2];
+        ScrambledSobol2D(index, seeds[0], u);
+        samples[i].imageX = xPos + u[0];
+        samples[i].imageY = yPos + u[1];
+        ScrambledSobol2D(index, seeds[1], u);
+        samples[i].lensU = u[0];
+        samples[i].lensV = u[1];
+        samples[i].time = Lerp(ScrambledSobol1D(index, seeds[2]),
+                               shutterOpen, shutterClose);
+        // Sample arrays of a dimension stratify together across samples
+        for (uint32_t j = 0; j < count1D; ++j)
             for (uint32_t k = 0; k < n1D[j]; ++k)
-                samples[i].oneD[j][k] = oneDSamples[j][startSamp+k];
-        }
-        for (uint32_t j = 0; j < count2D; ++j) {
-            int startSamp = 2 * n2D[j] * i;
-            for (uint32_t k = 0; k < 2*n2D[j]; ++k)
-                samples[i].twoD[j][k] = twoDSamples[j][startSamp+k];
-        }
+                samples[i].oneD[j][k] =
+                    ScrambledSobol1D(index * n1D[j] + k, seeds1D[j]);
+        for (uint32_t j = 0; j < count2D; ++j)
+            for (uint32_t k = 0; k < n2D[j]; ++k)
+                ScrambledSobol2D(index * n2D[j] + k, seeds2D[j],
+                                 &samples[i].twoD[j][2*k]);
     }
 }
 
@@ -129,13 +96,53 @@ SBFSampler::SBFSampler(int xstart, int xend,
     
     pixelOffset = pixoff;
     pixelSampleCount = pixsmp;
-    sampleBuf = NULL;
+    pixelsLeft = -1;
 
     baseXStart = bxs != -1 ? bxs : xPixelStart;
     baseYStart = bys != -1 ? bys : yPixelStart;
 }
 
+void SBFSampler::SetPixelSampleCount(vector<vector<int> > *ps) {
+    pixelSampleCount = ps;
+    sampleCountSum.clear();
+    if (!ps) return;
+    // Accumulate per-pixel cost, counting one extra sample for pixel overhead
+    int nx = xPixelEnd - xPixelStart, ny = yPixelEnd - yPixelStart;
+    sampleCountSum.reserve(nx * ny + 1);
+    sampleCountSum.push_back(0);
+    for (int y = yPixelStart; y < yPixelEnd; ++y)
+        for (int x = xPixelStart; x < xPixelEnd; ++x) {
+            int spp = min((*ps)[y-baseYStart][x-baseXStart], maxSamples);
+            sampleCountSum.push_back(sampleCountSum.back() + max(spp, 0) + 1);
+        }
+}
+
+
+int SBFSampler::PixelForSampleCount(int64_t n) const {
+    return int(std::lower_bound(sampleCountSum.begin(), sampleCountSum.end(),
+                                n) - sampleCountSum.begin());
+}
+
+
 Sampler *SBFSampler::GetSubSampler(int num, int count) {    
+    if (pixelSampleCount && sampleCountSum.size() > 1) {
+        // Assign a run of scanline-ordered pixels with about 1/count of the samples
+        int64_t total = sampleCountSum.back();
+        int p0 = PixelForSampleCount(total * num / count);
+        int p1 = PixelForSampleCount(total * (num+1) / count);
+        if (p0 == p1) return NULL;
+        int width = xPixelEnd - xPixelStart;
+        int y0 = yPixelStart + p0 / width;
+        int y1 = yPixelStart + (p1 - 1) / width + 1;
+        SBFSampler *sub = new SBFSampler(xPixelStart, xPixelEnd,
+            y0, y1, samplesPerPixel, shutterOpen, shutterClose,
+            initSamples, maxSamples, iteration,
+            pixelOffset, pixelSampleCount,
+            baseXStart, baseYStart);
+        sub->xPos = xPixelStart + p0 % width;
+        sub->pixelsLeft = p1 - p0;
+        return sub;
+    }
     int x0, x1, y0, y1;
     ComputeSubWindow(num, count, &x0, &x1, &y0, &y1);
     if (x0 == x1 || y0 == y1) return NULL;
@@ -147,22 +154,28 @@ Sampler *SBFSampler::GetSubSampler(int num, int count) {
 }
 
 int SBFSampler::GetMoreSamples(Sample *samples, RNG &rng) {   
-    if (yPos == yPixelEnd) return 0;
-    
-    int spp = pixelSampleCount ?
-        min(((*pixelSampleCount)[yPos-baseYStart][xPos-baseXStart]), maxSamples) : 
-        initSamples;
-    if(!sampleBuf) {
-        sampleBuf = new float[LDPixelSampleFloatsNeeded(samples, maxSamples)];
+    int spp;
+    while (true) {
+        if (yPos == yPixelEnd || pixelsLeft == 0) return 0;
+        spp = pixelSampleCount ?
+            min(((*pixelSampleCount)[yPos-baseYStart][xPos-baseXStart]), maxSamples) : 
+            initSamples;
+        if (spp > 0) break;
+        // Adaptive passes may assign no samples to a pixel
+        if (++xPos == xPixelEnd) {
+            xPos = xPixelStart;
+            ++yPos;
+        }
+        if (pixelsLeft > 0) --pixelsLeft;
     }
-
-    LDPixelSample(pixelOffset ? (*pixelOffset)[yPos-baseYStart][xPos-baseXStart] : 0, xPos, yPos, 
-            shutterOpen, shutterClose, spp, samples, sampleBuf, rng);
+    SobolPixelSample(pixelOffset ? (*pixelOffset)[yPos-baseYStart][xPos-baseXStart] : 0, xPos, yPos, 
+            shutterOpen, shutterClose, spp, samples);
  
     if (++xPos == xPixelEnd) {
         xPos = xPixelStart;
         ++yPos;
     }
+    if (pixelsLeft > 0) --pixelsLeft;
 
     return spp;
 }
@@ -49,9 +49,6 @@ public:
         vector<vector<int> > *pixoff=NULL,
         vector<vector<int> > *pixsmp=NULL,
         int bxs=-1, int bys=-1);
-    virtual ~SBFSampler() {
-        if(sampleBuf) delete[] sampleBuf;
-    }
     int MaximumSampleCount() { return maxSamples; }
     int GetMoreSamples(Sample *sample, RNG &rng);
     int RoundSize(int sz) const { 
@@ -64,24 +61,30 @@ public:
     int GetIteration() const {
         return iteration;
     }
+    int GetInitSamples() const {
+        return initSamples;
+    }
     void SetPixelOffset(vector<vector<int> > *po) {
         pixelOffset = po;
     }
-    void SetPixelSampleCount(vector<vector<int> > *ps) {
-        pixelSampleCount = ps;
-    }
+    void SetPixelSampleCount(vector<vector<int> > *ps);
 private:
+    // SBFSampler Private Methods
+    int PixelForSampleCount(int64_t n) const;
 
     // SBFSampler Private Data              
     vector<vector<int> > *pixelOffset;
     vector<vector<int> > *pixelSampleCount;     
-    float *sampleBuf;
     int initSamples;
     float adaptiveSamples;
     int maxSamples;
     int iteration;
     int xPos, yPos;
     int baseXStart, baseYStart;
+    // Prefix sum of per-pixel sample counts in scanline order, used to
+    // give adaptive sampling tasks similar amounts of work
+    vector<int64_t> sampleCountSum;
+    int pixelsLeft;
 };
 
 
@@ -74,7 +74,8 @@ void CrossBilateralFilter::Apply(
                 const TwoDArray<Feature> &featureImg,
                 const TwoDArray<Feature> &featureVarImg,
                 vector<TwoDArray<float> > &outMSE,
-                vector<TwoDArray<float> > &outPri) const {
+                vector<TwoDArray<float> > &outPri,
+                const TileMask *mask) const {
 #pragma omp parallel for num_threads(PbrtOptions.nCores) schedule(static)
     for(int taskId = 0; taskId < nTasks; taskId++) {
         int txs, txe, tys, tye;
@@ -82,6 +83,8 @@ void CrossBilateralFilter::Apply(
                          &txs, &txe, &tys, &tye);
         for(int y = tys; y < tye; y++) {
             for(int x = txs; x < txe; x++) {
+                if(mask && !(*mask)(x, y))
+                    continue;
                 int ys = std::max(y-radius, 0);
                 int ye = std::min(y+radius, featureImg.GetRowNum()-1);
                 int xs = std::max(x-radius, 0);
@@ -127,7 +130,8 @@ void CrossBilateralFilter::Apply(const TwoDArray<Color> &img,
                                  const TwoDArray<Color> &rVarImg,
                                  TwoDArray<Color> &outImg,                                  
                                  TwoDArray<float> &outMSE,
-                                 TwoDArray<float> &outPri) const {
+                                 TwoDArray<float> &outPri,
+                                 const TileMask *mask) const {
 #pragma omp parallel for num_threads(PbrtOptions.nCores) schedule(static)
     for(int taskId = 0; taskId < nTasks; taskId++) {
         int txs, txe, tys, tye;
@@ -135,6 +139,8 @@ void CrossBilateralFilter::Apply(const TwoDArray<Color> &img,
                          &txs, &txe, &tys, &tye);
         for(int y = tys; y < tye; y++) {
             for(int x = txs; x < txe; x++) {
+                if(mask && !(*mask)(x, y))
+                    continue;
                 int dxs = max(x-radius, 0);
                 int dxe = min(x+radius, width-1);
                 int dys = max(y-radius, 0);
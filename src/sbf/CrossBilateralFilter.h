@@ -59,7 +59,8 @@ public:
                const TwoDArray<Feature> &featureImg,                  
                const TwoDArray<Feature> &featureVarImg,
                vector<TwoDArray<float> > &outMSE,
-               vector<TwoDArray<float> > &outPri) const;
+               vector<TwoDArray<float> > &outPri,
+               const TileMask *mask = NULL) const;
 
     // Filter MC reconstructed image
     void Apply(const TwoDArray<Color> &img,
@@ -70,7 +71,11 @@ public:
                const TwoDArray<Color> &rVarImg,
                TwoDArray<Color> &outImg,               
                TwoDArray<float> &outMSE,
-               TwoDArray<float> &outPri) const;
+               TwoDArray<float> &outPri,
+               const TileMask *mask = NULL) const;
+
+    // Distance in pixels over which the output depends on the input
+    int Radius() const { return radius; }
 
 private:    
     int radius;   
@@ -161,7 +161,8 @@ void CrossNLMFilter::Apply(const TwoDArray<Color> &img,
                const TwoDArray<Color> &varImg,
                vector<TwoDArray<Color> > &fltArray,
                vector<TwoDArray<float> > &mseArray,
-               vector<TwoDArray<float> > &priArray) const {    
+               vector<TwoDArray<float> > &priArray,
+               const TileMask *mask) const {    
 #pragma omp parallel for num_threads(PbrtOptions.nCores) schedule(static)   
     for(int taskId = 0; taskId < nTasks; taskId++) {
         int txs, txe, tys, tye;
@@ -169,6 +170,8 @@ void CrossNLMFilter::Apply(const TwoDArray<Color> &img,
                          &txs, &txe, &tys, &tye); 
         for(int y = tys; y < tye; y++) 
             for(int x = txs; x < txe; x++) { 
+                if(mask && !(*mask)(x, y))
+                    continue;
                 vector<Color> sum(scaleR.size(), Color(0.f));
                 vector<Color> rSum(scaleR.size(), Color(0.f));
                 vector<Color> rSumSq(scaleR.size(), Color(0.f));
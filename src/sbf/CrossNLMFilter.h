@@ -72,7 +72,11 @@ public:
                const TwoDArray<Color> &VarImg,
                vector<TwoDArray<Color> > &fltArray,
                vector<TwoDArray<float> > &mseArray,
-               vector<TwoDArray<float> > &priArray) const;
+               vector<TwoDArray<float> > &priArray,
+               const TileMask *mask = NULL) const;
+
+    // Patches around every pixel in the search window are compared
+    int Radius() const { return searchRadius + patchRadius; }
 
 private:
     int searchRadius, patchRadius;
@@ -53,13 +53,18 @@ public:
     inline ReconstructionFilter(const Filter *filter);
     template<typename T>
     void Apply(TwoDArray<T> &image) const;
+    // Half width of the kernel in pixels
+    int Radius() const { return max(xWidth, yWidth); }
 
 private:
     inline void BuildKernel(vector<float> &kernel);
 
     vector<float> xKernel;
     vector<float> yKernel;
+    float xKernelSum, yKernelSum;
     int xWidth, yWidth;
+    // Horizontal pass output, kept across calls to avoid reallocation
+    mutable vector<float> scratch;
 };
 
 ReconstructionFilter::ReconstructionFilter(const Filter *filter) {
@@ -81,45 +86,103 @@ ReconstructionFilter::ReconstructionFilter(const Filter *filter) {
         float w = filter->Evaluate(0.f, dist);
         yKernel[i] = w;        
     }
+
+    xKernelSum = yKernelSum = 0.f;
+    for(size_t i = 0; i < xKernel.size(); i++)
+        xKernelSum += xKernel[i];
+    for(size_t i = 0; i < yKernel.size(); i++)
+        yKernelSum += yKernel[i];
 }
 
+/**
+ *  T must be a packed array of floats (float or VectorNf<N>), so that
+ *  both passes can run over flat float rows: the horizontal pass is a
+ *  strided 1D convolution that needs no bounds checks away from the
+ *  image border, and the vertical pass accumulates whole rows, blocked
+ *  by columns so the rows under the kernel stay in cache.
+ */
 template<typename T>
 void ReconstructionFilter::Apply(TwoDArray<T> &image) const {
-    TwoDArray<T> tmpBuf(image.GetColNum(), image.GetRowNum());
+    const int nc = sizeof(T) / sizeof(float);
+    const int nCols = image.GetColNum();
+    const int nRows = image.GetRowNum();
+    const int rowLen = nCols * nc;
+    scratch.resize((size_t)rowLen * nRows);
+    float *tmpBuf = &scratch[0];
+    float *imgBuf = (float*)image.GetRawPtr();
+    const float *xk = &xKernel[0];
+    const float *yk = &yKernel[0];
 
     // X direction filter    
+    const int xBegin = min(xWidth, nCols);
+    const int xEnd = max(nCols - xWidth, xBegin);
+    const float invXKernelSum = 1.f / xKernelSum;
 #pragma omp parallel for num_threads(PbrtOptions.nCores)
-    for(int y = 0; y < image.GetRowNum(); y++)
-        for(int x = 0; x < image.GetColNum(); x++) {
-            int minX = max(x - xWidth, 0);
-            int maxX = min(x + xWidth, image.GetColNum()-1);
-            T sum = 0.f;
-            float wSum = 0.f;
-            int kPos = minX - x + xWidth;            
-            for(int xx = minX; xx <= maxX; xx++, kPos++) {
-                float w = xKernel[kPos];
-                sum += w*image(xx, y);
-                wSum += w;
-            }            
-            tmpBuf(x, y) = sum/wSum;
+    for(int y = 0; y < nRows; y++) {
+        const float *src = imgBuf + (size_t)y * rowLen;
+        float *dst = tmpBuf + (size_t)y * rowLen;
+        // Border pixels: clamp the kernel and renormalize
+        for(int seg = 0; seg < 2; seg++) {
+            const int segBegin = seg == 0 ? 0 : xEnd;
+            const int segEnd = seg == 0 ? xBegin : nCols;
+            for(int x = segBegin; x < segEnd; x++) {
+                int minX = max(x - xWidth, 0);
+                int maxX = min(x + xWidth, nCols-1);
+                float wSum = 0.f;
+                for(int c = 0; c < nc; c++)
+                    dst[x*nc+c] = 0.f;
+                int kPos = minX - x + xWidth;
+                for(int xx = minX; xx <= maxX; xx++, kPos++) {
+                    float w = xk[kPos];
+                    for(int c = 0; c < nc; c++)
+                        dst[x*nc+c] += w*src[xx*nc+c];
+                    wSum += w;
+                }
+                float invWSum = 1.f / wSum;
+                for(int c = 0; c < nc; c++)
+                    dst[x*nc+c] *= invWSum;
+            }
+        }
+        // Interior pixels: the full kernel fits, accumulate one tap
+        // over the whole run of the row at a time
+        const int iBegin = xBegin * nc, iEnd = xEnd * nc;
+        for(int i = iBegin; i < iEnd; i++)
+            dst[i] = 0.f;
+        for(int k = 0; k <= 2*xWidth; k++) {
+            const float w = xk[k];
+            const float *s = src + (k - xWidth) * nc;
+            for(int i = iBegin; i < iEnd; i++)
+                dst[i] += w * s[i];
         }
+        for(int i = iBegin; i < iEnd; i++)
+            dst[i] *= invXKernelSum;
+    }
 
     // Y direction filter
+    const int blockLen = 1024;
 #pragma omp parallel for num_threads(PbrtOptions.nCores)
-    for(int y = 0; y < image.GetRowNum(); y++)
-        for(int x = 0; x < image.GetColNum(); x++) {
-            int minY = max(y - yWidth, 0);
-            int maxY = min(y + yWidth, image.GetRowNum()-1);
-            T sum = 0.f;
-            float wSum = 0.f;
-            int kPos = minY - y + yWidth;            
-            for(int yy = minY; yy <= maxY; yy++, kPos++) {
-                float w = yKernel[kPos];
-                sum += w*tmpBuf(x, yy);
-                wSum += w;
-            } 
-            image(x, y) = sum/wSum;
+    for(int y = 0; y < nRows; y++) {
+        int minY = max(y - yWidth, 0);
+        int maxY = min(y + yWidth, nRows-1);
+        float wSum = 0.f;
+        for(int yy = minY; yy <= maxY; yy++)
+            wSum += yk[yy - y + yWidth];
+        const float invWSum = 1.f / wSum;
+        float *dst = imgBuf + (size_t)y * rowLen;
+        for(int b = 0; b < rowLen; b += blockLen) {
+            const int bEnd = min(b + blockLen, rowLen);
+            for(int i = b; i < bEnd; i++)
+                dst[i] = 0.f;
+            for(int yy = minY; yy <= maxY; yy++) {
+                const float w = yk[yy - y + yWidth];
+                const float *src = tmpBuf + (size_t)yy * rowLen;
+                for(int i = b; i < bEnd; i++)
+                    dst[i] += w * src[i];
+            }
+            for(int i = b; i < bEnd; i++)
+                dst[i] *= invWSum;
         }
+    }
 }
 
 
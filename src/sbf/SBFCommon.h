@@ -63,5 +63,52 @@ inline void ComputeSubWindow(int num, int count, int width, int height,
     *ye   = Floor2Int(Lerp(ty1, 0, height));
 
 }
- 
+
+const int c_TileSize = 16;
+
+/**
+ *  Coarse per-tile flags over an image. SBF marks the tiles that received
+ *  samples since the last update, and the filters skip pixels outside of
+ *  the marked tiles dilated by their footprint.
+ */
+class TileMask {
+public:
+    TileMask() : nTilesX(0), nTilesY(0) {}
+    TileMask(int width, int height, bool value) {
+        nTilesX = (width + c_TileSize - 1) / c_TileSize;
+        nTilesY = (height + c_TileSize - 1) / c_TileSize;
+        flags.assign(nTilesX * nTilesY, value ? 1 : 0);
+    }
+    bool operator()(int x, int y) const {
+        return flags[(y / c_TileSize) * nTilesX + x / c_TileSize] != 0;
+    }
+    // Called concurrently from AddSample(), all writers store the same value
+    void Mark(int x, int y) {
+        char &flag = flags[(y / c_TileSize) * nTilesX + x / c_TileSize];
+        if (!flag) flag = 1;
+    }
+    void Fill(bool value) {
+        std::fill(flags.begin(), flags.end(), value ? 1 : 0);
+    }
+    // Mask of the tiles within _radius_ pixels of a marked tile
+    TileMask Dilate(int radius) const {
+        TileMask dilated;
+        dilated.nTilesX = nTilesX;
+        dilated.nTilesY = nTilesY;
+        dilated.flags.assign(flags.size(), 0);
+        int r = (radius + c_TileSize - 1) / c_TileSize;
+        for (int ty = 0; ty < nTilesY; ty++)
+            for (int tx = 0; tx < nTilesX; tx++) {
+                if (!flags[ty * nTilesX + tx]) continue;
+                for (int y = max(ty - r, 0); y <= min(ty + r, nTilesY - 1); y++)
+                    for (int x = max(tx - r, 0); x <= min(tx + r, nTilesX - 1); x++)
+                        dilated.flags[y * nTilesX + x] = 1;
+            }
+        return dilated;
+    }
+private:
+    int nTilesX, nTilesY;
+    vector<char> flags;
+};
+
 #endif //#ifndef SBF_SBF_COMMON_H__
@@ -81,8 +81,12 @@ SBF::SBF(int xs, int ys, int w, int h,
     
     fltImg = TwoDArray<Color>(xPixelCount, yPixelCount);
     minMseImg = TwoDArray<float>(xPixelCount, yPixelCount);
-    adaptImg = TwoDArray<float>(xPixelCount, yPixelCount);
+    // Pixels without a valid MSE estimate are never assigned a metric
+    adaptImg = TwoDArray<float>(xPixelCount, yPixelCount, 0.f);
     sigmaImg = TwoDArray<Color>(xPixelCount, yPixelCount);
+
+    dirtyTiles = TileMask(xPixelCount, yPixelCount, false);
+    interCacheValid = false;
 }
 
 void SBF::AddSample(const CameraSample &sample, const Spectrum &L, 
@@ -93,6 +97,8 @@ void SBF::AddSample(const CameraSample &sample, const Spectrum &L,
     if (x < 0 || y < 0 || x >= xPixelCount || y >= yPixelCount) 
         return;    
 
+    dirtyTiles.Mark(x, y);
+
     // Update PixelInfo structure
     PixelInfo &pixelInfo = (*pixelInfos)(x, y);
 
@@ -119,7 +125,8 @@ void SBF::AddSample(const CameraSample &sample, const Spectrum &L,
     AtomicAdd((AtomicInt32*)&(pixelInfo.sampleCount), (int32_t)1);
 }
 
-void SBF::GetAdaptPixels(float avgSpp, vector<vector<int> > &pixOff, vector<vector<int> > &pixSmp) {
+void SBF::GetAdaptPixels(float avgSpp, vector<vector<int> > &pixOff, vector<vector<int> > &pixSmp,
+                         bool minOneSample) {
     Update(false);
 
     // Clear pixels
@@ -149,13 +156,36 @@ void SBF::GetAdaptPixels(float avgSpp, vector<vector<int> > &pixOff, vector<vect
     for(int y = 0; y < yPixelCount; y++) {
         pixSmp[y].resize(xPixelCount);
         for(int x = 0; x < xPixelCount; x++) {
-            pixSmp[y][x] = 
-                max((int)ceil(totalSamples * 
-                    (long double)adaptImg(x, y) * invProbSum), 1);
+            long double share = totalSamples * 
+                (long double)adaptImg(x, y) * invProbSum;
+            if(minOneSample) {
+                pixSmp[y][x] = max((int)ceil(share), 1);
+            } else {
+                // Round stochastically, pixels with a small share are often
+                // skipped and the tiles around them need no refiltering
+                int n = (int)floor(share);
+                pixSmp[y][x] = n + 
+                    (rng.RandomFloat() < (float)(share - (long double)n) ? 1 : 0);
+            }
         }
     }
 }
 
+float SBF::MeanEstimatedMSE() const {
+    long double mseSum = 0.0L;
+    int count = 0;
+    for(int y = 0; y < yPixelCount; y++)
+        for(int x = 0; x < xPixelCount; x++) {
+            float mse = minMseImg(x, y);
+            // Skip pixels without a valid estimate
+            if(mse >= 0.f && mse < numeric_limits<float>::max()) {
+                mseSum += (long double)mse;
+                count++;
+            }
+        }
+    return count > 0 ? (float)(mseSum/(long double)count) : 0.f;
+}
+
 float SBF::CalculateAvgSpp() const {
     unsigned long long totalSamples = 0;
     for(int y = 0; y < yPixelCount; y++)
@@ -165,50 +195,66 @@ float SBF::CalculateAvgSpp() const {
     return (float)avgSpp;
 }
 
-void SBF::WriteImage(const string &filename, int xres, int yres, bool dump) {
+void SBF::WriteImage(const string &filename, int xres, int yres, bool dump,
+                     bool multiLayer) {
     Update(true);
 
     string filenameBase = filename.substr(0, filename.rfind("."));
     string filenameExt  = filename.substr(filename.rfind("."));
 
-    WriteImage(filenameBase+"_sbf_img"+filenameExt, colImg, xres, yres);
-    WriteImage(filenameBase+"_sbf_flt"+filenameExt, fltImg, xres, yres);
     TwoDArray<Color> sImg = TwoDArray<Color>(xPixelCount, yPixelCount);
     for(int y = 0; y < yPixelCount; y++)
         for(int x = 0; x < xPixelCount; x++) {
             float sc = (float)(*pixelInfos)(x, y).sampleCount;
             sImg(x, y) = Color(sc, sc, sc);
         }        
-    WriteImage(filenameBase+"_sbf_smp"+filenameExt, sImg, xres, yres);
-    WriteImage(filenameBase+"_sbf_param"+filenameExt, sigmaImg, xres, yres);
     TwoDArray<Color> priColImg = FloatImageToColor(adaptImg);
-    WriteImage(filenameBase+"_sbf_pri"+filenameExt, priColImg, xres, yres);
+    TwoDArray<Color> depthColImg, dvColImg;
+
+    // The filtered image goes first, it is the default layer of multi-layer output
+    vector<string> names;
+    vector<const TwoDArray<Color> *> images;
+    names.push_back("flt");   images.push_back(&fltImg);
+    names.push_back("img");   images.push_back(&colImg);
+    names.push_back("smp");   images.push_back(&sImg);
+    names.push_back("param"); images.push_back(&sigmaImg);
+    names.push_back("pri");   images.push_back(&priColImg);
 
     if(dump) { // Write debug images
-        WriteImage(filenameBase+"_sbf_var"+filenameExt, varImg, xres, yres);
-        
         // Normals contain negative values, normalize them here
         for(int y = 0; y < norImg.GetRowNum(); y++)
             for(int x = 0; x < norImg.GetColNum(); x++) {
                 norImg(x, y) += Color(1.f, 1.f, 1.f);
                 norImg(x, y) /= 2.f;
             }
-        WriteImage(filenameBase+"_sbf_nor"+filenameExt, norImg, xres, yres);
-
-        WriteImage(filenameBase+"_sbf_nor_var"+filenameExt, norVarImg, xres, yres);
-        WriteImage(filenameBase+"_sbf_rho"+filenameExt, rhoImg, xres, yres);
-        WriteImage(filenameBase+"_sbf_rho_var"+filenameExt, rhoVarImg, xres, yres);
+        depthColImg = FloatImageToColor(depthImg);
+        dvColImg = FloatImageToColor(depthVarImg);
+
+        names.push_back("var");     images.push_back(&varImg);
+        names.push_back("nor");     images.push_back(&norImg);
+        names.push_back("nor_var"); images.push_back(&norVarImg);
+        names.push_back("rho");     images.push_back(&rhoImg);
+        names.push_back("rho_var"); images.push_back(&rhoVarImg);
+        names.push_back("dep");     images.push_back(&depthColImg);
+        names.push_back("dep_var"); images.push_back(&dvColImg);
+    }
 
-        TwoDArray<Color> depthColImg = FloatImageToColor(depthImg);
-        TwoDArray<Color> dvColImg = FloatImageToColor(depthVarImg);
-        WriteImage(filenameBase+"_sbf_dep"+filenameExt, depthColImg, xres, yres);
-        WriteImage(filenameBase+"_sbf_dep_var"+filenameExt, dvColImg, xres, yres);
+    // Images are copied when enqueued and written by the background image writer
+    if(multiLayer) {
+        vector<const float *> layers;
+        for(size_t i = 0; i < images.size(); i++)
+            layers.push_back((const float*)images[i]->GetRawPtr());
+        EnqueueImageLayersWrite(filenameBase+"_sbf"+filenameExt, names, layers,
+                xPixelCount, yPixelCount, xres, yres, xPixelStart, yPixelStart);
+    } else {
+        for(size_t i = 0; i < images.size(); i++)
+            WriteImage(filenameBase+"_sbf_"+names[i]+filenameExt, *images[i], xres, yres);
     }
 }
 
 void SBF::WriteImage(const string &filename, const TwoDArray<Color> &image, int xres, int yres) const {
-    ::WriteImage(filename, (float*)image.GetRawPtr(), NULL, xPixelCount, yPixelCount,
-                 xres, yres, xPixelStart, yPixelStart);
+    EnqueueImageWrite(filename, (const float*)image.GetRawPtr(), NULL, xPixelCount, yPixelCount,
+                      xres, yres, xPixelStart, yPixelStart);
 }
 
 TwoDArray<Color> SBF::FloatImageToColor(const TwoDArray<float> &image) const {
@@ -224,9 +270,20 @@ TwoDArray<Color> SBF::FloatImageToColor(const TwoDArray<float> &image) const {
 void SBF::Update(bool final) {
     ProgressReporter reporter(1, "Updating");
 
+    /**
+     *  Between adaptive iterations only the pixels that received samples
+     *  change, so intermediate updates recompute the statistics of the 
+     *  dirty tiles and reuse the previous filter outputs everywhere beyond 
+     *  the filter footprints around them. The final update uses different
+     *  parameters and always processes the full image.
+     */
+    bool incremental = !final && interCacheValid;
+
 #pragma omp parallel for num_threads(PbrtOptions.nCores)
     for(int y = 0; y < yPixelCount; y++)
         for(int x = 0;x < xPixelCount; x++) {
+            if(incremental && !dirtyTiles(x, y))
+                continue;
             PixelInfo &pixelInfo = (*pixelInfos)(x, y);
             float invSampleCount = 1.f/(float)pixelInfo.sampleCount;
             float invSampleCount_1 = 1.f/((float)pixelInfo.sampleCount-1.f);
@@ -309,58 +366,85 @@ void SBF::Update(bool final) {
 
 
     vector<float> sigma = final ? finalParams : interParams;
+    float mseSigma = final ? finalMseSigma : interMseSigma;
     Feature sigmaF;
     sigmaF[0] = sigmaF[1] = sigmaF[2] = sigmaN;
     sigmaF[3] = sigmaF[4] = sigmaF[5] = sigmaR;
     sigmaF[6] = sigmaD;
 
-    vector<TwoDArray<Color> > fltArray;
-    vector<TwoDArray<float> > mseArray;
-    vector<TwoDArray<float> > priArray;
-    vector<TwoDArray<float> > wSumArray;
-    vector<TwoDArray<float> > fltMseArray;
-    vector<TwoDArray<float> > fltPriArray;
-    for(size_t i = 0; i < sigma.size(); i++) {
-        fltArray.push_back(TwoDArray<Color>(xPixelCount, yPixelCount));
-        mseArray.push_back(TwoDArray<float>(xPixelCount, yPixelCount));
-        priArray.push_back(TwoDArray<float>(xPixelCount, yPixelCount));
-        wSumArray.push_back(TwoDArray<float>(xPixelCount, yPixelCount));
-        fltMseArray.push_back(TwoDArray<float>(xPixelCount, yPixelCount));
-        fltPriArray.push_back(TwoDArray<float>(xPixelCount, yPixelCount));
+    // The final parameters filter into temporary arrays, so that the 
+    // intermediate outputs are kept intact
+    vector<TwoDArray<Color> > finalFltArray;
+    vector<TwoDArray<float> > finalMseArray, finalPriArray;
+    vector<TwoDArray<float> > finalFltMseArray, finalFltPriArray;
+    vector<TwoDArray<Color> > &fltArray = final ? finalFltArray : interFltArray;
+    vector<TwoDArray<float> > &mseArray = final ? finalMseArray : interMseArray;
+    vector<TwoDArray<float> > &priArray = final ? finalPriArray : interPriArray;
+    vector<TwoDArray<float> > &fltMseArray = final ? finalFltMseArray : interFltMseArray;
+    vector<TwoDArray<float> > &fltPriArray = final ? finalFltPriArray : interFltPriArray;
+    if(fltArray.size() != sigma.size()) {
+        for(size_t i = 0; i < sigma.size(); i++) {
+            fltArray.push_back(TwoDArray<Color>(xPixelCount, yPixelCount));
+            mseArray.push_back(TwoDArray<float>(xPixelCount, yPixelCount));
+            priArray.push_back(TwoDArray<float>(xPixelCount, yPixelCount));
+            fltMseArray.push_back(TwoDArray<float>(xPixelCount, yPixelCount));
+            fltPriArray.push_back(TwoDArray<float>(xPixelCount, yPixelCount));
+        }
     }
 
+    vector<CrossBilateralFilter> cbFilters;
+    int fltRadius = 0;
     if(fType == CROSS_BILATERAL_FILTER) {
         for(size_t i = 0; i < sigma.size(); i++) {
-            CrossBilateralFilter cbFilter(sigma[i], c_SigmaC, sigmaF, xPixelCount, yPixelCount); 
-            TwoDArray<Color> flt(xPixelCount, yPixelCount);
-            TwoDArray<float> mse(xPixelCount, yPixelCount);            
-            TwoDArray<float> pri(xPixelCount, yPixelCount);
-            cbFilter.Apply(colImg, featureImg, featureVarImg, rColImg, varImg, rVarImg, flt, mse, pri);
-            mseArray[i] = mse;
-            priArray[i] = pri;
-            fltArray[i] = flt;
-        }    
+            cbFilters.push_back(CrossBilateralFilter(sigma[i], c_SigmaC, sigmaF, 
+                                                     xPixelCount, yPixelCount));
+            fltRadius = max(fltRadius, cbFilters.back().Radius());
+        }
+    }
+    CrossNLMFilter nlmFilter(final ? 20 : 10, 2, sigma, sigmaF, 
+            xPixelCount, yPixelCount);
+    if(fType == CROSS_NLM_FILTER)
+        fltRadius = nlmFilter.Radius();
+    // We use cross bilateral filter to filter MSE estimation even for NLM filters.
+    CrossBilateralFilter mseFilter(mseSigma, 0.f, sigmaF, xPixelCount, yPixelCount); 
+
+    // A filtered pixel depends on the reconstructed image within the
+    // filter radius, and the filtered MSE on the MSE within its own radius
+    TileMask fltMask, mseMask;
+    if(incremental) {
+        fltMask = dirtyTiles.Dilate(rFilter.Radius() + fltRadius);
+        mseMask = dirtyTiles.Dilate(rFilter.Radius() + fltRadius + 
+                                    mseFilter.Radius());
+    }
 
-        CrossBilateralFilter mseFilter(final ? finalMseSigma : interMseSigma, 0.f, 
-                                       sigmaF, xPixelCount, yPixelCount); 
-        mseFilter.Apply(mseArray, priArray, featureImg, featureVarImg, fltMseArray, fltPriArray);
+    if(fType == CROSS_BILATERAL_FILTER) {
+        for(size_t i = 0; i < sigma.size(); i++) {
+            cbFilters[i].Apply(colImg, featureImg, featureVarImg, rColImg, varImg, rVarImg, 
+                               fltArray[i], mseArray[i], priArray[i],
+                               incremental ? &fltMask : NULL);
+        }    
     } else { //fType == CROSS_NLM_FILTER
-        CrossNLMFilter nlmFilter(final ? 20 : 10, 2, sigma, sigmaF, 
-                xPixelCount, yPixelCount);
         nlmFilter.Apply(colImg, featureImg, featureVarImg, 
-                rColImg, rVarImg, fltArray, mseArray, priArray);
-        // We use cross bilateral filter to filter MSE estimation even for NLM filters.
-        CrossBilateralFilter mseFilter(final ? finalMseSigma : interMseSigma, 0.f, 
-                                       sigmaF, xPixelCount, yPixelCount);   
-        mseFilter.Apply(mseArray, priArray, featureImg, featureVarImg, fltMseArray, fltPriArray);
+                rColImg, rVarImg, fltArray, mseArray, priArray,
+                incremental ? &fltMask : NULL);
         //filter.ApplyMSE(0.04f, mseArray, priArray, rColImg, featureImg, featureVarImg, fltMseArray, fltPriArray);
     }
+    mseFilter.Apply(mseArray, priArray, featureImg, featureVarImg, fltMseArray, fltPriArray,
+                    incremental ? &mseMask : NULL);
 
-    minMseImg = numeric_limits<float>::infinity();   
+    if(incremental) {
+        for(int y = 0; y < yPixelCount; y++)
+            for(int x = 0; x < xPixelCount; x++)
+                if(mseMask(x, y))
+                    minMseImg(x, y) = numeric_limits<float>::infinity();
+    } else
+        minMseImg = numeric_limits<float>::infinity();   
     for(size_t i = 0; i < sigma.size(); i++) {
 #pragma omp parallel for num_threads(PbrtOptions.nCores)
         for(int y = 0; y < yPixelCount; y++)
             for(int x = 0; x < xPixelCount; x++) {
+                if(incremental && !mseMask(x, y))
+                    continue;
                 float error = fltMseArray[i](x, y);                
                 float pri = fltPriArray[i](x, y);
                 if(error < minMseImg(x, y)) {
@@ -373,6 +457,11 @@ void SBF::Update(bool final) {
             }
     }
 
+    // The final update overwrites the selected outputs, so the next 
+    // intermediate update has to start over
+    dirtyTiles.Fill(false);
+    interCacheValid = !final;
+
     reporter.Update();
     reporter.Done();
 
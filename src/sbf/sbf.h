@@ -65,10 +65,14 @@ public:
     }
     void AddSample(const CameraSample &sample, const Spectrum &L, 
             const Intersection &isect);
-    void GetAdaptPixels(float avgSpp, vector<vector<int> > &pixOff, vector<vector<int> > &pixSmp);
-    void WriteImage(const string &filename, int xres, int yres, bool dump);
+    void GetAdaptPixels(float avgSpp, vector<vector<int> > &pixOff, vector<vector<int> > &pixSmp,
+                        bool minOneSample = true);
+    void WriteImage(const string &filename, int xres, int yres, bool dump,
+                    bool multiLayer);
 
     void Update(bool final);
+    // Mean of the per-pixel MSE estimates from the last Update()
+    float MeanEstimatedMSE() const;
 private:
     void WriteImage(const string &filename, const TwoDArray<Color> &image, int xres, int yres) const;
     TwoDArray<Color> FloatImageToColor(const TwoDArray<float> &image) const;
@@ -127,6 +131,15 @@ private:
     TwoDArray<float> minMseImg;
     TwoDArray<Color> sigmaImg;
 
+    // Tiles that received samples since the last Update()
+    TileMask dirtyTiles;
+    // Filter outputs for the intermediate parameters, intermediate 
+    // updates only recompute them around the dirty tiles
+    vector<TwoDArray<Color> > interFltArray;
+    vector<TwoDArray<float> > interMseArray, interPriArray;
+    vector<TwoDArray<float> > interFltMseArray, interFltPriArray;
+    bool interCacheValid;
+
     RNG rng;
 };
 
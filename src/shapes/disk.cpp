@@ -157,3 +157,11 @@ Point Disk::Sample(float u1, float u2, Normal *Ns) const {
 }
 
 
+bool Disk::GetNormalCone(Vector *axis, float *cosTheta) const {
+    *axis = Normalize(Vector((*ObjectToWorld)(Normal(0,0,1))));
+    if (ReverseOrientation) *axis = -*axis;
+    *cosTheta = 1.f;
+    return true;
+}
+
+
@@ -51,6 +51,7 @@ public:
     bool IntersectP(const Ray &ray) const;
     float Area() const;
     Point Sample(float u1, float u2, Normal *Ns) const;
+    bool GetNormalCone(Vector *axis, float *cosTheta) const;
 private:
     // Disk Private Data
     float height, radius, innerRadius, phiMax;
@@ -456,3 +456,28 @@ Point Triangle::Sample(float u1, float u2, Normal *Ns) const {
 }
 
 
+bool Triangle::GetNormalCone(Vector *axis, float *cosTheta) const {
+    // Orient the normal as _Intersect()_ does; area lights emit along it
+    const Point &p1 = mesh->p[v[0]];
+    const Point &p2 = mesh->p[v[1]];
+    const Point &p3 = mesh->p[v[2]];
+    float uvs[3][2];
+    GetUVs(uvs);
+    float du1 = uvs[0][0] - uvs[2][0];
+    float du2 = uvs[1][0] - uvs[2][0];
+    float dv1 = uvs[0][1] - uvs[2][1];
+    float dv2 = uvs[1][1] - uvs[2][1];
+    float determinant = du1 * dv2 - dv1 * du2;
+    Vector n = Cross(p3 - p1, p2 - p1);
+    if (determinant != 0.f) {
+        Vector dp1 = p1 - p3, dp2 = p2 - p3;
+        n = Cross(dv2 * dp1 - dv1 * dp2, -du2 * dp1 + du1 * dp2);
+    }
+    if (n.LengthSquared() == 0.f) return false;
+    *axis = Normalize(n);
+    if (ReverseOrientation ^ TransformSwapsHandedness) *axis = -*axis;
+    *cosTheta = 1.f;
+    return true;
+}
+
+
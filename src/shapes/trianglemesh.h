@@ -103,6 +103,7 @@ public:
             const DifferentialGeometry &dg,
             DifferentialGeometry *dgShading) const;
     Point Sample(float u1, float u2, Normal *Ns) const;
+    bool GetNormalCone(Vector *axis, float *cosTheta) const;
 private:
     // Triangle Private Data
     Reference<TriangleMesh> mesh;
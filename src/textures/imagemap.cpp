@@ -34,15 +34,16 @@
 #include "stdafx.h"
 #include "textures/imagemap.h"
 #include "imageio.h"
+#include "fileutil.h"
 
 // ImageTexture Method Definitions
 template <typename Tmemory, typename Treturn>
 ImageTexture<Tmemory, Treturn>::ImageTexture(TextureMapping2D *m,
         const string &filename, bool doTrilinear, float maxAniso,
-        ImageWrap wrapMode, float scale, float gamma) {
+        ImageWrap wrapMode, float scale, float gamma, const string &storage) {
     mapping = m;
     mipmap = GetTexture(filename, doTrilinear, maxAniso,
-                        wrapMode, scale, gamma);
+                        wrapMode, scale, gamma, storage);
 }
 
 
@@ -55,9 +56,9 @@ template <typename Tmemory, typename Treturn>
 template <typename Tmemory, typename Treturn> MIPMap<Tmemory> *
 ImageTexture<Tmemory, Treturn>::GetTexture(const string &filename,
         bool doTrilinear, float maxAniso, ImageWrap wrap,
-        float scale, float gamma) {
+        float scale, float gamma, const string &storage) {
     // Look for texture in texture cache
-    TexInfo texInfo(filename, doTrilinear, maxAniso, wrap, scale, gamma);
+    TexInfo texInfo(filename, doTrilinear, maxAniso, wrap, scale, gamma, storage);
     if (textures.find(texInfo) != textures.end())
         return textures[texInfo];
     int width, height;
@@ -68,8 +69,13 @@ ImageTexture<Tmemory, Treturn>::GetTexture(const string &filename,
         Tmemory *convertedTexels = new Tmemory[width*height];
         for (int i = 0; i < width*height; ++i)
             convertIn(texels[i], &convertedTexels[i], scale, gamma);
+        TexelFormat format = chooseTexelFormat(filename, storage, gamma);
         ret = new MIPMap<Tmemory>(width, height, convertedTexels, doTrilinear,
-                                  maxAniso, wrap);
+                                  maxAniso, wrap, format);
+        if (ret->Format() != format && storage != "auto")
+            Warning("Texture \"%s\" has values outside [0,1]; using \"half\" "
+                    "texel storage instead of \"%s\".", filename.c_str(),
+                    storage.c_str());
         delete[] texels;
         delete[] convertedTexels;
     }
@@ -86,6 +92,26 @@ ImageTexture<Tmemory, Treturn>::GetTexture(const string &filename,
 }
 
 
+template <typename Tmemory, typename Treturn> TexelFormat
+ImageTexture<Tmemory, Treturn>::chooseTexelFormat(const string &filename,
+        const string &storage, float gamma) {
+    // Determine requested texel storage, picking one from the source format for _"auto"_
+    TexelFormat format = TEXEL_FLOAT;
+    if (storage == "half") format = TEXEL_HALF;
+    else if (storage == "byte") format = TEXEL_BYTE;
+    else if (storage == "srgb8") format = TEXEL_SRGB8;
+    else if (storage == "auto") {
+        if (HasExtension(filename, ".tga"))
+            format = (gamma == 1.f) ? TEXEL_BYTE : TEXEL_SRGB8;
+        else if (HasExtension(filename, ".exr"))
+            format = TEXEL_HALF;
+    }
+    else if (storage != "float")
+        Error("Texel storage \"%s\" unknown. Using \"float\".", storage.c_str());
+    return format;
+}
+
+
 template <typename Tmemory, typename Treturn>
     std::map<TexInfo,
              MIPMap<Tmemory> *> ImageTexture<Tmemory, Treturn>::textures;
@@ -133,8 +159,9 @@ ImageTexture<float, float> *CreateImageFloatTexture(const Transform &tex2world,
     else if (wrap == "clamp") wrapMode = TEXTURE_CLAMP;
     float scale = tp.FindFloat("scale", 1.f);
     float gamma = tp.FindFloat("gamma", 1.f);
+    string storage = tp.FindString("storage", "auto");
     return new ImageTexture<float, float>(map, tp.FindFilename("filename"),
-        trilerp, maxAniso, wrapMode, scale, gamma);
+        trilerp, maxAniso, wrapMode, scale, gamma, storage);
 }
 
 
@@ -171,8 +198,9 @@ ImageTexture<RGBSpectrum, Spectrum> *CreateImageSpectrumTexture(const Transform
     else if (wrap == "clamp") wrapMode = TEXTURE_CLAMP;
     float scale = tp.FindFloat("scale", 1.f);
     float gamma = tp.FindFloat("gamma", 1.f);
+    string storage = tp.FindString("storage", "auto");
     return new ImageTexture<RGBSpectrum, Spectrum>(map, tp.FindFilename("filename"),
-        trilerp, maxAniso, wrapMode, scale, gamma);
+        trilerp, maxAniso, wrapMode, scale, gamma, storage);
 }
 
 
@@ -45,19 +45,23 @@
 
 // TexInfo Declarations
 struct TexInfo {
-    TexInfo(const string &f, bool dt, float ma, ImageWrap wm, float sc, float ga)
-        : filename(f), doTrilinear(dt), maxAniso(ma), wrapMode(wm), scale(sc), gamma(ga) { }
+    TexInfo(const string &f, bool dt, float ma, ImageWrap wm, float sc, float ga,
+            const string &st)
+        : filename(f), doTrilinear(dt), maxAniso(ma), wrapMode(wm), scale(sc), gamma(ga),
+          storage(st) { }
     string filename;
     bool doTrilinear;
     float maxAniso;
     ImageWrap wrapMode;
     float scale, gamma;
+    string storage;
     bool operator<(const TexInfo &t2) const {
         if (filename != t2.filename) return filename < t2.filename;
         if (doTrilinear != t2.doTrilinear) return doTrilinear < t2.doTrilinear;
         if (maxAniso != t2.maxAniso) return maxAniso < t2.maxAniso;
         if (scale != t2.scale) return scale < t2.scale;
         if (gamma != t2.gamma) return gamma < t2.gamma;
+        if (storage != t2.storage) return storage < t2.storage;
         return wrapMode < t2.wrapMode;
     }
 };
@@ -70,7 +74,8 @@ template <typename Tmemory, typename Treturn>
 public:
     // ImageTexture Public Methods
     ImageTexture(TextureMapping2D *m, const string &filename, bool doTri,
-                 float maxAniso, ImageWrap wm, float scale, float gamma);
+                 float maxAniso, ImageWrap wm, float scale, float gamma,
+                 const string &storage = "auto");
     Treturn Evaluate(const DifferentialGeometry &) const;
     ~ImageTexture();
     static void ClearCache() {
@@ -85,7 +90,10 @@ public:
 private:
     // ImageTexture Private Methods
     static MIPMap<Tmemory> *GetTexture(const string &filename,
-        bool doTrilinear, float maxAniso, ImageWrap wm, float scale, float gamma);
+        bool doTrilinear, float maxAniso, ImageWrap wm, float scale, float gamma,
+        const string &storage);
+    static TexelFormat chooseTexelFormat(const string &filename,
+        const string &storage, float gamma);
     static void convertIn(const RGBSpectrum &from, RGBSpectrum *to,
                           float scale, float gamma) {
         *to = Pow(scale * from, gamma);